@@ -0,0 +1,174 @@
+#include "animation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "downsample.h"
+#include "stats.h"
+
+using namespace std;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+string playbackModeName(PlaybackMode mode) {
+    switch (mode) {
+        case PlaybackMode::Forward: return "forward";
+        case PlaybackMode::Backward: return "backward";
+        case PlaybackMode::Bounce: return "bounce";
+    }
+    return "unknown";
+}
+
+// Channel shown in the given frame
+static int frameChannel(PlaybackMode mode, int startChannel, int frame, int depth) {
+    switch (mode) {
+        case PlaybackMode::Forward:
+            return (startChannel + frame) % depth;
+        case PlaybackMode::Backward:
+            return ((startChannel - frame) % depth + depth) % depth;
+        default: {
+            int period = max(1, 2 * (depth - 1));
+            int phase = (startChannel + frame) % period;
+            return phase < depth ? phase : period - phase;
+        }
+    }
+}
+
+AnimationResult playAnimation(vector<unique_ptr<DataReader>>& readers, const vector<hsize_t>& dims, PlaybackMode mode,
+                              int startChannel, const AnimationOptions& options) {
+    int rank = dims.size();
+    hsize_t width = dims[rank - 1];
+    hsize_t height = dims[rank - 2];
+    int depth = (rank > 2) ? dims[rank - 3] : 1;
+    int frames = max(1, options.frames);
+    int mip = 1;
+    while (width / mip > options.viewWidth) {
+        mip *= 2;
+    }
+
+    vector<int> channels(frames);
+    for (auto i = 0; i < frames; i++) {
+        channels[i] = frameChannel(mode, startChannel, i, depth);
+    }
+
+    // Frame i is read into buffer i % slots, which is reused once frame i has been displayed
+    unsigned slots = options.prefetch + 1;
+    vector<vector<float>> buffers(slots, vector<float>(width * height));
+    vector<float> view((height / mip) * (width / mip));
+
+    auto loadFrame = [&](DataReader* reader, int frame) {
+        vector<hsize_t> count = {1, height, width};
+        vector<hsize_t> start = {hsize_t(channels[frame]), 0, 0};
+        if (rank == 4) {
+            count.insert(count.begin(), 1);
+            start.insert(start.begin(), options.stokes);
+        }
+        reader->read(start, count, buffers[frame % slots].data());
+    };
+
+    // Requested frames are read by the I/O threads in order, and marked as loaded
+    mutex queueMutex;
+    condition_variable queueChanged;
+    deque<int> requests;
+    vector<char> loaded(frames, 0);
+    bool stopping = false;
+    vector<thread> ioThreads;
+    if (options.prefetch > 0) {
+        for (auto t = 0; t < max(1u, options.ioThreads); t++) {
+            ioThreads.emplace_back([&, t]() {
+                while (true) {
+                    int frame;
+                    {
+                        unique_lock<mutex> lock(queueMutex);
+                        queueChanged.wait(lock, [&]() { return stopping || !requests.empty(); });
+                        if (stopping) {
+                            return;
+                        }
+                        frame = requests.front();
+                        requests.pop_front();
+                    }
+                    loadFrame(readers[t].get(), frame);
+                    {
+                        lock_guard<mutex> lock(queueMutex);
+                        loaded[frame] = 1;
+                    }
+                    queueChanged.notify_all();
+                }
+            });
+        }
+    }
+
+    auto frameInterval = std::chrono::duration<double>(options.fps > 0 ? 1.0 / options.fps : 0.0);
+    vector<double> presented;
+    double waitSeconds = 0, computeSeconds = 0;
+    int hits = 0, nextRequest = 0;
+    auto tStart = Clock::now();
+
+    for (auto i = 0; i < frames; i++) {
+        auto t0 = Clock::now();
+        if (options.prefetch > 0) {
+            unique_lock<mutex> lock(queueMutex);
+            while (nextRequest < frames && nextRequest <= i + (int) options.prefetch) {
+                requests.push_back(nextRequest++);
+            }
+            queueChanged.notify_all();
+            if (loaded[i] && i > 0) {
+                hits++;
+            }
+            queueChanged.wait(lock, [&]() { return loaded[i] != 0; });
+        } else {
+            loadFrame(readers[0].get(), i);
+        }
+
+        auto t1 = Clock::now();
+        const float* frame = buffers[i % slots].data();
+        if (mip > 1) {
+            downsample(frame, height, width, width, mip, DownsampleFilter::Mean, view.data());
+        }
+        // Statistics a viewer computes for each channel it displays
+        calculateStats(frame, width * height);
+
+        auto t2 = Clock::now();
+        waitSeconds += std::chrono::duration<double>(t1 - t0).count();
+        computeSeconds += std::chrono::duration<double>(t2 - t1).count();
+        presented.push_back(std::chrono::duration<double>(t2 - tStart).count());
+
+        // Frames that are ready early are held back until their slot in the target frame rate
+        if (options.fps > 0) {
+            this_thread::sleep_until(tStart + std::chrono::duration_cast<Clock::duration>(frameInterval * (i + 1)));
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    for (auto& ioThread : ioThreads) {
+        ioThread.join();
+    }
+
+    AnimationResult result;
+    result.totalMs = presented.back() * 1.0e3;
+    result.fps = frames / presented.back();
+    double meanInterval = 0, variance = 0;
+    for (auto i = 1; i < frames; i++) {
+        meanInterval += presented[i] - presented[i - 1];
+    }
+    meanInterval = frames > 1 ? meanInterval / (frames - 1) : 0;
+    for (auto i = 1; i < frames; i++) {
+        double deviation = presented[i] - presented[i - 1] - meanInterval;
+        variance += deviation * deviation;
+    }
+    result.jitterMs = frames > 1 ? sqrt(variance / (frames - 1)) * 1.0e3 : 0;
+    result.prefetchHitPct = frames > 1 ? hits * 100.0 / (frames - 1) : NAN;
+    result.waitMs = waitSeconds * 1.0e3;
+    result.computeMs = computeSeconds * 1.0e3;
+    result.bytes = size_t(frames) * width * height * sizeof(float);
+    return result;
+}
@@ -0,0 +1,53 @@
+#ifndef ADASS_HDF5_BENCHMARK_ANIMATION_H
+#define ADASS_HDF5_BENCHMARK_ANIMATION_H
+
+#include <H5Cpp.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "reader.h"
+
+enum class PlaybackMode {
+    Forward,
+    Backward,
+    // Forward to the last channel, then backward to the first, and so on
+    Bounce
+};
+
+std::string playbackModeName(PlaybackMode mode);
+
+struct AnimationOptions {
+    // Frames played per run
+    int frames = 64;
+    // Target frame rate; 0 plays frames as fast as they can be produced
+    double fps = 30;
+    // Frames read ahead of the one being displayed; 0 reads each frame when it is needed
+    unsigned prefetch = 4;
+    unsigned ioThreads = 2;
+    // Frames are down-sampled (mean) to at most this width, as a viewer would before sending them
+    int viewWidth = 1024;
+    // Stokes plane played, for 4D cubes
+    int stokes = 0;
+};
+
+struct AnimationResult {
+    double totalMs;
+    double fps;
+    // Standard deviation of the intervals between frames
+    double jitterMs;
+    // Share of frames (after the first) that had already been read when they were needed
+    double prefetchHitPct;
+    // Time spent waiting for frames to be read, and down-sampling them and computing their statistics
+    double waitMs, computeMs;
+    size_t bytes;
+};
+
+// Plays the XY planes of consecutive channels of a ([stokes,] depth, height, width) cube, starting at startChannel.
+// While each frame is down-sampled and its statistics computed, I/O threads read the following frames into a bounded
+// ring of buffers. readers holds one reader per I/O thread, since raw readers are not thread-safe; with prefetch 0,
+// frames are read synchronously with the first one.
+AnimationResult playAnimation(std::vector<std::unique_ptr<DataReader>>& readers, const std::vector<hsize_t>& dims,
+                              PlaybackMode mode, int startChannel, const AnimationOptions& options);
+
+#endif //ADASS_HDF5_BENCHMARK_ANIMATION_H
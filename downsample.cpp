@@ -0,0 +1,285 @@
+#include "downsample.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <immintrin.h>
+
+using namespace std;
+
+// Largest block edge sampled in full by the median filter
+static const int medianSampleEdge = 8;
+
+// Accumulates one input row into per-column partial results, counting the non-NaN values in each column
+typedef void (*AccumulateFunction)(const float* row, float* values, float* counts, size_t n);
+
+static SimdLevel activeSimdLevel = detectSimdLevel();
+
+string filterName(DownsampleFilter filter) {
+    switch (filter) {
+        case DownsampleFilter::Mean: return "mean";
+        case DownsampleFilter::Nearest: return "nn";
+        case DownsampleFilter::Min: return "min";
+        case DownsampleFilter::Max: return "max";
+        case DownsampleFilter::Median: return "median";
+    }
+    return "unknown";
+}
+
+bool parseSimdLevel(const string& name, SimdLevel& level) {
+    if (name == "scalar") {
+        level = SimdLevel::Scalar;
+    } else if (name == "avx2") {
+        level = SimdLevel::Avx2;
+    } else if (name == "avx512") {
+        level = SimdLevel::Avx512;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+string simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::Avx2: return "avx2";
+        case SimdLevel::Avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+SimdLevel detectSimdLevel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::Avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::Avx2;
+    }
+    return SimdLevel::Scalar;
+}
+
+void setSimdLevel(SimdLevel level) {
+    activeSimdLevel = min(level, detectSimdLevel());
+}
+
+SimdLevel getSimdLevel() {
+    return activeSimdLevel;
+}
+
+static void accumulateSumScalar(const float* row, float* sums, float* counts, size_t n) {
+    for (size_t x = 0; x < n; x++) {
+        float val = row[x];
+        bool valid = !isnan(val);
+        sums[x] += valid ? val : 0.0f;
+        counts[x] += valid ? 1.0f : 0.0f;
+    }
+}
+
+static void accumulateMinScalar(const float* row, float* minima, float* counts, size_t n) {
+    for (size_t x = 0; x < n; x++) {
+        float val = row[x];
+        bool valid = !isnan(val);
+        minima[x] = (valid && val < minima[x]) ? val : minima[x];
+        counts[x] += valid ? 1.0f : 0.0f;
+    }
+}
+
+static void accumulateMaxScalar(const float* row, float* maxima, float* counts, size_t n) {
+    for (size_t x = 0; x < n; x++) {
+        float val = row[x];
+        bool valid = !isnan(val);
+        maxima[x] = (valid && val > maxima[x]) ? val : maxima[x];
+        counts[x] += valid ? 1.0f : 0.0f;
+    }
+}
+
+// NaNs compare unordered with themselves, which gives the validity mask. The min/max instructions return
+// their second operand if either is NaN, so passing the accumulator second skips invalid values.
+__attribute__((target("avx2")))
+static void accumulateSumAvx2(const float* row, float* sums, float* counts, size_t n) {
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    size_t x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256 val = _mm256_loadu_ps(row + x);
+        __m256 valid = _mm256_cmp_ps(val, val, _CMP_ORD_Q);
+        _mm256_storeu_ps(sums + x, _mm256_add_ps(_mm256_loadu_ps(sums + x), _mm256_and_ps(valid, val)));
+        _mm256_storeu_ps(counts + x, _mm256_add_ps(_mm256_loadu_ps(counts + x), _mm256_and_ps(valid, ones)));
+    }
+    accumulateSumScalar(row + x, sums + x, counts + x, n - x);
+}
+
+__attribute__((target("avx2")))
+static void accumulateMinAvx2(const float* row, float* minima, float* counts, size_t n) {
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    size_t x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256 val = _mm256_loadu_ps(row + x);
+        __m256 valid = _mm256_cmp_ps(val, val, _CMP_ORD_Q);
+        _mm256_storeu_ps(minima + x, _mm256_min_ps(val, _mm256_loadu_ps(minima + x)));
+        _mm256_storeu_ps(counts + x, _mm256_add_ps(_mm256_loadu_ps(counts + x), _mm256_and_ps(valid, ones)));
+    }
+    accumulateMinScalar(row + x, minima + x, counts + x, n - x);
+}
+
+__attribute__((target("avx2")))
+static void accumulateMaxAvx2(const float* row, float* maxima, float* counts, size_t n) {
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    size_t x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256 val = _mm256_loadu_ps(row + x);
+        __m256 valid = _mm256_cmp_ps(val, val, _CMP_ORD_Q);
+        _mm256_storeu_ps(maxima + x, _mm256_max_ps(val, _mm256_loadu_ps(maxima + x)));
+        _mm256_storeu_ps(counts + x, _mm256_add_ps(_mm256_loadu_ps(counts + x), _mm256_and_ps(valid, ones)));
+    }
+    accumulateMaxScalar(row + x, maxima + x, counts + x, n - x);
+}
+
+__attribute__((target("avx512f")))
+static void accumulateSumAvx512(const float* row, float* sums, float* counts, size_t n) {
+    const __m512 ones = _mm512_set1_ps(1.0f);
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m512 val = _mm512_loadu_ps(row + x);
+        __mmask16 valid = _mm512_cmp_ps_mask(val, val, _CMP_ORD_Q);
+        __m512 sum = _mm512_loadu_ps(sums + x);
+        __m512 count = _mm512_loadu_ps(counts + x);
+        _mm512_storeu_ps(sums + x, _mm512_mask_add_ps(sum, valid, sum, val));
+        _mm512_storeu_ps(counts + x, _mm512_mask_add_ps(count, valid, count, ones));
+    }
+    accumulateSumScalar(row + x, sums + x, counts + x, n - x);
+}
+
+__attribute__((target("avx512f")))
+static void accumulateMinAvx512(const float* row, float* minima, float* counts, size_t n) {
+    const __m512 ones = _mm512_set1_ps(1.0f);
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m512 val = _mm512_loadu_ps(row + x);
+        __mmask16 valid = _mm512_cmp_ps_mask(val, val, _CMP_ORD_Q);
+        __m512 minimum = _mm512_loadu_ps(minima + x);
+        __m512 count = _mm512_loadu_ps(counts + x);
+        _mm512_storeu_ps(minima + x, _mm512_mask_min_ps(minimum, valid, minimum, val));
+        _mm512_storeu_ps(counts + x, _mm512_mask_add_ps(count, valid, count, ones));
+    }
+    accumulateMinScalar(row + x, minima + x, counts + x, n - x);
+}
+
+__attribute__((target("avx512f")))
+static void accumulateMaxAvx512(const float* row, float* maxima, float* counts, size_t n) {
+    const __m512 ones = _mm512_set1_ps(1.0f);
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m512 val = _mm512_loadu_ps(row + x);
+        __mmask16 valid = _mm512_cmp_ps_mask(val, val, _CMP_ORD_Q);
+        __m512 maximum = _mm512_loadu_ps(maxima + x);
+        __m512 count = _mm512_loadu_ps(counts + x);
+        _mm512_storeu_ps(maxima + x, _mm512_mask_max_ps(maximum, valid, maximum, val));
+        _mm512_storeu_ps(counts + x, _mm512_mask_add_ps(count, valid, count, ones));
+    }
+    accumulateMaxScalar(row + x, maxima + x, counts + x, n - x);
+}
+
+static AccumulateFunction accumulateFunction(DownsampleFilter filter) {
+    static const AccumulateFunction functions[3][3] = {
+        {accumulateSumScalar, accumulateMinScalar, accumulateMaxScalar},
+        {accumulateSumAvx2, accumulateMinAvx2, accumulateMaxAvx2},
+        {accumulateSumAvx512, accumulateMinAvx512, accumulateMaxAvx512}
+    };
+    int index = (filter == DownsampleFilter::Min) ? 1 : (filter == DownsampleFilter::Max) ? 2 : 0;
+    return functions[(int) activeSimdLevel][index];
+}
+
+static void downsampleNearest(const float* in, long long outRows, long long outColumns, size_t stride, int mip, float* out) {
+#pragma omp parallel for schedule(static)
+    for (long long j = 0; j < outRows; j++) {
+        const float* inRow = in + j * mip * stride;
+        float* outRow = out + j * outColumns;
+        for (long long i = 0; i < outColumns; i++) {
+            outRow[i] = inRow[i * mip];
+        }
+    }
+}
+
+static void downsampleMedian(const float* in, long long outRows, long long outColumns, size_t stride, int mip, float* out) {
+    int step = max(1, mip / medianSampleEdge);
+#pragma omp parallel
+    {
+        vector<float> samples;
+        samples.reserve(medianSampleEdge * medianSampleEdge);
+#pragma omp for schedule(static)
+        for (long long j = 0; j < outRows; j++) {
+            for (long long i = 0; i < outColumns; i++) {
+                samples.clear();
+                for (auto y = 0; y < mip; y += step) {
+                    const float* inRow = in + (j * mip + y) * stride + i * mip;
+                    for (auto x = 0; x < mip; x += step) {
+                        if (!isnan(inRow[x])) {
+                            samples.push_back(inRow[x]);
+                        }
+                    }
+                }
+                if (samples.empty()) {
+                    out[j * outColumns + i] = NAN;
+                } else {
+                    auto middle = samples.begin() + samples.size() / 2;
+                    nth_element(samples.begin(), middle, samples.end());
+                    out[j * outColumns + i] = *middle;
+                }
+            }
+        }
+    }
+}
+
+void downsample(const float* in, size_t rows, size_t columns, size_t stride, int mip, DownsampleFilter filter, float* out) {
+    long long outRows = rows / mip;
+    long long outColumns = columns / mip;
+    size_t usedColumns = outColumns * mip;
+
+    if (filter == DownsampleFilter::Nearest) {
+        downsampleNearest(in, outRows, outColumns, stride, mip, out);
+        return;
+    } else if (filter == DownsampleFilter::Median) {
+        downsampleMedian(in, outRows, outColumns, stride, mip, out);
+        return;
+    }
+
+    auto accumulate = accumulateFunction(filter);
+    float initialValue = (filter == DownsampleFilter::Min) ? INFINITY : (filter == DownsampleFilter::Max) ? -INFINITY : 0.0f;
+
+#pragma omp parallel
+    {
+        // Per-column partial results for the mip input rows of one output row
+        vector<float> values(usedColumns), counts(usedColumns);
+#pragma omp for schedule(static)
+        for (long long j = 0; j < outRows; j++) {
+            fill(values.begin(), values.end(), initialValue);
+            fill(counts.begin(), counts.end(), 0.0f);
+            for (auto y = 0; y < mip; y++) {
+                accumulate(in + (j * mip + y) * stride, values.data(), counts.data(), usedColumns);
+            }
+
+            float* outRow = out + j * outColumns;
+            for (long long i = 0; i < outColumns; i++) {
+                const float* blockValues = values.data() + i * mip;
+                const float* blockCounts = counts.data() + i * mip;
+                float count = 0;
+                float result = initialValue;
+                for (auto x = 0; x < mip; x++) {
+                    count += blockCounts[x];
+                    if (filter == DownsampleFilter::Mean) {
+                        result += blockValues[x];
+                    } else if (filter == DownsampleFilter::Min) {
+                        result = min(result, blockValues[x]);
+                    } else {
+                        result = max(result, blockValues[x]);
+                    }
+                }
+                if (count == 0) {
+                    outRow[i] = NAN;
+                } else {
+                    outRow[i] = (filter == DownsampleFilter::Mean) ? result / count : result;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef ADASS_HDF5_BENCHMARK_DOWNSAMPLE_H
+#define ADASS_HDF5_BENCHMARK_DOWNSAMPLE_H
+
+#include <cstddef>
+#include <string>
+
+enum class DownsampleFilter {
+    Mean,
+    Nearest,
+    Min,
+    Max,
+    Median
+};
+
+enum class SimdLevel {
+    Scalar,
+    Avx2,
+    Avx512
+};
+
+std::string filterName(DownsampleFilter filter);
+
+bool parseSimdLevel(const std::string& name, SimdLevel& level);
+std::string simdLevelName(SimdLevel level);
+// Best instruction set supported by this CPU
+SimdLevel detectSimdLevel();
+// Selects the kernels used from now on. Levels the CPU does not support fall back to the best one it does.
+void setSimdLevel(SimdLevel level);
+SimdLevel getSimdLevel();
+
+// Down-samples a rows x columns image (with the given row stride, in elements) by mip in each direction,
+// writing (rows / mip) x (columns / mip) values to out. Partial blocks at the right and bottom edges are dropped.
+// All filters except nearest-neighbour ignore NaNs, and produce NaN for blocks without valid pixels.
+// Output rows are produced in parallel; each one streams through its mip input rows once, accumulating
+// per-column partial results with SIMD kernels before reducing them horizontally. The median filter is
+// exact up to 8x8 blocks, and uses an evenly spaced 8x8 sample of larger blocks.
+void downsample(const float* in, size_t rows, size_t columns, size_t stride, int mip, DownsampleFilter filter, float* out);
+
+#endif //ADASS_HDF5_BENCHMARK_DOWNSAMPLE_H
@@ -0,0 +1,396 @@
+#include "generate.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <fmt/format.h>
+
+#include "resources.h"
+
+using namespace std;
+using namespace H5;
+
+bool parseFillPattern(const string& name, FillPattern& pattern) {
+    if (name == "noise") {
+        pattern = FillPattern::Noise;
+    } else if (name == "gradient") {
+        pattern = FillPattern::Gradient;
+    } else if (name == "waves") {
+        pattern = FillPattern::Waves;
+    } else if (name == "constant") {
+        pattern = FillPattern::Constant;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+string fillPatternName(FillPattern pattern) {
+    switch (pattern) {
+        case FillPattern::Noise: return "noise";
+        case FillPattern::Gradient: return "gradient";
+        case FillPattern::Waves: return "waves";
+        case FillPattern::Constant: return "constant";
+    }
+    return "unknown";
+}
+
+// Filter IDs registered with the HDF Group for the LZ4 and Zstandard plugins
+static const H5Z_filter_t lz4Filter = 32004;
+static const H5Z_filter_t zstdFilter = 32015;
+
+bool parseCompression(const string& spec, vector<CompressionFilter>& filters) {
+    filters.clear();
+    size_t begin = 0;
+    while (begin <= spec.size()) {
+        auto end = spec.find('+', begin);
+        if (end == string::npos) {
+            end = spec.size();
+        }
+        auto stage = spec.substr(begin, end - begin);
+        begin = end + 1;
+
+        auto colon = stage.find(':');
+        auto name = stage.substr(0, colon);
+        vector<unsigned> values;
+        if (colon != string::npos) {
+            size_t position = colon + 1;
+            while (position <= stage.size()) {
+                auto comma = stage.find(',', position);
+                if (comma == string::npos) {
+                    comma = stage.size();
+                }
+                auto value = stage.substr(position, comma - position);
+                if (value.empty() || value.find_first_not_of("0123456789") != string::npos) {
+                    return false;
+                }
+                values.push_back(stoul(value));
+                position = comma + 1;
+            }
+        }
+
+        if (name == "shuffle" && values.empty()) {
+            filters.push_back({H5Z_FILTER_SHUFFLE, {}});
+        } else if (name == "deflate" && values.size() <= 1) {
+            filters.push_back({H5Z_FILTER_DEFLATE, values.empty() ? vector<unsigned>{6} : values});
+        } else if (name == "lz4" && values.size() <= 1) {
+            filters.push_back({lz4Filter, values});
+        } else if (name == "zstd" && values.size() <= 1) {
+            filters.push_back({zstdFilter, values});
+        } else if (name == "filter" && !values.empty()) {
+            filters.push_back({H5Z_filter_t(values[0]), vector<unsigned>(values.begin() + 1, values.end())});
+        } else {
+            return false;
+        }
+    }
+    return !filters.empty();
+}
+
+// splitmix64 finaliser: a cheap, well-mixed hash of the pixel index
+static inline uint64_t mixBits(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Cube geometry and NaN masks, shared by the slab generators of both datasets
+struct CubeModel {
+    CubeModel(const GenerateOptions& options);
+    float value(hsize_t s, hsize_t z, hsize_t y, hsize_t x) const;
+
+    const GenerateOptions& options;
+    hsize_t width, height, depth, stokes;
+    vector<bool> nanChannelMask;
+    uint64_t seedBits;
+    // Pixels whose 53-bit hash falls below this are NaN
+    uint64_t nanThreshold;
+    // Per-axis factors of the waves pattern
+    vector<float> xWaves, yWaves, lineProfile;
+};
+
+CubeModel::CubeModel(const GenerateOptions& options) : options(options) {
+    width = options.dims[0];
+    height = options.dims[1];
+    depth = options.dims[2];
+    stokes = (options.dims.size() > 3) ? options.dims[3] : 1;
+    nanChannelMask.resize(depth, false);
+    for (auto channel : options.nanChannels) {
+        if (channel >= 0 && channel < depth) {
+            nanChannelMask[channel] = true;
+        }
+    }
+    seedBits = mixBits(options.seed);
+    nanThreshold = min(max(options.nanFraction, 0.0), 1.0) * double(1ULL << 53);
+
+    if (options.pattern == FillPattern::Waves) {
+        xWaves.resize(width);
+        yWaves.resize(height);
+        lineProfile.resize(depth);
+        for (hsize_t x = 0; x < width; x++) {
+            xWaves[x] = sinf(x * 0.05f);
+        }
+        for (hsize_t y = 0; y < height; y++) {
+            yWaves[y] = cosf(y * 0.05f);
+        }
+        for (hsize_t z = 0; z < depth; z++) {
+            float offset = (z - depth * 0.5f) / (depth * 0.125f + 1.0f);
+            lineProfile[z] = expf(-0.5f * offset * offset);
+        }
+    }
+}
+
+float CubeModel::value(hsize_t s, hsize_t z, hsize_t y, hsize_t x) const {
+    if (nanChannelMask[z]) {
+        return NAN;
+    }
+    for (auto& box : options.nanBoxes) {
+        if (x >= box.x && x < box.x + box.width && y >= box.y && y < box.y + box.height) {
+            return NAN;
+        }
+    }
+    uint64_t hash = mixBits((((s * depth + z) * height + y) * width + x) ^ seedBits);
+    if ((hash >> 11) < nanThreshold) {
+        return NAN;
+    }
+    switch (options.pattern) {
+        case FillPattern::Noise:
+            return (mixBits(hash) >> 40) * (1.0f / (1 << 24));
+        case FillPattern::Gradient:
+            return s + float(x) / width + float(y) / height + float(z) / depth;
+        case FillPattern::Waves:
+            return s + xWaves[x] * yWaves[y] * lineProfile[z];
+        default:
+            return s + 1.0f;
+    }
+}
+
+// Writes a ([stokes,] slow, mid, fast) dataset in slabs of whole fast-axis rows. The main dataset is (z, y, x)
+// and the swizzled one (x, y, z). Slabs are aligned to the chunk shape (given in the same order) where possible,
+// so that each chunk is written once.
+static void writeDataSet(DataSet& dataSet, const CubeModel& cube, bool swizzledOrder, const vector<hsize_t>& shape,
+                         const vector<hsize_t>& chunkDims, size_t memoryBudget, double& computeSeconds, double& writeSeconds) {
+    hsize_t slow = shape[0], mid = shape[1], fast = shape[2];
+    hsize_t slowAlign = chunkDims.empty() ? 1 : chunkDims[0];
+    hsize_t midAlign = chunkDims.empty() ? 1 : chunkDims[1];
+    size_t slabElements = max<size_t>(memoryBudget / 2 / sizeof(float), fast);
+    hsize_t slabSlow, slabMid;
+    if (slabElements >= mid * fast * slowAlign) {
+        slabMid = mid;
+        slabSlow = slabElements / (mid * fast);
+        slabSlow = min(slow, slabSlow / slowAlign * slowAlign);
+    } else {
+        slabSlow = min(slow, slowAlign);
+        slabMid = max<hsize_t>(1, slabElements / (fast * slabSlow));
+        if (slabMid >= midAlign) {
+            slabMid = slabMid / midAlign * midAlign;
+        }
+        slabMid = min(slabMid, mid);
+    }
+
+    struct Slab {
+        hsize_t s, slowStart, midStart, numSlow, numMid;
+    };
+    vector<Slab> slabs;
+    for (hsize_t s = 0; s < cube.stokes; s++) {
+        for (hsize_t a = 0; a < slow; a += slabSlow) {
+            for (hsize_t b = 0; b < mid; b += slabMid) {
+                slabs.push_back({s, a, b, min(slabSlow, slow - a), min(slabMid, mid - b)});
+            }
+        }
+    }
+
+    auto writeSlab = [&dataSet, &cube, fast](const Slab& slab, const float* data) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        vector<hsize_t> count = {slab.numSlow, slab.numMid, fast};
+        vector<hsize_t> start = {slab.slowStart, slab.midStart, 0};
+        if (cube.options.dims.size() > 3) {
+            count.insert(count.begin(), 1);
+            start.insert(start.begin(), slab.s);
+        }
+        DataSpace memspace(count.size(), count.data());
+        auto fileSpace = dataSet.getSpace();
+        fileSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+        dataSet.write(data, PredType::NATIVE_FLOAT, memspace, fileSpace);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double>(t1 - t0).count();
+    };
+
+    // Two buffers: one is written from a background thread while the next slab is generated into the other.
+    // Generating on this thread keeps reusing the same OpenMP thread team.
+    vector<float> buffers[2];
+    buffers[0].resize(slabSlow * slabMid * fast);
+    buffers[1].resize(buffers[0].size());
+    future<double> pending;
+    for (auto k = 0; k < slabs.size(); k++) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        auto& slab = slabs[k];
+        float* dest = buffers[k % 2].data();
+        long long rows = slab.numSlow * slab.numMid;
+#pragma omp parallel for schedule(static)
+        for (long long r = 0; r < rows; r++) {
+            hsize_t a = slab.slowStart + r / slab.numMid;
+            hsize_t b = slab.midStart + r % slab.numMid;
+            float* row = dest + r * fast;
+            for (hsize_t c = 0; c < fast; c++) {
+                row[c] = swizzledOrder ? cube.value(slab.s, c, b, a) : cube.value(slab.s, a, b, c);
+            }
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        computeSeconds += std::chrono::duration<double>(t1 - t0).count();
+
+        if (pending.valid()) {
+            writeSeconds += pending.get();
+        }
+        pending = async(launch::async, writeSlab, slab, dest);
+    }
+    writeSeconds += pending.get();
+}
+
+static void writeAttribute(Group& group, const string& name, const string& value) {
+    StrType type(PredType::C_S1, max<size_t>(1, value.size()));
+    group.createAttribute(name, type, DataSpace(H5S_SCALAR)).write(type, value);
+}
+
+template <typename T>
+static void writeAttribute(Group& group, const string& name, const PredType& type, T value) {
+    group.createAttribute(name, type, DataSpace(H5S_SCALAR)).write(type, &value);
+}
+
+// Writes a FITS-like header as attributes: the cards describing the cube and its axes, padded with comment cards
+// up to the requested number
+static void writeHeader(Group& hduGroup, const GenerateOptions& options) {
+    if (options.headerCards <= 0) {
+        return;
+    }
+    static const char* axisTypes[] = {"RA---SIN", "DEC--SIN", "FREQ", "STOKES"};
+    static const char* axisUnits[] = {"deg", "deg", "Hz", ""};
+    int rank = options.dims.size();
+    writeAttribute(hduGroup, "SIMPLE", "T");
+    writeAttribute(hduGroup, "BITPIX", PredType::NATIVE_INT, -32);
+    writeAttribute(hduGroup, "NAXIS", PredType::NATIVE_INT, rank);
+    writeAttribute(hduGroup, "BUNIT", "JY/BEAM");
+    writeAttribute(hduGroup, "OBJECT", "SYNTHETIC");
+    writeAttribute(hduGroup, "SCHEMA_VERSION", "0.3");
+    for (auto i = 0; i < rank; i++) {
+        writeAttribute(hduGroup, fmt::format("NAXIS{}", i + 1), PredType::NATIVE_INT, int(options.dims[i]));
+        writeAttribute(hduGroup, fmt::format("CTYPE{}", i + 1), axisTypes[i]);
+        writeAttribute(hduGroup, fmt::format("CUNIT{}", i + 1), axisUnits[i]);
+        writeAttribute(hduGroup, fmt::format("CRPIX{}", i + 1), PredType::NATIVE_DOUBLE, options.dims[i] / 2.0 + 1);
+        writeAttribute(hduGroup, fmt::format("CRVAL{}", i + 1), PredType::NATIVE_DOUBLE, (i + 1) * 10.0);
+        writeAttribute(hduGroup, fmt::format("CDELT{}", i + 1), PredType::NATIVE_DOUBLE, (i + 1) * 1.0e-4);
+    }
+    for (auto i = 6 + 6 * rank; i < options.headerCards; i++) {
+        writeAttribute(hduGroup, fmt::format("COMMENT{}", i), fmt::format("Synthetic header card {} of {}", i + 1, options.headerCards));
+    }
+}
+
+// Creates a dataset of the given shape, with the chunk shape clipped to it
+static DataSet createDataSet(Group& group, const string& name, vector<hsize_t> shape, vector<hsize_t> chunkDims,
+                             size_t memoryBudget, const vector<CompressionFilter>& compression) {
+    DSetCreatPropList createProperties;
+    DSetAccPropList accessProperties;
+    if (!chunkDims.empty()) {
+        for (auto i = 0; i < 3; i++) {
+            chunkDims[i] = max<hsize_t>(1, min(chunkDims[i], shape[shape.size() - 3 + i]));
+        }
+        // Slabs that cannot cover whole chunks leave them partially written until the next slab
+        size_t chunkBytes = chunkDims[0] * chunkDims[1] * chunkDims[2] * sizeof(float);
+        size_t openChunks = ((shape[shape.size() - 2] + chunkDims[1] - 1) / chunkDims[1])
+                            * ((shape[shape.size() - 1] + chunkDims[2] - 1) / chunkDims[2]);
+        accessProperties.setChunkCache(max<size_t>(521, openChunks * 10 + 1), min(openChunks * chunkBytes, memoryBudget / 2), 1.0);
+        if (shape.size() == 4) {
+            chunkDims.insert(chunkDims.begin(), 1);
+        }
+        createProperties.setChunk(chunkDims.size(), chunkDims.data());
+        for (auto& filter : compression) {
+            createProperties.setFilter(filter.id, H5Z_FLAG_MANDATORY, filter.values.size(), filter.values.data());
+        }
+    }
+    return group.createDataSet(name, PredType::NATIVE_FLOAT, DataSpace(shape.size(), shape.data()), createProperties, accessProperties);
+}
+
+bool generateCube(const string& filename, const GenerateOptions& options) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    if (options.dims.size() != 3 && options.dims.size() != 4) {
+        fmt::print("Cube dimensions must be width,height,depth[,stokes]. Aborting.\n");
+        return false;
+    }
+    if (any_of(options.dims.begin(), options.dims.end(), [](hsize_t dim) { return dim == 0; })) {
+        fmt::print("Cube dimensions must be positive. Aborting.\n");
+        return false;
+    }
+    if ((!options.chunkDims.empty() && options.chunkDims.size() != 3)
+        || (!options.swizzledChunkDims.empty() && options.swizzledChunkDims.size() != 3)) {
+        fmt::print("Chunk shapes must have three dimensions (x, y, z). Aborting.\n");
+        return false;
+    }
+    if (!options.compression.empty() && options.chunkDims.empty()) {
+        fmt::print("Compressed datasets must be chunked (--chunks). Aborting.\n");
+        return false;
+    }
+    for (auto& filter : options.compression) {
+        if (H5Zfilter_avail(filter.id) <= 0) {
+            fmt::print("Filter {} is not available; check HDF5_PLUGIN_PATH. Aborting.\n", filter.id);
+            return false;
+        }
+    }
+
+    CubeModel cube(options);
+    int rank = options.dims.size();
+    FileCreatPropList fileCreateProperties;
+    if (options.pageSize > 0) {
+        // Paged aggregation keeps metadata together in pages, which readers can then fetch through a page buffer
+        H5Pset_file_space_strategy(fileCreateProperties.getId(), H5F_FSPACE_STRATEGY_PAGE, false, 1);
+        H5Pset_file_space_page_size(fileCreateProperties.getId(), options.pageSize);
+    }
+    auto file = H5File(filename, H5F_ACC_TRUNC, fileCreateProperties);
+    auto hduGroup = file.createGroup("0");
+    writeHeader(hduGroup, options);
+    double computeSeconds = 0, writeSeconds = 0;
+
+    // 0/DATA is stored as ([stokes,] z, y, x), so the (x, y, z) chunk shape is reversed
+    vector<hsize_t> shape = {cube.depth, cube.height, cube.width};
+    vector<hsize_t> chunkDims(options.chunkDims.rbegin(), options.chunkDims.rend());
+    vector<hsize_t> fullShape(shape);
+    if (rank == 4) {
+        fullShape.insert(fullShape.begin(), cube.stokes);
+    }
+    auto dataSet = createDataSet(hduGroup, "DATA", fullShape, chunkDims, options.memoryBudget, options.compression);
+    writeDataSet(dataSet, cube, false, shape, chunkDims, options.memoryBudget, computeSeconds, writeSeconds);
+    dataSet.close();
+
+    if (options.swizzled && cube.depth > 1) {
+        auto swizzledGroup = hduGroup.createGroup("SwizzledData");
+        vector<hsize_t> swizzledShape = {cube.width, cube.height, cube.depth};
+        vector<hsize_t> fullSwizzledShape(swizzledShape);
+        if (rank == 4) {
+            fullSwizzledShape.insert(fullSwizzledShape.begin(), cube.stokes);
+        }
+        auto swizzledDataSet = createDataSet(swizzledGroup, (rank == 4) ? "ZYXW" : "ZYX", fullSwizzledShape,
+                                             options.swizzledChunkDims, options.memoryBudget, options.compression);
+        writeDataSet(swizzledDataSet, cube, true, swizzledShape, options.swizzledChunkDims, options.memoryBudget,
+                     computeSeconds, writeSeconds);
+        swizzledDataSet.close();
+    }
+    file.close();
+
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    double totalSeconds = std::chrono::duration<double>(tEnd - tStart).count();
+    double writtenMb = cube.width * cube.height * cube.depth * cube.stokes * sizeof(float) * 1.0e-6;
+    if (options.swizzled && cube.depth > 1) {
+        writtenMb *= 2;
+    }
+    fmt::print("Generated {}x{}x{}x{} {} cube ({}{}) in {:.2f} s: {:.1f} MB/s\n", cube.width, cube.height, cube.depth,
+               cube.stokes, fillPatternName(options.pattern), options.chunkDims.empty() ? "contiguous" : "chunked",
+               (options.swizzled && cube.depth > 1) ? ", swizzled" : "", totalSeconds, writtenMb / totalSeconds);
+    fmt::print("Compute {:.2f} s (overlapped), write {:.2f} s\n", computeSeconds, writeSeconds);
+    if (!options.compression.empty()) {
+        double storageBytes = H5File(filename, H5F_ACC_RDONLY).openDataSet("0/DATA").getStorageSize();
+        double dataBytes = cube.width * cube.height * cube.depth * cube.stokes * sizeof(float);
+        fmt::print("Compression ratio of 0/DATA: {:.2f}\n", dataBytes / max(1.0, storageBytes));
+    }
+    fmt::print("Peak RSS {:.1f} MB\n", peakResidentMb());
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef ADASS_HDF5_BENCHMARK_GENERATE_H
+#define ADASS_HDF5_BENCHMARK_GENERATE_H
+
+#include <H5Cpp.h>
+#include <string>
+#include <vector>
+
+enum class FillPattern {
+    // Uniform hash noise in [0, 1), which does not compress
+    Noise,
+    // Smooth ramp along all axes
+    Gradient,
+    // Spatial sine pattern modulated by a Gaussian line profile along the spectral axis
+    Waves,
+    Constant
+};
+
+bool parseFillPattern(const std::string& name, FillPattern& pattern);
+std::string fillPatternName(FillPattern pattern);
+
+// A stage of the filter pipeline of the chunked datasets, with its client data values
+struct CompressionFilter {
+    H5Z_filter_t id;
+    std::vector<unsigned> values;
+};
+
+// Parses a pipeline such as shuffle+deflate:4, lz4 or shuffle+zstd:3, in the order the filters are applied.
+// filter:<id>[,values] adds any other registered filter or plugin.
+bool parseCompression(const std::string& spec, std::vector<CompressionFilter>& filters);
+
+// A rectangle of pixels that is NaN in every channel
+struct NanBox {
+    hsize_t x, y, width, height;
+};
+
+struct GenerateOptions {
+    // Cube shape as (width, height, depth) or (width, height, depth, stokes)
+    std::vector<hsize_t> dims;
+    // Chunk shape of 0/DATA as (x, y, z); empty for a contiguous layout
+    std::vector<hsize_t> chunkDims;
+    bool swizzled = true;
+    // Chunk shape of the swizzled dataset in its own (x, y, z) order; empty for a contiguous layout
+    std::vector<hsize_t> swizzledChunkDims;
+    FillPattern pattern = FillPattern::Noise;
+    std::vector<NanBox> nanBoxes;
+    // Channels that are NaN in full
+    std::vector<int> nanChannels;
+    // Fraction of the remaining pixels that are NaN, scattered at random
+    double nanFraction = 0;
+    unsigned int seed = 0;
+    // Memory available for the two slab buffers, in bytes
+    size_t memoryBudget = 1024 * 1024 * 1024;
+    // FITS header cards written as attributes of 0, as converted FITS files have (0 for none)
+    int headerCards = 100;
+    // File space page size for paged aggregation; 0 keeps the default free-space strategy
+    hsize_t pageSize = 0;
+    // Filter pipeline of the chunked datasets; empty for uncompressed
+    std::vector<CompressionFilter> compression;
+};
+
+// Creates a file with the 0/DATA (and optionally 0/SwizzledData/ZYX or ZYXW) schema used by the trials,
+// replacing any existing file, with a header of attributes on 0 that describe the cube. Pixel values are
+// a function of their coordinates and the seed, so each dataset is generated directly in its own order,
+// in slabs computed in parallel. The next slab is computed while the previous one is written.
+bool generateCube(const std::string& filename, const GenerateOptions& options);
+
+#endif //ADASS_HDF5_BENCHMARK_GENERATE_H
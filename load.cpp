@@ -0,0 +1,357 @@
+#include "load.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fmt/format.h>
+#include <random>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "downsample.h"
+#include "stats.h"
+
+using namespace std;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const LoadPattern loadPatterns[] = {LoadPattern::XY, LoadPattern::YZ, LoadPattern::ZProfile, LoadPattern::Region,
+                                           LoadPattern::DownSample};
+
+string loadPatternName(LoadPattern pattern) {
+    switch (pattern) {
+        case LoadPattern::XY: return "xy";
+        case LoadPattern::YZ: return "yz";
+        case LoadPattern::ZProfile: return "z";
+        case LoadPattern::Region: return "region";
+        case LoadPattern::DownSample: return "downsample";
+    }
+    return "unknown";
+}
+
+bool parseLoadMix(const string& spec, vector<pair<LoadPattern, double>>& mix) {
+    mix.clear();
+    size_t from = 0;
+    while (from <= spec.size()) {
+        size_t to = spec.find(',', from);
+        if (to == string::npos) {
+            to = spec.size();
+        }
+        auto item = spec.substr(from, to - from);
+        auto colon = item.find(':');
+        auto name = item.substr(0, colon);
+        double weight = (colon == string::npos) ? 1.0 : atof(item.c_str() + colon + 1);
+        auto match = find_if(begin(loadPatterns), end(loadPatterns), [&](LoadPattern p) { return loadPatternName(p) == name; });
+        if (match == end(loadPatterns) || !(weight >= 0)) {
+            return false;
+        }
+        if (weight > 0) {
+            mix.push_back({*match, weight});
+        }
+        from = to + 1;
+    }
+    return !mix.empty();
+}
+
+// Requests completed by one client, and the latencies of each pattern
+struct ClientLog {
+    vector<vector<double>> latencies;
+    size_t bytes = 0;
+    size_t dropped = 0;
+    Clock::time_point lastCompletion;
+};
+
+LoadRequest randomRequest(LoadPattern pattern, const vector<hsize_t>& dims, int regionSize, int mip, mt19937& rng) {
+    int rank = dims.size();
+    hsize_t width = dims[rank - 1];
+    hsize_t height = dims[rank - 2];
+    hsize_t depth = (rank > 2) ? dims[rank - 3] : 1;
+    hsize_t z = uniform_int_distribution<hsize_t>(0, depth - 1)(rng);
+    hsize_t y = uniform_int_distribution<hsize_t>(0, height - 1)(rng);
+    hsize_t x = uniform_int_distribution<hsize_t>(0, width - 1)(rng);
+
+    LoadRequest request;
+    request.pattern = pattern;
+    switch (pattern) {
+        case LoadPattern::YZ:
+            request.channel = 0;
+            request.channels = depth;
+            request.x = x;
+            request.y = 0;
+            request.width = 1;
+            request.height = height;
+            break;
+        case LoadPattern::ZProfile:
+            request.channel = 0;
+            request.channels = depth;
+            request.x = x;
+            request.y = y;
+            request.width = 1;
+            request.height = 1;
+            break;
+        case LoadPattern::Region: {
+            hsize_t size = min<hsize_t>(regionSize, min(width, height));
+            request.channel = 0;
+            request.channels = depth;
+            request.x = min(x, width - size);
+            request.y = min(y, height - size);
+            request.width = size;
+            request.height = size;
+            break;
+        }
+        default:
+            request.channel = z;
+            request.channels = 1;
+            request.x = 0;
+            request.y = 0;
+            request.width = width;
+            request.height = height;
+            request.mip = (pattern == LoadPattern::DownSample) ? mip : 1;
+            break;
+    }
+    return request;
+}
+
+bool requestFits(const LoadRequest& request, const vector<hsize_t>& dims) {
+    int rank = dims.size();
+    hsize_t depth = (rank > 2) ? dims[rank - 3] : 1;
+    hsize_t stokes = (rank > 3) ? dims[rank - 4] : 1;
+    return request.channels && request.width && request.height && request.mip > 0 && request.stokes < stokes
+           && request.channel + request.channels <= depth && request.y + request.height <= dims[rank - 2]
+           && request.x + request.width <= dims[rank - 1];
+}
+
+size_t serveRequest(const LoadRequest& request, DataReader* reader, const vector<hsize_t>& dims, vector<float>& data,
+                    vector<float>& result, TileCache* tileCache) {
+    // The swizzled dataset stores the same box in (x, y, channel) order
+    bool swizzled = request.dataSet != "main";
+    vector<hsize_t> start = {request.channel, request.y, request.x};
+    vector<hsize_t> count = {request.channels, request.height, request.width};
+    if (swizzled) {
+        reverse(start.begin(), start.end());
+        reverse(count.begin(), count.end());
+    }
+    if (dims.size() == 4) {
+        start.insert(start.begin(), request.stokes);
+        count.insert(count.begin(), 1);
+    }
+    size_t n = request.channels * request.height * request.width;
+    size_t planeSize = request.height * request.width;
+    data.resize(n);
+
+    int mip = (request.pattern == LoadPattern::DownSample) ? request.mip : 1;
+    bool tiled = tileCache && !swizzled && (request.pattern == LoadPattern::XY || request.pattern == LoadPattern::Region || mip > 1);
+    if (tiled && mip > 1) {
+        // Cached tiles are already down-sampled on a grid aligned to multiples of mip, so the box snaps to it
+        size_t outSize = (request.height / mip) * (request.width / mip);
+        result.resize(request.channels * outSize);
+        for (hsize_t c = 0; c < request.channels; c++) {
+            readThroughTiles(*tileCache, reader, request.dataSet, dims, request.stokes, request.channel + c, request.x / mip,
+                             request.y / mip, request.width / mip, request.height / mip, mip, result.data() + c * outSize);
+        }
+        return n * sizeof(float);
+    } else if (tiled) {
+        for (hsize_t c = 0; c < request.channels; c++) {
+            readThroughTiles(*tileCache, reader, request.dataSet, dims, request.stokes, request.channel + c, request.x, request.y,
+                             request.width, request.height, 1, data.data() + c * planeSize);
+        }
+    } else {
+        reader->read(start, count, data.data());
+    }
+
+    if (mip > 1) {
+        // Each channel of the box is down-sampled in turn
+        size_t outSize = (request.height / mip) * (request.width / mip);
+        result.resize(request.channels * outSize);
+        for (hsize_t c = 0; c < request.channels; c++) {
+            downsample(data.data() + c * planeSize, request.height, request.width, request.width, mip, DownsampleFilter::Mean,
+                       result.data() + c * outSize);
+        }
+    } else if (request.pattern == LoadPattern::Region && !swizzled) {
+        // Mean spectral profile of the region
+        result.resize(request.channels);
+        for (size_t i = 0; i < result.size(); i++) {
+            result[i] = calculateStats(data.data() + i * planeSize, planeSize).mean;
+        }
+    } else {
+        result.assign(1, calculateStats(data.data(), n).mean);
+    }
+    return n * sizeof(float);
+}
+
+static void runClient(DataReader* reader, const vector<hsize_t>& dims, const LoadOptions& options, int regionSize,
+                      double clientRate, unsigned int seed, Clock::time_point tStart, ClientLog& log) {
+#ifdef _OPENMP
+    omp_set_num_threads(1);
+#endif
+    mt19937 rng(seed);
+    vector<double> weights;
+    for (auto& entry : options.mix) {
+        weights.push_back(entry.second);
+    }
+    discrete_distribution<int> choosePattern(weights.begin(), weights.end());
+    exponential_distribution<double> interArrival(clientRate > 0 ? clientRate : 1.0);
+    log.latencies.resize(options.mix.size());
+    log.lastCompletion = tStart;
+    vector<float> data, result;
+
+    auto secondsSince = [&](Clock::time_point t) { return std::chrono::duration<double>(t - tStart).count(); };
+    // Backlogged open-loop requests are served for at most as long again as requests arrive
+    double drainLimit = 2 * options.seconds;
+    double arrival = clientRate > 0 ? interArrival(rng) : 0;
+
+    while (true) {
+        Clock::time_point issued;
+        if (clientRate > 0) {
+            if (arrival > options.seconds) {
+                break;
+            }
+            if (secondsSince(Clock::now()) > drainLimit) {
+                for (; arrival <= options.seconds; arrival += interArrival(rng)) {
+                    log.dropped++;
+                }
+                break;
+            }
+            issued = tStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(arrival));
+            this_thread::sleep_until(issued);
+        } else {
+            issued = Clock::now();
+            if (secondsSince(issued) > options.seconds) {
+                break;
+            }
+        }
+
+        int index = choosePattern(rng);
+        auto request = randomRequest(options.mix[index].first, dims, regionSize, options.mip, rng);
+        log.bytes += serveRequest(request, reader, dims, data, result);
+        log.lastCompletion = Clock::now();
+        log.latencies[index].push_back(std::chrono::duration<double, milli>(log.lastCompletion - issued).count());
+        arrival += interArrival(rng);
+    }
+}
+
+static LoadPatternStats patternStats(const string& name, vector<double>& latencies) {
+    sort(latencies.begin(), latencies.end());
+    return {name, latencies.size(), percentile(latencies, 50), percentile(latencies, 99), latencies.empty() ? NAN : latencies.back()};
+}
+
+vector<LoadPatternStats> latencyStats(const vector<string>& names, vector<vector<double>>& latencies) {
+    vector<LoadPatternStats> stats;
+    vector<double> all;
+    for (auto p = 0; p < names.size(); p++) {
+        all.insert(all.end(), latencies[p].begin(), latencies[p].end());
+        stats.push_back(patternStats(names[p], latencies[p]));
+    }
+    stats.push_back(patternStats("all", all));
+    return stats;
+}
+
+vector<LoadResult> runLoad(const function<unique_ptr<DataReader>()>& openReader, const vector<hsize_t>& dims, const LoadOptions& options) {
+    int rank = dims.size();
+    int regionSize = options.regionSize;
+    if (regionSize <= 0) {
+        regionSize = ceil(sqrt(0.001) * min(dims[rank - 1], dims[rank - 2]));
+    }
+
+    vector<LoadResult> results;
+    for (auto clients : options.clients) {
+        vector<unique_ptr<DataReader>> clientReaders;
+        for (auto i = 0; i < clients; i++) {
+            clientReaders.push_back(openReader());
+            if (!clientReaders.back()) {
+                return results;
+            }
+        }
+
+        // Clients start together, once all their threads exist
+        vector<ClientLog> logs(clients);
+        vector<thread> threads;
+        double clientRate = options.rate / clients;
+        auto tStart = Clock::now() + std::chrono::milliseconds(10);
+        for (auto i = 0; i < clients; i++) {
+            threads.emplace_back(runClient, clientReaders[i].get(), cref(dims), cref(options), regionSize, clientRate,
+                                 options.seed + 7919 * i, tStart, ref(logs[i]));
+        }
+        for (auto& clientThread : threads) {
+            clientThread.join();
+        }
+
+        LoadResult result;
+        result.clients = clients;
+        result.offeredRate = options.rate > 0 ? options.rate : NAN;
+        result.requests = 0;
+        result.dropped = 0;
+        size_t bytes = 0;
+        auto tEnd = tStart;
+        vector<string> names;
+        vector<vector<double>> latencies(options.mix.size());
+        for (auto p = 0; p < options.mix.size(); p++) {
+            names.push_back(loadPatternName(options.mix[p].first));
+            for (auto& log : logs) {
+                latencies[p].insert(latencies[p].end(), log.latencies[p].begin(), log.latencies[p].end());
+                result.requests += log.latencies[p].size();
+            }
+        }
+        for (auto& log : logs) {
+            bytes += log.bytes;
+            result.dropped += log.dropped;
+            tEnd = max(tEnd, log.lastCompletion);
+        }
+        result.patterns = latencyStats(names, latencies);
+        double seconds = std::chrono::duration<double>(tEnd - tStart).count();
+        result.completedRate = seconds > 0 ? result.requests / seconds : NAN;
+        result.mbPerSec = seconds > 0 ? bytes * 1.0e-6 / seconds : NAN;
+        results.push_back(result);
+    }
+    return results;
+}
+
+void printLoadResults(const vector<LoadResult>& results, OutputFormat format, const string& backend, const LoadOptions& options) {
+    switch (format) {
+        case OutputFormat::Json: {
+            fmt::print("{{\"seed\": {}, \"backend\": \"{}\", \"rate\": {}, \"seconds\": {}, \"load\": [\n", options.seed, backend,
+                       jsonNumber(options.rate, 2), jsonNumber(options.seconds, 2));
+            for (auto i = 0; i < results.size(); i++) {
+                auto& r = results[i];
+                fmt::print("  {{\"clients\": {}, \"cache\": \"{}\", \"chunk_cache\": \"{}\", \"offered_rate\": {}, \"completed_rate\": {}, "
+                           "\"mb_per_s\": {}, \"requests\": {}, \"dropped\": {}, \"patterns\": [", r.clients, r.cache, r.chunkCache,
+                           jsonNumber(r.offeredRate, 2), jsonNumber(r.completedRate, 2), jsonNumber(r.mbPerSec, 2), r.requests, r.dropped);
+                for (auto j = 0; j < r.patterns.size(); j++) {
+                    auto& p = r.patterns[j];
+                    fmt::print("{{\"pattern\": \"{}\", \"requests\": {}, \"p50_ms\": {}, \"p99_ms\": {}, \"max_ms\": {}}}{}", p.pattern,
+                               p.requests, jsonNumber(p.p50Ms, 3), jsonNumber(p.p99Ms, 3), jsonNumber(p.maxMs, 3),
+                               j + 1 < r.patterns.size() ? ", " : "");
+                }
+                fmt::print("]}}{}\n", i + 1 < results.size() ? "," : "");
+            }
+            fmt::print("]}}\n");
+            break;
+        }
+        case OutputFormat::Csv: {
+            fmt::print("clients,backend,cache,chunk_cache,offered_rate,completed_rate,mb_per_s,dropped,pattern,requests,p50_ms,p99_ms,max_ms\n");
+            for (auto& r : results) {
+                for (auto& p : r.patterns) {
+                    fmt::print("{},{},{},{},{:.2f},{:.2f},{:.2f},{},{},{},{:.3f},{:.3f},{:.3f}\n", r.clients, backend, r.cache, r.chunkCache,
+                               r.offeredRate, r.completedRate, r.mbPerSec, r.dropped, p.pattern, p.requests, p.p50Ms, p.p99Ms, p.maxMs);
+                }
+            }
+            break;
+        }
+        default: {
+            fmt::print("Seed {}, {} backend, {}, {:.1f} s of arrivals per run\n", options.seed, backend,
+                       options.rate > 0 ? fmt::format("{:.1f} requests/s offered", options.rate) : string("closed-loop"), options.seconds);
+            for (auto& r : results) {
+                fmt::print("{} client(s) ({} cache, {} chunk cache): {} requests, {:.2f} requests/s, {:.2f} MB/s", r.clients, r.cache,
+                           r.chunkCache, r.requests, r.completedRate, r.mbPerSec);
+                fmt::print("{}\n", r.dropped ? fmt::format(", {} dropped", r.dropped) : "");
+                for (auto& p : r.patterns) {
+                    fmt::print("    {:<10} {:>8} requests; p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms\n", p.pattern, p.requests,
+                               p.p50Ms, p.p99Ms, p.maxMs);
+                }
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef ADASS_HDF5_BENCHMARK_LOAD_H
+#define ADASS_HDF5_BENCHMARK_LOAD_H
+
+#include <H5Cpp.h>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "reader.h"
+#include "runner.h"
+#include "tilecache.h"
+
+// Request types issued by the load generator, each followed by the computation a viewer would do on the data
+enum class LoadPattern {
+    // XY-Image (or part of one) of one channel, and its mean
+    XY,
+    // YZ-Image, and its mean
+    YZ,
+    // Z-Profile of one pixel
+    ZProfile,
+    // Region over a range of channels, and its mean spectral profile
+    Region,
+    // XY-Image (or part of one) of one channel, down-sampled (mean)
+    DownSample
+};
+
+std::string loadPatternName(LoadPattern pattern);
+// Parses a weighted mix such as "xy:4,z:2,region" (weights default to 1)
+bool parseLoadMix(const std::string& spec, std::vector<std::pair<LoadPattern, double>>& mix);
+
+// A box of channels [channel, channel + channels), rows [y, y + height) and columns [x, x + width) of one stokes,
+// read from the main dataset or its swizzled copy and then processed as its pattern describes. The down-sample
+// pattern reduces the box by mip.
+struct LoadRequest {
+    LoadPattern pattern;
+    std::string dataSet = "main";
+    hsize_t stokes = 0;
+    hsize_t channel, channels;
+    hsize_t x, y, width, height;
+    int mip = 1;
+};
+
+// A request of the given pattern at random coordinates of a ([stokes,] depth, height, width) cube
+LoadRequest randomRequest(LoadPattern pattern, const std::vector<hsize_t>& dims, int regionSize, int mip, std::mt19937& rng);
+// Checks that the request fits in a cube of the given shape
+bool requestFits(const LoadRequest& request, const std::vector<hsize_t>& dims);
+// Reads the request with a reader of its dataset and does the work a viewer would do before replying, returning the
+// bytes read. data and result are reused between calls. With a tile cache, XY, region and down-sample requests to
+// the main dataset are assembled from cached tiles.
+size_t serveRequest(const LoadRequest& request, DataReader* reader, const std::vector<hsize_t>& dims, std::vector<float>& data,
+                    std::vector<float>& result, TileCache* tileCache = nullptr);
+
+struct LoadOptions {
+    std::vector<std::pair<LoadPattern, double>> mix = {{LoadPattern::XY, 1}, {LoadPattern::YZ, 1}, {LoadPattern::ZProfile, 1},
+                                                       {LoadPattern::Region, 1}, {LoadPattern::DownSample, 1}};
+    // Concurrency levels to run, one after the other
+    std::vector<int> clients = {1, 2, 4, 8};
+    // Total arrival rate over all clients in requests per second; 0 runs each client closed-loop (back to back)
+    double rate = 0;
+    // Seconds during which requests arrive, per concurrency level
+    double seconds = 10;
+    // Edge of the region requests; 0 uses 0.1% of the image area, as the medium region trials do
+    int regionSize = 0;
+    int mip = 8;
+    unsigned int seed = 0;
+};
+
+struct LoadPatternStats {
+    std::string pattern;
+    size_t requests;
+    double p50Ms, p99Ms, maxMs;
+};
+
+struct LoadResult {
+    int clients;
+    // Page cache state ("none", "cold" or "warm") and HDF5 chunk cache setting the requests were served with
+    std::string cache = "none";
+    std::string chunkCache;
+    // Requests per second offered (NaN when closed-loop) and completed
+    double offeredRate;
+    double completedRate;
+    double mbPerSec;
+    size_t requests;
+    // Open-loop requests still queued when the drain period ran out
+    size_t dropped;
+    // Per pattern, followed by all requests together
+    std::vector<LoadPatternStats> patterns;
+};
+
+// Latency statistics (from latencies in ms, which are sorted) of each named pattern, followed by all requests together
+std::vector<LoadPatternStats> latencyStats(const std::vector<std::string>& names, std::vector<std::vector<double>>& latencies);
+
+// Runs the mix with each number of clients. Every client is a thread with a reader of its own, made by openReader,
+// that issues requests on its own random schedule: with a rate, arrivals are Poisson with rate / clients per client,
+// and latency is measured from the scheduled arrival, so that time spent queued behind slow requests is included.
+// Each client computes on its own thread only, so concurrency is set by the number of clients.
+std::vector<LoadResult> runLoad(const std::function<std::unique_ptr<DataReader>()>& openReader, const std::vector<hsize_t>& dims,
+                                const LoadOptions& options);
+void printLoadResults(const std::vector<LoadResult>& results, OutputFormat format, const std::string& backend, const LoadOptions& options);
+
+#endif //ADASS_HDF5_BENCHMARK_LOAD_H
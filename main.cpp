@@ -3,12 +3,38 @@
 #include <fmt/format.h>
 #include <map>
 #include <chrono>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <sys/mman.h>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <getopt.h>
+#include <random>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#ifdef _OPENMP
 #include <omp.h>
-#include <fcntl.h>
-#include <fstream>
+#endif
+
+#include "animation.h"
+#include "downsample.h"
+#include "generate.h"
+#include "load.h"
+#include "mipmap.h"
+#include "moments.h"
+#include "pagecache.h"
+#include "polarization.h"
+#include "profiles.h"
+#include "reader.h"
+#include "resources.h"
+#include "runner.h"
+#include "startup.h"
+#include "stats.h"
+#include "statsindex.h"
+#include "swizzle.h"
+#include "tilecache.h"
+#include "trace.h"
+#include "viewport.h"
 
 using namespace std;
 using namespace H5;
@@ -17,52 +43,113 @@ map<string, DataSet> dataSets;
 vector<float> cache;
 int dimensions;
 int width, height, depth, stokes;
-unsigned char* filePtr;
-ifstream fileStream;
+// Readers for each backend and dataset ("main" or "swizzled") used by the selected trials
+map<pair<Backend, string>, unique_ptr<DataReader>> readers;
+// Counters of all readers so far, including those replaced by reopenDataSets, so that totals taken around a trial
+// that evicts the file part-way (e.g. between the passes of the moments trial) cover the whole trial
+struct ReaderTotals {
+    size_t chunksTouched = 0;
+    double setupSeconds = 0;
+    double transferSeconds = 0;
+    double decodeSeconds = 0;
+    size_t decodedBytes = 0;
+};
+ReaderTotals retiredReaders;
+// Maximum number of concurrent reads for the uring and pool backends
+unsigned queueDepth = 32;
+// Per-trial output is suppressed when running multiple iterations in-process
+bool quiet = false;
+// Access properties (e.g. the HDF5 chunk cache) that every dataset is opened with
+DSetAccPropList dataSetAccess;
+// File the trials read, for trials that open additional readers
+string dataFilename;
+H5File* dataFile = nullptr;
+// Whether the running trial is a cold pass of --cache cold or both, for trials that read the data more than once
+bool coldPass = false;
+AnimationOptions animationOptions;
+// Decoded tiles shared by the XY, region and mean down-sampling trials across iterations (--tile-cache); null if disabled
+unique_ptr<TileCache> tileCache;
+// Budget and tile edge of the tile cache, also used by the viewer session trial
+size_t tileCacheBytes = 256 * 1024 * 1024;
+int tileSize = 256;
+// Views per viewer session
+int sessionViews = 100;
+// Hardware cache counters recorded around each trial (--perf); null if disabled
+unique_ptr<PerfCounters> perfCounters;
+// Statistics written by --build-stats, which the XY-Image trial uses instead of computing them with --precomputed-stats
+unique_ptr<StatisticsIndex> statisticsIndex;
+bool usePrecomputedStats = false;
+// Memory for the read buffers and accumulators of the moment map trials (--memory), and the thread counts they
+// are timed with (by default powers of two up to all threads)
+size_t momentMemory = 1024 * 1024 * 1024;
+vector<int> momentThreads;
+// Stokes plane the trials of 4D cubes read (--stokes), or -1 to draw one at random for each iteration, and the one
+// drawn for the current trial
+int stokesIndex = 0;
+int trialStokes = 0;
+// Channels per block of the streamed region profile trials; 0 reads all channels at once
+int profileBlock = 0;
+// Down-sampling factor of the viewport trials' views, or 0 for a random power of two per iteration
+int viewportMip = 0;
+// View size and page buffer of the startup trials
+StartupOptions startupOptions;
 
 float calculateMean(vector<float>& data) {
-    int N = data.size();
-    float total = 0;
-    int dataCount = 0;
-    for (auto i = 0; i < N; i++) {
-        if (!isnan(cache[i])) {
-            total += cache[i];
-            dataCount++;
-        }
-    }
-    return dataCount > 0 ? total / dataCount : NAN;
+    return calculateStats(data.data(), data.size()).mean;
 }
 
-size_t getFilesize(const char* filename) {
-    struct stat st;
-    stat(filename, &st);
-    return st.st_size;
+void printResult(float val) {
+    if (!quiet) {
+        fmt::print("Result: {:.2f}; ", val);
+    }
 }
 
-void printResult(float val) {
-    fmt::print("Result: {:.2f}; ", val);
+template <typename... Args>
+void printTrial(fmt::format_string<Args...> format, Args&&... args) {
+    if (!quiet) {
+        fmt::print(format, std::forward<Args>(args)...);
+    }
 }
 
-ifstream openFile(string filename) {
-    return ifstream(filename, ios::binary);
+// Shape of the main dataset, for functions that take it as dims
+vector<hsize_t> mainDims() {
+    vector<hsize_t> dims = {hsize_t(depth), hsize_t(height), hsize_t(width)};
+    if (dimensions == 4) {
+        dims.insert(dims.begin(), stokes);
+    }
+    return dims;
 }
 
-unsigned char* mapFile(string filename) {
-    size_t filesize = getFilesize(filename.c_str());
-    int fd = open(filename.c_str(), O_RDONLY, 0);
-    if (fd == -1) {
-        return nullptr;
+// Returns the ratio of the size of the main dataset to its storage (1 if it is not filtered), and its filters
+// joined with '+', e.g. "shuffle+deflate"
+double mainCompression(string& filterNames) {
+    filterNames.clear();
+    auto createProperties = dataSets["main"].getCreatePlist();
+    for (auto i = 0; i < createProperties.getNfilters(); i++) {
+        unsigned flags, filterConfig;
+        size_t numValues = 0;
+        char filterName[64];
+        createProperties.getFilter(i, flags, numValues, nullptr, sizeof(filterName), filterName, filterConfig);
+        filterNames += (filterNames.empty() ? "" : "+") + string(filterName);
+    }
+    if (filterNames.empty()) {
+        return 1;
     }
-    return (unsigned char*) mmap(nullptr, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+    double dataBytes = double(width) * height * depth * stokes * sizeof(float);
+    return dataBytes / max<hsize_t>(1, dataSets["main"].getStorageSize());
 }
 
-void unmapFile(string filename, void* ptr) {
-    size_t filesize = getFilesize(filename.c_str());
-    munmap(ptr, filesize);
+DataReader* getReader(const string& dataSetName, Backend backend) {
+    auto& reader = readers[make_pair(backend, dataSetName)];
+    if (!reader) {
+        throw runtime_error(fmt::format("No {} reader for the {} dataset", backendName(backend), dataSetName));
+    }
+    return reader.get();
 }
 
-void trialXY() {
+TrialResult trialXY(Backend backend) {
     // XY-Image reads
+    auto reader = getReader("main", backend);
     auto tStart = std::chrono::high_resolution_clock::now();
     int z = ((float) rand()) / RAND_MAX * depth;
     // Define dimensions of hyperslab in 2D
@@ -72,56 +159,36 @@ void trialXY() {
     // Append channel (and stokes in 4D) to hyperslab dims
     if (dimensions == 4) {
         count.insert(count.begin(), {1});
-        start.insert(start.begin(), {0});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
     }
 
-    // Read data into memory space
-    hsize_t memDims[] = {height, width};
-    DataSpace memspace(2, memDims);
-    cache.resize(width * height);
-    auto sliceDataSpace = dataSets["main"].getSpace();
-    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
-    dataSets["main"].read(cache.data(), PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
-    float mean = calculateMean(cache);
-    auto tEnd = std::chrono::high_resolution_clock::now();
-    auto dtXY = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
-    printResult(mean);
-    fmt::print("Ran XY-Image trial (z={}) in {:.2f} ms\n", z, dtXY * 1.0e-3);
-}
-
-void trialXYMmap() {
-// XY-Image reads
-    auto tStart = std::chrono::high_resolution_clock::now();
-    int z = ((float) rand()) / RAND_MAX * depth;
-    auto sliceSizeBytes = width * height * sizeof(float);
-    auto offset = dataSets["main"].getOffset() + z * sliceSizeBytes;
-
+    // Read data into cache
     cache.resize(width * height);
-    memcpy(cache.data(), filePtr + offset, sliceSizeBytes);
-    float mean = calculateMean(cache);
-    auto tEnd = std::chrono::high_resolution_clock::now();
-    auto dtXY = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
-    printResult(mean);
-    fmt::print("Ran XY-Image trial (z={}) in {:.2f} ms\n", z, dtXY * 1.0e-3);
-}
-
-void trialXYRaw() {
-    auto tStart = std::chrono::high_resolution_clock::now();
-    int z = ((float) rand()) / RAND_MAX * depth;
-    auto sliceSizeBytes = width * height * sizeof(float);
-    auto offset = dataSets["main"].getOffset() + z * sliceSizeBytes;
-    cache.resize(width * height);
-    fileStream.seekg(offset);
-    fileStream.read((char*)cache.data(), sliceSizeBytes);
-    float mean = calculateMean(cache);
+    if (tileCache) {
+        readThroughTiles(*tileCache, reader, "main", mainDims(), trialStokes, z, 0, 0, width, height, 1, cache.data());
+    } else {
+        reader->read(start, count, cache.data());
+    }
+    bool precomputed = usePrecomputedStats && statisticsIndex && statisticsIndex->valid();
+    float mean;
+    if (precomputed) {
+        BasicStats stats;
+        statisticsIndex->channelStats(trialStokes, z, stats);
+        mean = stats.mean;
+    } else {
+        mean = calculateMean(cache);
+    }
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto dtXY = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
+    auto name = precomputed ? "XY-Image (precomputed statistics)" : "XY-Image";
     printResult(mean);
-    fmt::print("Ran XY-Image trial (z={}) in {:.2f} ms\n", z, dtXY * 1.0e-3);
+    printTrial("Ran {} trial (z={}) in {:.2f} ms\n", name, z, dtXY * 1.0e-3);
+    return {name, dtXY * 1.0e-3, cache.size() * sizeof(float)};
 }
 
-void trialXZ() {
+TrialResult trialXZ(Backend backend) {
     // XZ-Image reads
+    auto reader = getReader("main", backend);
     auto tStart = std::chrono::high_resolution_clock::now();
     int y = ((float) rand()) / RAND_MAX * height;
     // Define dimensions of hyperslab in 2D
@@ -131,25 +198,23 @@ void trialXZ() {
     // Append channel (and stokes in 4D) to hyperslab dims
     if (dimensions == 4) {
         count.insert(count.begin(), {1});
-        start.insert(start.begin(), {0});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
     }
 
-    // Read data into memory space
-    hsize_t memDims[] = {depth, width};
-    DataSpace memspace(2, memDims);
+    // Read data into cache
     cache.resize(depth * width);
-    auto sliceDataSpace = dataSets["main"].getSpace();
-    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
-    dataSets["main"].read(cache.data(), PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
+    reader->read(start, count, cache.data());
     float mean = calculateMean(cache);
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto dtXZ = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
     printResult(mean);
-    fmt::print("Ran XZ-Image trial (y={}) in {:.2f} ms\n", y, dtXZ * 1.0e-3);
+    printTrial("Ran XZ-Image trial (y={}) in {:.2f} ms\n", y, dtXZ * 1.0e-3);
+    return {"XZ-Image", dtXZ * 1.0e-3, cache.size() * sizeof(float)};
 }
 
-void trialYZ() {
+TrialResult trialYZ(Backend backend) {
     // YZ-Image reads
+    auto reader = getReader("main", backend);
     auto tStart = std::chrono::high_resolution_clock::now();
     int x = ((float) rand()) / RAND_MAX * width;
     // Define dimensions of hyperslab in 2D
@@ -159,25 +224,23 @@ void trialYZ() {
     // Append channel (and stokes in 4D) to hyperslab dims
     if (dimensions == 4) {
         count.insert(count.begin(), {1});
-        start.insert(start.begin(), {0});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
     }
 
-    // Read data into memory space
-    hsize_t memDims[] = {depth, height};
-    DataSpace memspace(2, memDims);
+    // Read data into cache
     cache.resize(depth * height);
-    auto sliceDataSpace = dataSets["main"].getSpace();
-    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
-    dataSets["main"].read(cache.data(), PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
+    reader->read(start, count, cache.data());
     float mean = calculateMean(cache);
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto dtYZ = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
     printResult(mean);
-    fmt::print("Ran YZ-Image trial (x={}) in {:.2f} ms\n", x, dtYZ * 1.0e-3);
+    printTrial("Ran YZ-Image trial (x={}) in {:.2f} ms\n", x, dtYZ * 1.0e-3);
+    return {"YZ-Image", dtYZ * 1.0e-3, cache.size() * sizeof(float)};
 }
 
-void trialYZSwizzled() {
+TrialResult trialYZSwizzled(Backend backend) {
     // YZ-Image reads
+    auto swizzledReader = getReader("swizzled", backend);
     auto tStart = std::chrono::high_resolution_clock::now();
     int x = ((float) rand()) / RAND_MAX * width;
     // Define dimensions of hyperslab in 2D
@@ -187,26 +250,24 @@ void trialYZSwizzled() {
     // Append channel (and stokes in 4D) to hyperslab dims
     if (dimensions == 4) {
         count.insert(count.begin(), {1});
-        start.insert(start.begin(), {0});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
     }
 
-    // Read data into memory space
-    hsize_t memDims[] = {depth, height};
-    DataSpace memspace(2, memDims);
+    // Read data into cache
     int N = depth * height;
     cache.resize(N);
-    auto sliceDataSpace = dataSets["swizzled"].getSpace();
-    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
-    dataSets["swizzled"].read(cache.data(), PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
+    swizzledReader->read(start, count, cache.data());
     float mean = calculateMean(cache);
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto dtYZ = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
     printResult(mean);
-    fmt::print("Ran YZ-Image Swizzled trial (x={}) in {:.2f} ms.\n", x, dtYZ * 1.0e-3, mean);
+    printTrial("Ran YZ-Image Swizzled trial (x={}) in {:.2f} ms.\n", x, dtYZ * 1.0e-3, mean);
+    return {"YZ-Image Swizzled", dtYZ * 1.0e-3, cache.size() * sizeof(float)};
 }
 
-void trialZ() {
+TrialResult trialZ(Backend backend) {
     // Z-Profile reads
+    auto reader = getReader("main", backend);
     auto tStart = std::chrono::high_resolution_clock::now();
     int x = ((float) rand()) / RAND_MAX * width;
     int y = ((float) rand()) / RAND_MAX * height;
@@ -218,51 +279,24 @@ void trialZ() {
     // Append channel (and stokes in 4D) to hyperslab dims
     if (dimensions == 4) {
         count.insert(count.begin(), {1});
-        start.insert(start.begin(), {0});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
     }
 
-    // Read data into memory space
-    hsize_t memDims[] = {depth};
-    DataSpace memspace(1, memDims);
+    // Read data into cache
     int N = depth;
     cache.resize(depth);
-    auto sliceDataSpace = dataSets["main"].getSpace();
-    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
-    dataSets["main"].read(cache.data(), PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
+    reader->read(start, count, cache.data());
     float mean = calculateMean(cache);
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto dtZ = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
     printResult(mean);
-    fmt::print("Ran Z-Profile trial ({},{}) in {:.2f} ms.\n", x, y, dtZ * 1.0e-3, mean);
+    printTrial("Ran Z-Profile trial ({},{}) in {:.2f} ms.\n", x, y, dtZ * 1.0e-3, mean);
+    return {"Z-Profile", dtZ * 1.0e-3, cache.size() * sizeof(float)};
 }
 
-void trialZMmap() {
-    omp_set_num_threads(8);
-    // Z-Profile reads
-    auto tStart = std::chrono::high_resolution_clock::now();
-    int x = ((float) rand()) / RAND_MAX * width;
-    int y = ((float) rand()) / RAND_MAX * height;
-
-    auto sliceSizeBytes = width * height * sizeof(float);
-    auto dataSetOffset = dataSets["main"].getOffset();
-    auto pixelOffset = (y * width + x) * sizeof(float);
-    cache.resize(depth);
-
-#pragma omp parallel for
-    for (auto i = 0; i < depth; i++) {
-        auto planeOffset = dataSetOffset + i * sliceSizeBytes;
-        auto offset = planeOffset + pixelOffset;
-        memcpy(cache.data() + i, filePtr + offset, sizeof(float));
-    }
-    float mean = calculateMean(cache);
-    auto tEnd = std::chrono::high_resolution_clock::now();
-    auto dtZ = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
-    printResult(mean);
-    fmt::print("Ran Z-Profile trial ({},{}) in {:.2f} ms.\n", x, y, dtZ * 1.0e-3, mean);
-}
-
-void trialZSwizzled() {
+TrialResult trialZSwizzled(Backend backend) {
     // Z-Profile reads
+    auto swizzledReader = getReader("swizzled", backend);
     auto tStart = std::chrono::high_resolution_clock::now();
     int x = ((float) rand()) / RAND_MAX * width;
     int y = ((float) rand()) / RAND_MAX * height;
@@ -274,26 +308,24 @@ void trialZSwizzled() {
     // Append channel (and stokes in 4D) to hyperslab dims
     if (dimensions == 4) {
         count.insert(count.begin(), {1});
-        start.insert(start.begin(), {0});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
     }
 
-    // Read data into memory space
-    hsize_t memDims[] = {depth};
-    DataSpace memspace(1, memDims);
+    // Read data into cache
     int N = depth;
     cache.resize(N);
-    auto sliceDataSpace = dataSets["swizzled"].getSpace();
-    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
-    dataSets["swizzled"].read(cache.data(), PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
+    swizzledReader->read(start, count, cache.data());
     float mean = calculateMean(cache);
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto dtZ = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
     printResult(mean);
-    fmt::print("Ran Z-Profile Swizzled trial ({},{}) in {:.2f} ms.\n", x, y, dtZ * 1.0e-3, mean);
+    printTrial("Ran Z-Profile Swizzled trial ({},{}) in {:.2f} ms.\n", x, y, dtZ * 1.0e-3, mean);
+    return {"Z-Profile Swizzled", dtZ * 1.0e-3, cache.size() * sizeof(float)};
 }
 
-void trialRegion(int size) {
+TrialResult trialRegion(Backend backend, int size) {
     // Z-Profile reads
+    auto reader = getReader("main", backend);
     auto tStart = std::chrono::high_resolution_clock::now();
     int x = ((float) rand()) / RAND_MAX * width;
     int y = ((float) rand()) / RAND_MAX * height;
@@ -306,26 +338,31 @@ void trialRegion(int size) {
     // Append channel (and stokes in 4D) to hyperslab dims
     if (dimensions == 4) {
         count.insert(count.begin(), {1});
-        start.insert(start.begin(), {0});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
     }
 
-    // Read data into memory space
-    hsize_t memDims[] = {depth, size, size};
-    DataSpace memspace(3, memDims);
+    // Read data into cache
     int N = depth * size * size;
     cache.resize(N);
-    auto sliceDataSpace = dataSets["main"].getSpace();
-    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
-    dataSets["main"].read(cache.data(), PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
+    if (tileCache) {
+        // One region per channel, each assembled from the tiles it overlaps
+        for (auto c = 0; c < depth; c++) {
+            readThroughTiles(*tileCache, reader, "main", mainDims(), trialStokes, c, x, y, size, size, 1, cache.data() + size_t(c) * size * size);
+        }
+    } else {
+        reader->read(start, count, cache.data());
+    }
     float mean = calculateMean(cache);
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto dtZ = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
     printResult(mean);
-    fmt::print("Ran {}x{}x{} Region trial ({},{}) in {:.2f} ms.\n", size, size, depth, x, y, dtZ * 1.0e-3, mean);
+    printTrial("Ran {}x{}x{} Region trial ({},{}) in {:.2f} ms.\n", size, size, depth, x, y, dtZ * 1.0e-3, mean);
+    return {fmt::format("{}x{}x{} Region", size, size, depth), dtZ * 1.0e-3, cache.size() * sizeof(float)};
 }
 
-void trialRegionSwizzled(int size) {
+TrialResult trialRegionSwizzled(Backend backend, int size) {
     // Z-Profile reads
+    auto swizzledReader = getReader("swizzled", backend);
     auto tStart = std::chrono::high_resolution_clock::now();
     int x = ((float) rand()) / RAND_MAX * width;
     int y = ((float) rand()) / RAND_MAX * height;
@@ -338,26 +375,52 @@ void trialRegionSwizzled(int size) {
     // Append channel (and stokes in 4D) to hyperslab dims
     if (dimensions == 4) {
         count.insert(count.begin(), {1});
-        start.insert(start.begin(), {0});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
     }
 
-    // Read data into memory space
-    hsize_t memDims[] = {size, size, depth};
-    DataSpace memspace(3, memDims);
+    // Read data into cache
     int N = depth * size * size;
     cache.resize(N);
-    auto sliceDataSpace = dataSets["swizzled"].getSpace();
-    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
-    dataSets["swizzled"].read(cache.data(), PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
+    swizzledReader->read(start, count, cache.data());
     float mean = calculateMean(cache);
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto dtZ = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
     printResult(mean);
-    fmt::print("Ran {}x{}x{} Region Swizzled trial ({},{}) in {:.2f} ms.\n", size, size, depth, x, y, dtZ * 1.0e-3, mean);
+    printTrial("Ran {}x{}x{} Region Swizzled trial ({},{}) in {:.2f} ms.\n", size, size, depth, x, y, dtZ * 1.0e-3, mean);
+    return {fmt::format("{}x{}x{} Region Swizzled", size, size, depth), dtZ * 1.0e-3, cache.size() * sizeof(float)};
 }
 
-void trialDownSample(int mip, bool meanFilter, int size=0) {
+TrialResult trialRegionProfile(Backend backend, int size, RegionShape shape, bool swizzled) {
+    // Mean spectral profile of the pixels of a region, read through its bounding box
+    auto reader = getReader(swizzled ? "swizzled" : "main", backend);
+    int x = ((float) rand()) / RAND_MAX * width;
+    int y = ((float) rand()) / RAND_MAX * height;
+    x = min(x, width - size - 1);
+    y = min(y, height - size - 1);
+    auto runs = regionRuns(shape, size, size);
+    size_t pixels = 0;
+    for (auto& run : runs) {
+        pixels += run.end - run.start;
+    }
+
+    vector<float> profile;
+    auto result = regionProfile(reader, swizzled, mainDims(), trialStokes, x, y, size, size, runs, profileBlock, profile);
+    auto name = fmt::format("{}x{}x{} {} Profile{}", size, size, depth, regionShapeName(shape), swizzled ? " Swizzled" : "");
+    if (profileBlock > 0) {
+        name += fmt::format(" (streamed, {} channels per block)", profileBlock);
+    }
+    printResult(calculateMean(profile));
+    printTrial("Ran {} trial ({},{}) in {:.2f} ms, first partial profile after {:.2f} ms\n", name, x, y, result.completeMs,
+               result.firstPartialMs);
+    TrialResult trialResult = {name, result.completeMs, result.bytes, result.readMs, result.computeMs};
+    trialResult.metrics = {{"first_partial_ms", result.firstPartialMs}, {"complete_ms", result.completeMs},
+                           {"blocks", double(result.blocks)}, {"region_pixels", double(pixels)}};
+    return trialResult;
+}
+
+TrialResult trialDownSample(Backend backend, int mip, DownsampleFilter filter, int size=0) {
     // XY-Image reads
+    auto reader = getReader("main", backend);
     auto tStart = std::chrono::high_resolution_clock::now();
     int z = ((float) rand()) / RAND_MAX * depth;
     int x, y, w, h;
@@ -383,66 +446,78 @@ void trialDownSample(int mip, bool meanFilter, int size=0) {
     // Append channel (and stokes in 4D) to hyperslab dims
     if (dimensions == 4) {
         count.insert(count.begin(), {1});
-        start.insert(start.begin(), {0});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
     }
 
-    // Read data into memory space
-    hsize_t memDims[] = {h, w};
-    DataSpace memspace(2, memDims);
-    cache.resize(w * h);
-    auto sliceDataSpace = dataSets["main"].getSpace();
-    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
-    dataSets["main"].read(cache.data(), PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
-
     size_t numRowsRegion = h / mip;
     size_t rowLengthRegion = w / mip;
     vector<float> regionData;
     regionData.resize(numRowsRegion * rowLengthRegion);
+    auto tRead = tStart;
 
-    if (meanFilter) {
-        // Perform down-sampling by calculating the mean for each MIPxMIP block
-        for (auto j = 0; j < numRowsRegion; j++) {
-            for (auto i = 0; i < rowLengthRegion; i++) {
-                float pixelSum = 0;
-                int pixelCount = 0;
-                for (auto pixelX = 0; pixelX < mip; pixelX++) {
-                    for (auto pixelY = 0; pixelY < mip; pixelY++) {
-                        auto imageRow = j * mip + pixelY;
-                        auto imageCol = i * mip + pixelX;
-                        float pixVal = cache[imageRow * w + imageCol];
-                        if (!isnan(pixVal)) {
-                            pixelCount++;
-                            pixelSum += pixVal;
-                        }
-                    }
-                }
-                regionData[j * rowLengthRegion + i] = pixelCount ? pixelSum / pixelCount : NAN;
-            }
-        }
+    if (tileCache && filter == DownsampleFilter::Mean) {
+        // Cached tiles are already down-sampled, on a grid aligned to multiples of mip, so the region snaps to it.
+        // Reading and down-sampling missing tiles both count as I/O.
+        cache.resize(w * h);
+        readThroughTiles(*tileCache, reader, "main", mainDims(), trialStokes, z, x / mip, y / mip, rowLengthRegion, numRowsRegion, mip,
+                         regionData.data());
+        tRead = std::chrono::high_resolution_clock::now();
     } else {
-        // Nearest neighbour filtering
-        for (auto j = 0; j < numRowsRegion; j++) {
-            for (auto i = 0; i < rowLengthRegion; i++) {
-                auto imageRow = j * mip;
-                auto imageCol = i * mip;
-                regionData[j * rowLengthRegion + i] = cache[imageRow * w + imageCol];
-            }
-        }
+        // Read data into cache
+        cache.resize(w * h);
+        reader->read(start, count, cache.data());
+        tRead = std::chrono::high_resolution_clock::now();
+        downsample(cache.data(), h, w, w, mip, filter, regionData.data());
     }
 
     float dsMean = calculateMean(regionData);
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto dtXY = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
+    auto dtRead = std::chrono::duration_cast<std::chrono::microseconds>(tRead - tStart).count();
+    auto name = size ? fmt::format("XY Down-sample (region {}x{}) x{} ({})", size, size, mip, filterName(filter))
+                     : fmt::format("XY Down-sample (full) x{} ({})", mip, filterName(filter));
     printResult(dsMean);
-    if (size) {
-        fmt::print("Ran XY Down-sample (region {}x{}) x{} {} trial (z={}) in {:.2f} ms\n", size, size, mip, meanFilter ? "(mean)" : "(nn)", z, dtXY * 1.0e-3);
-    } else {
-        fmt::print("Ran XY Down-sample (full) x{} {} trial (z={}) in {:.2f} ms\n", mip, meanFilter ? "(mean)" : "(nn)", z, dtXY * 1.0e-3);
+    printTrial("Ran {} trial (z={}) in {:.2f} ms\n", name, z, dtXY * 1.0e-3);
+    return {name, dtXY * 1.0e-3, cache.size() * sizeof(float), dtRead * 1.0e-3, (dtXY - dtRead) * 1.0e-3};
+}
+
+TrialResult trialDownSampleStrided(Backend backend, int mip) {
+    // Nearest-neighbour down-sampling with the stride pushed into the selection, so that only the pixels kept are read
+    auto reader = getReader("main", backend);
+    auto tStart = std::chrono::high_resolution_clock::now();
+    int z = ((float) rand()) / RAND_MAX * depth;
+    size_t numRowsRegion = height / mip;
+    size_t rowLengthRegion = width / mip;
+    // Define dimensions of hyperslab in 2D
+    vector<hsize_t> count = {1, numRowsRegion, rowLengthRegion};
+    vector<hsize_t> start = {hsize_t(z), 0, 0};
+    vector<hsize_t> stride = {1, hsize_t(mip), hsize_t(mip)};
+
+    // Append channel (and stokes in 4D) to hyperslab dims
+    if (dimensions == 4) {
+        count.insert(count.begin(), {1});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
+        stride.insert(stride.begin(), {1});
     }
+
+    // Read data into cache
+    cache.resize(rowLengthRegion * numRowsRegion);
+    reader->readStrided(start, count, stride, cache.data());
+    float mean = calculateMean(cache);
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    auto dtXY = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
+    printResult(mean);
+    auto name = fmt::format("XY Strided Down-sample (full) x{} (nn)", mip);
+    printTrial("Ran {} trial (z={}) in {:.2f} ms\n", name, z, dtXY * 1.0e-3);
+    return {name, dtXY * 1.0e-3, cache.size() * sizeof(float)};
 }
 
-void trialReadMip(int mip) {
-    // XY-Image reads
+TrialResult trialReadMip(Backend backend, int mip) {
+    // XY-Image reads of a mipmap built with --build-mips. Files without one fall back to reading
+    // an equally sized corner of the full-resolution image.
+    auto mipName = fmt::format("mip{}", mip);
+    bool emulated = !dataSets.count(mipName);
+    auto reader = getReader(emulated ? "main" : mipName, backend);
     auto tStart = std::chrono::high_resolution_clock::now();
     int z = ((float) rand()) / RAND_MAX * depth;
     size_t numRowsRegion = height / mip;
@@ -454,37 +529,1423 @@ void trialReadMip(int mip) {
     // Append channel (and stokes in 4D) to hyperslab dims
     if (dimensions == 4) {
         count.insert(count.begin(), {1});
-        start.insert(start.begin(), {0});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
     }
 
-    // Read data into memory space
-    hsize_t memDims[] = {numRowsRegion, rowLengthRegion};
-    DataSpace memspace(2, memDims);
+    // Read data into cache
     cache.resize(rowLengthRegion * numRowsRegion);
-    auto sliceDataSpace = dataSets["main"].getSpace();
-    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
-    dataSets["main"].read(cache.data(), PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
+    reader->read(start, count, cache.data());
     float mean = calculateMean(cache);
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto dtXY = std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
     printResult(mean);
-    fmt::print("Ran XY MIP Read x{} trial (z={}) in {:.2f} ms\n", mip, z, dtXY * 1.0e-3);
+    auto name = fmt::format("XY MIP Read x{}{}", mip, emulated ? " (emulated)" : "");
+    printTrial("Ran {} trial (z={}) in {:.2f} ms\n", name, z, dtXY * 1.0e-3);
+    return {name, dtXY * 1.0e-3, cache.size() * sizeof(float)};
+}
+
+TrialResult trialAnimation(Backend backend, PlaybackMode mode, bool prefetch) {
+    // Channel animation: consecutive XY-Images, read ahead by background I/O threads
+    AnimationOptions options(animationOptions);
+    options.stokes = trialStokes;
+    if (!prefetch) {
+        options.prefetch = 0;
+    }
+    // Each I/O thread needs a reader of its own
+    vector<unique_ptr<DataReader>> ioReaders;
+    for (auto i = 0; i < (options.prefetch ? max(1u, options.ioThreads) : 1); i++) {
+        ioReaders.push_back(createReader(backend, dataFilename, dataSets["main"], queueDepth));
+        if (!ioReaders.back()) {
+            throw runtime_error(fmt::format("Could not open a {} reader for animation", backendName(backend)));
+        }
+    }
+    vector<hsize_t> dims(dimensions);
+    dataSets["main"].getSpace().getSimpleExtentDims(dims.data(), nullptr);
+    int z = ((float) rand()) / RAND_MAX * (depth - 1);
+
+    auto result = playAnimation(ioReaders, dims, mode, z, options);
+    auto name = fmt::format("Animation ({}, {} fps target, prefetch {})", playbackModeName(mode), options.fps, options.prefetch);
+    printTrial("Ran {} trial (z={}) in {:.2f} ms: {:.2f} fps, jitter {:.2f} ms, {:.0f}% prefetch hits\n", name, z, result.totalMs,
+               result.fps, result.jitterMs, result.prefetchHitPct);
+    TrialResult trialResult = {name, result.totalMs, result.bytes, result.waitMs, result.computeMs};
+    trialResult.metrics = {{"fps", result.fps}, {"jitter_ms", result.jitterMs}, {"prefetch_hit_pct", result.prefetchHitPct}};
+    return trialResult;
+}
+
+// Reopens the datasets and evicts the file from the page cache, returning the fraction still resident
+double dropFileCache(H5File& file, const string& filename);
+
+TrialResult trialViewerSession(Backend backend) {
+    // A viewer panning and zooming over neighbouring channels, replayed reading each view directly and then through
+    // a tile cache. Views are at most 1024x768 pixels, at power-of-two zoom levels down to the whole image.
+    auto reader = getReader("main", backend);
+    int viewWidth = min(width, 1024);
+    int viewHeight = min(height, 768);
+    int maxMip = 1;
+    while (width / maxMip > viewWidth || height / maxMip > viewHeight) {
+        maxMip *= 2;
+    }
+
+    struct View {
+        int z, mip, centerX, centerY;
+    };
+    vector<View> views = {{int(((float) rand()) / RAND_MAX * (depth - 1)), maxMip, width / 2, height / 2}};
+    vector<View> history;
+    for (auto i = 1; i < sessionViews; i++) {
+        View view = views.back();
+        int action = rand() % 10;
+        if (action < 5) {
+            // Pan by a quarter of the view
+            int step = (action % 2 ? viewWidth : viewHeight) * view.mip / 4 * (rand() % 2 ? 1 : -1);
+            (action % 2 ? view.centerX : view.centerY) += step;
+        } else if (action < 7 && view.mip > 1) {
+            view.mip /= 2;
+        } else if (action == 7 && view.mip < maxMip) {
+            view.mip *= 2;
+        } else if (action == 8) {
+            view.z = min(depth - 1, max(0, view.z + (rand() % 2 ? 1 : -1)));
+        } else if (!history.empty()) {
+            // Back to an earlier view
+            view = history[rand() % history.size()];
+        }
+        view.centerX = min(width - 1, max(0, view.centerX));
+        view.centerY = min(height - 1, max(0, view.centerY));
+        history.push_back(views.back());
+        views.push_back(view);
+    }
+
+    TileCache sessionCache(tileCacheBytes, tileSize);
+    vector<float> block, viewData;
+    vector<double> directMs, cachedMs;
+    size_t bytes = 0;
+    for (auto pass = 0; pass < 2; pass++) {
+        // Both passes start from the same cache state; the runner has evicted the file before the direct one
+        if (coldPass && pass > 0) {
+            dropFileCache(*dataFile, dataFilename);
+            reader = getReader("main", backend);
+        }
+        for (auto& view : views) {
+            // View origin and size in down-sampled pixels
+            int w = min(viewWidth, width / view.mip);
+            int h = min(viewHeight, height / view.mip);
+            int x = min(max(0, view.centerX / view.mip - w / 2), width / view.mip - w);
+            int y = min(max(0, view.centerY / view.mip - h / 2), height / view.mip - h);
+            viewData.resize(w * h);
+
+            auto t0 = std::chrono::high_resolution_clock::now();
+            if (pass == 0) {
+                vector<hsize_t> count = {1, hsize_t(h * view.mip), hsize_t(w * view.mip)};
+                vector<hsize_t> start = {hsize_t(view.z), hsize_t(y * view.mip), hsize_t(x * view.mip)};
+                if (dimensions == 4) {
+                    count.insert(count.begin(), {1});
+                    start.insert(start.begin(), {hsize_t(trialStokes)});
+                }
+                block.resize(w * h * view.mip * view.mip);
+                reader->read(start, count, block.data());
+                downsample(block.data(), h * view.mip, w * view.mip, w * view.mip, view.mip, DownsampleFilter::Mean, viewData.data());
+            } else {
+                readThroughTiles(sessionCache, reader, "main", mainDims(), trialStokes, view.z, x, y, w, h, view.mip, viewData.data());
+                bytes += viewData.size() * sizeof(float);
+            }
+            auto t1 = std::chrono::high_resolution_clock::now();
+            (pass == 0 ? directMs : cachedMs).push_back(std::chrono::duration<double, milli>(t1 - t0).count());
+        }
+    }
+
+    auto stats = sessionCache.stats();
+    double directTotal = accumulate(directMs.begin(), directMs.end(), 0.0);
+    double cachedTotal = accumulate(cachedMs.begin(), cachedMs.end(), 0.0);
+    sort(directMs.begin(), directMs.end());
+    sort(cachedMs.begin(), cachedMs.end());
+    auto name = fmt::format("Viewer session ({} views, {} MiB tile cache)", sessionViews, tileCacheBytes / (1024 * 1024));
+    printTrial("Ran {} trial (z={}) in {:.2f} ms ({:.2f} ms uncached): {:.1f}% tile hits, {} evictions\n", name, views.front().z,
+               cachedTotal, directTotal, stats.hits * 100.0 / max<size_t>(1, stats.hits + stats.misses), stats.evictions);
+    TrialResult result = {name, cachedTotal, bytes};
+    result.metrics = {{"tile_hit_pct", stats.hits * 100.0 / max<size_t>(1, stats.hits + stats.misses)},
+                      {"evictions_per_view", stats.evictions / double(views.size())},
+                      {"p50_ms", percentile(cachedMs, 50)}, {"p99_ms", percentile(cachedMs, 99)},
+                      {"uncached_p50_ms", percentile(directMs, 50)}, {"uncached_p99_ms", percentile(directMs, 99)},
+                      {"speedup", directTotal / cachedTotal}};
+    return result;
+}
+
+TrialResult trialStatistics(Backend backend) {
+    // Statistics and histogram of an XY-Image, timed separately from the read to show when computing them costs
+    // more than reading the data
+    auto reader = getReader("main", backend);
+    auto tStart = std::chrono::high_resolution_clock::now();
+    int z = ((float) rand()) / RAND_MAX * depth;
+    vector<hsize_t> count = {1, hsize_t(height), hsize_t(width)};
+    vector<hsize_t> start = {hsize_t(z), 0, 0};
+    if (dimensions == 4) {
+        count.insert(count.begin(), {1});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
+    }
+    cache.resize(width * height);
+    reader->read(start, count, cache.data());
+    auto tRead = std::chrono::high_resolution_clock::now();
+    auto stats = calculateStats(cache.data(), cache.size());
+    auto tStats = std::chrono::high_resolution_clock::now();
+    // As many bins as the square root of the number of pixels, as CARTA uses by default
+    int bins = max(2, int(sqrt(double(cache.size()))));
+    auto histogram = calculateHistogram(cache.data(), cache.size(), stats.minVal, stats.maxVal, bins);
+    auto tEnd = std::chrono::high_resolution_clock::now();
+
+    double readMs = std::chrono::duration<double, milli>(tRead - tStart).count();
+    double statsMs = std::chrono::duration<double, milli>(tStats - tRead).count();
+    double histogramMs = std::chrono::duration<double, milli>(tEnd - tStats).count();
+    double totalMs = std::chrono::duration<double, milli>(tEnd - tStart).count();
+    size_t bytes = cache.size() * sizeof(float);
+    auto name = fmt::format("XY Statistics ({})", simdLevelName(getSimdLevel()));
+    printTrial("Mean: {:.4f}, std dev: {:.4f}, min: {:.4f}, max: {:.4f}, {} valid pixels in {} bins; ", stats.mean, stats.stdDev,
+               stats.minVal, stats.maxVal, accumulate(histogram.begin(), histogram.end(), size_t(0)), bins);
+    printTrial("Ran {} trial (z={}) in {:.2f} ms ({:.2f} ms statistics, {:.2f} ms histogram)\n", name, z, totalMs, statsMs, histogramMs);
+    TrialResult result = {name, totalMs, bytes, readMs, statsMs + histogramMs};
+    result.metrics = {{"stats_ms", statsMs}, {"histogram_ms", histogramMs},
+                      {"stats_gb_per_sec", statsMs > 0 ? bytes * 1.0e-6 / statsMs : NAN},
+                      {"compute_read_ratio", readMs > 0 ? (statsMs + histogramMs) / readMs : NAN}};
+    return result;
+}
+
+TrialResult trialFirstStatistics(Backend backend) {
+    // Time until the statistics and histogram of a channel are available, read from 0/Statistics and computed
+    // from the image. A viewer needs the image to display the channel either way, so it is read once and both
+    // paths share that read and its cache state: stored is the read plus the lookup, computed the read plus the
+    // computation.
+    if (!statisticsIndex || !statisticsIndex->valid()) {
+        throw runtime_error("No precomputed statistics; run --build-stats first");
+    }
+    auto reader = getReader("main", backend);
+    int z = ((float) rand()) / RAND_MAX * depth;
+    vector<hsize_t> count = {1, hsize_t(height), hsize_t(width)};
+    vector<hsize_t> start = {hsize_t(z), 0, 0};
+    if (dimensions == 4) {
+        count.insert(count.begin(), {1});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
+    }
+    cache.resize(width * height);
+    vector<size_t> histogram;
+
+    auto tStart = std::chrono::high_resolution_clock::now();
+    reader->read(start, count, cache.data());
+    auto tRead = std::chrono::high_resolution_clock::now();
+    BasicStats stored;
+    statisticsIndex->channelStats(trialStokes, z, stored, &histogram);
+    auto tStored = std::chrono::high_resolution_clock::now();
+    auto computed = calculateStats(cache.data(), cache.size());
+    histogram = calculateHistogram(cache.data(), cache.size(), computed.minVal, computed.maxVal, statisticsIndex->bins());
+    auto tComputed = std::chrono::high_resolution_clock::now();
+
+    double readMs = std::chrono::duration<double, milli>(tRead - tStart).count();
+    double storedMs = std::chrono::duration<double, milli>(tStored - tRead).count();
+    double computeOnlyMs = std::chrono::duration<double, milli>(tComputed - tStored).count();
+    double storedTotalMs = readMs + storedMs;
+    double computedMs = readMs + computeOnlyMs;
+    auto name = "Time to first statistics";
+    printTrial("Mean: {:.4f} stored, {:.4f} computed; ", stored.mean, computed.mean);
+    printTrial("Ran {} trial (z={}): {:.3f} ms stored, {:.2f} ms computed\n", name, z, storedMs, computeOnlyMs);
+    TrialResult result = {name, storedTotalMs, cache.size() * sizeof(float), readMs, storedMs};
+    result.metrics = {{"stored_stats_ms", storedMs}, {"computed_stats_ms", computeOnlyMs},
+                      {"computed_total_ms", computedMs}, {"speedup", storedTotalMs > 0 ? computedMs / storedTotalMs : NAN}};
+    return result;
+}
+
+TrialResult trialMoments(Backend backend, MomentTraversal traversal) {
+    // Moment 0, 1 and 2, peak and peak channel maps of the trial's stokes in one pass over the cube, repeated with
+    // each thread count
+    bool spectra = traversal == MomentTraversal::Spectra;
+    auto reader = getReader(spectra ? "swizzled" : "main", backend);
+    int maxThreads = 1;
+#ifdef _OPENMP
+    maxThreads = omp_get_max_threads();
+#endif
+    vector<int> threadCounts;
+    for (auto threads : momentThreads) {
+        if (find(threadCounts.begin(), threadCounts.end(), threads) == threadCounts.end()) {
+            threadCounts.push_back(threads);
+        }
+    }
+    if (threadCounts.empty()) {
+        for (auto threads = 1; threads < maxThreads; threads *= 2) {
+            threadCounts.push_back(threads);
+        }
+        threadCounts.push_back(maxThreads);
+    }
+
+    // The trial's times and bytes are those of every pass together, the span its resource counters cover
+    MomentMaps maps;
+    MomentResult moments, total = {0, 0, 0, 0, 0};
+    vector<pair<string, double>> scaling;
+    auto tStart = std::chrono::high_resolution_clock::now();
+    for (size_t pass = 0; pass < threadCounts.size(); pass++) {
+        int threads = threadCounts[pass];
+        // Each thread count reads the cube from the same cache state; the runner has evicted it before the first
+        if (coldPass && pass > 0) {
+            dropFileCache(*dataFile, dataFilename);
+            reader = getReader(spectra ? "swizzled" : "main", backend);
+        }
+#ifdef _OPENMP
+        omp_set_num_threads(max(1, threads));
+#endif
+        moments = computeMoments(reader, mainDims(), trialStokes, traversal, momentMemory, maps);
+        scaling.push_back({fmt::format("gb_per_sec_{}t", threads), moments.bytes * 1.0e-9 / moments.seconds});
+        total.readSeconds += moments.readSeconds;
+        total.computeSeconds += moments.computeSeconds;
+        total.bytes += moments.bytes;
+        total.bufferBytes = max(total.bufferBytes, moments.bufferBytes);
+    }
+    // Including the evictions between passes in cold mode
+    total.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+#ifdef _OPENMP
+    omp_set_num_threads(maxThreads);
+#endif
+
+    string threadList;
+    for (auto threads : threadCounts) {
+        threadList += (threadList.empty() ? "" : "/") + to_string(threads);
+    }
+    auto name = fmt::format("Moment maps ({}, {} thread{})", momentTraversalName(traversal), threadList,
+                            threadCounts.size() == 1 && threadCounts[0] == 1 ? "" : "s");
+    double validSum = 0;
+    for (auto val : maps.moment0) {
+        if (!isnan(val)) {
+            validSum += val;
+        }
+    }
+    printResult(validSum / maps.moment0.size());
+    printTrial("Ran {} trial in {:.2f} ms: {:.2f} GB/s, read {:.2f} ms, compute {:.2f} ms\n", name, total.seconds * 1.0e3,
+               total.bytes * 1.0e-9 / total.seconds, total.readSeconds * 1.0e3, total.computeSeconds * 1.0e3);
+    TrialResult result = {name, total.seconds * 1.0e3, total.bytes, total.readSeconds * 1.0e3, total.computeSeconds * 1.0e3};
+    result.metrics = {{"gb_per_sec", total.bytes * 1.0e-9 / total.seconds}, {"buffer_mb", total.bufferBytes * 1.0e-6},
+                      {"peak_rss_mb", peakResidentMb()}};
+    result.metrics.insert(result.metrics.end(), scaling.begin(), scaling.end());
+    return result;
+}
+
+TrialResult trialStartup(Backend backend, StartupMode mode) {
+    // Time to the first image of the file, from opening it to its down-sampled first channel, statistics and header.
+    // The file is opened by a child process, as it is already open here and HDF5 would share its metadata cache.
+    StartupOptions options(startupOptions);
+    options.mode = mode;
+    options.backend = backend;
+    StartupTimes times;
+    if (!measureStartupInChild(dataFilename, options, times)) {
+        throw runtime_error(fmt::format("Startup measurement of {} failed", dataFilename));
+    }
+    auto name = fmt::format("Startup ({})", startupModeName(mode));
+    printTrial("Ran {} trial in {:.2f} ms: open {:.2f} ms, metadata {:.2f} ms, {} attributes {:.2f} ms, image {:.2f} ms, "
+               "statistics {:.2f} ms\n", name, times.totalMs, times.openMs, times.metadataMs, times.attributes, times.attributesMs,
+               times.imageMs, times.statsMs);
+    TrialResult result = {name, times.totalMs, times.bytes};
+    result.metrics = {{"open_ms", times.openMs}, {"metadata_ms", times.metadataMs}, {"attributes_ms", times.attributesMs},
+                      {"image_ms", times.imageMs}, {"stats_ms", times.statsMs}, {"header_attributes", double(times.attributes)},
+                      {"paged", times.paged ? 1.0 : 0.0}};
+    return result;
+}
+
+// Name of the reader of the k-th stokes plane read at once from a dataset; the first is the dataset's own reader
+string stokesReaderName(const string& dataSetName, int k) {
+    return k ? fmt::format("{}:{}", dataSetName, k) : dataSetName;
+}
+
+TrialResult trialPolarization(Backend backend, PolarizationQuantity quantity, bool spectral, bool swizzled) {
+    // A derived polarization XY-Image or Z-profile, computed from the stokes planes it needs, which are read
+    // concurrently with a reader each. The same selection is then read from 0/Polarization if the file has it.
+    if (dimensions != 4 || stokes < 3) {
+        throw runtime_error("Polarization trials need a 4D cube with I, Q and U");
+    }
+    string dataSetName = swizzled ? "swizzled" : "main";
+    hsize_t planeWidth = width, planeHeight = height, channels = depth;
+    hsize_t x = ((float) rand()) / RAND_MAX * planeWidth;
+    hsize_t y = ((float) rand()) / RAND_MAX * planeHeight;
+    hsize_t z = ((float) rand()) / RAND_MAX * channels;
+    vector<hsize_t> count, start;
+    if (!spectral) {
+        count = {1, 1, planeHeight, planeWidth};
+        start = {0, z, 0, 0};
+    } else if (!swizzled) {
+        count = {1, channels, 1, 1};
+        start = {0, 0, y, x};
+    } else {
+        count = {1, 1, 1, channels};
+        start = {0, x, y, 0};
+    }
+    size_t n = spectral ? channels : planeWidth * planeHeight;
+    auto inputs = polarizationInputs(quantity);
+    vector<DataReader*> planeReaders;
+    for (size_t k = 0; k < inputs.size(); k++) {
+        planeReaders.push_back(getReader(stokesReaderName(dataSetName, k), backend));
+    }
+    vector<vector<float>> planes(inputs.size(), vector<float>(n));
+
+    auto tStart = std::chrono::high_resolution_clock::now();
+    vector<thread> planeReads;
+    for (size_t k = 0; k < inputs.size(); k++) {
+        planeReads.emplace_back([&, k]() {
+            auto planeStart = start;
+            planeStart[0] = inputs[k];
+            planeReaders[k]->read(planeStart, count, planes[k].data());
+        });
+    }
+    for (auto& planeRead : planeReads) {
+        planeRead.join();
+    }
+    auto tRead = std::chrono::high_resolution_clock::now();
+    vector<const float*> planePointers;
+    for (auto& plane : planes) {
+        planePointers.push_back(plane.data());
+    }
+    cache.resize(n);
+    derivePolarization(quantity, planePointers, n, cache.data());
+    auto tEnd = std::chrono::high_resolution_clock::now();
+
+    double readMs = std::chrono::duration<double, milli>(tRead - tStart).count();
+    double deriveMs = std::chrono::duration<double, milli>(tEnd - tRead).count();
+    double totalMs = std::chrono::duration<double, milli>(tEnd - tStart).count();
+    size_t bytes = inputs.size() * n * sizeof(float);
+    auto name = fmt::format("{}{} {}", spectral ? "Z-Profile" : "XY-Image", swizzled ? " Swizzled" : "", polarizationName(quantity));
+    printResult(calculateMean(cache));
+    printTrial("Ran {} trial ({},{},{}) in {:.2f} ms: read {:.2f} ms, derive {:.2f} ms", name, x, y, z, totalMs, readMs, deriveMs);
+    TrialResult result = {name, totalMs, bytes, readMs, deriveMs};
+    result.metrics = {{"stokes_planes", double(inputs.size())},
+                      {"derive_gb_per_sec", deriveMs > 0 ? bytes * 1.0e-6 / deriveMs : NAN}};
+
+    auto precomputedName = fmt::format("polarization{}/{}", swizzled ? "/swizzled" : "", polarizationDataSetName(quantity));
+    if (readers.count(make_pair(backend, precomputedName))) {
+        vector<hsize_t> precomputedCount(count.begin() + 1, count.end());
+        vector<hsize_t> precomputedStart(start.begin() + 1, start.end());
+        vector<float> precomputed(n);
+        auto t0 = std::chrono::high_resolution_clock::now();
+        getReader(precomputedName, backend)->read(precomputedStart, precomputedCount, precomputed.data());
+        double precomputedMs = std::chrono::duration<double, milli>(std::chrono::high_resolution_clock::now() - t0).count();
+        double maxDifference = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (!isnan(cache[i]) && !isnan(precomputed[i])) {
+                maxDifference = max(maxDifference, double(fabs(cache[i] - precomputed[i])));
+            }
+        }
+        printTrial(", {:.2f} ms precomputed", precomputedMs);
+        result.metrics.push_back({"precomputed_ms", precomputedMs});
+        result.metrics.push_back({"precomputed_bytes", double(n * sizeof(float))});
+        result.metrics.push_back({"speedup", precomputedMs > 0 ? totalMs / precomputedMs : NAN});
+        result.metrics.push_back({"max_difference", maxDifference});
+    }
+    printTrial("\n");
+    return result;
+}
+
+TrialResult trialViewport(Backend backend, TileEncoding encoding) {
+    // The tiles covering a 1024x768 view at a random pan and power-of-two zoom level, fetched, down-sampled and
+    // encoded in parallel with a reader per thread, against reading the whole channel and sending it down-sampled
+    // to the same zoom level as float32
+    int viewWidth = min(width, 1024);
+    int viewHeight = min(height, 768);
+    int levels = 1;
+    while (width >> (levels - 1) > viewWidth || height >> (levels - 1) > viewHeight) {
+        levels++;
+    }
+    int mip = 1 << (rand() % levels);
+    if (viewportMip > 0) {
+        mip = min(viewportMip, min(width, height));
+    }
+    int w = min(viewWidth, width / mip);
+    int h = min(viewHeight, height / mip);
+    int x = ((float) rand()) / RAND_MAX * (width / mip - w);
+    int y = ((float) rand()) / RAND_MAX * (height / mip - h);
+    int z = ((float) rand()) / RAND_MAX * depth;
+    Viewport viewport = {trialStokes, z, mip, x, y, w, h};
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    vector<unique_ptr<DataReader>> tileReaders;
+    for (auto i = 0; i < threads; i++) {
+        tileReaders.push_back(createReader(backend, dataFilename, dataSets["main"], queueDepth));
+        if (!tileReaders.back()) {
+            throw runtime_error(fmt::format("Could not open a {} reader for viewport tiles", backendName(backend)));
+        }
+    }
+    vector<vector<uint8_t>> encodedTiles;
+    auto result = renderViewport(tileReaders, tileCache.get(), "main", mainDims(), viewport, tileSize, encoding, encodedTiles);
+
+    // The float32 full-plane path, from the same cache state as the tiles
+    if (coldPass) {
+        tileReaders.clear();
+        dropFileCache(*dataFile, dataFilename);
+    }
+    auto reader = getReader("main", backend);
+    vector<hsize_t> count = {1, hsize_t(height), hsize_t(width)};
+    vector<hsize_t> start = {hsize_t(z), 0, 0};
+    if (dimensions == 4) {
+        count.insert(count.begin(), {1});
+        start.insert(start.begin(), {hsize_t(trialStokes)});
+    }
+    int imageWidth = width / mip;
+    int imageHeight = height / mip;
+    vector<float> image(size_t(imageWidth) * imageHeight);
+    auto t0 = std::chrono::high_resolution_clock::now();
+    cache.resize(size_t(width) * height);
+    reader->read(start, count, cache.data());
+    if (mip > 1) {
+        downsample(cache.data(), height, width, width, mip, DownsampleFilter::Mean, image.data());
+    } else {
+        image = cache;
+    }
+    double fullPlaneMs = std::chrono::duration<double, milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    size_t fullPlaneBytes = image.size() * sizeof(float);
+
+    // Error of the decoded tiles against the same pixels of the full plane, relative to the channel's range
+    auto stats = calculateStats(image.data(), image.size());
+    int tileEdge = tileCache ? tileCache->tileSize() : tileSize;
+    auto tiles = viewportTiles(mainDims(), viewport, tileEdge);
+    double maxError = 0;
+    size_t pixels = 0;
+    vector<float> decoded;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        int left = tiles[i].first * tileEdge, top = tiles[i].second * tileEdge;
+        int tileWidth = min(tileEdge, imageWidth - left);
+        int tileHeight = min(tileEdge, imageHeight - top);
+        decoded.resize(size_t(tileWidth) * tileHeight);
+        pixels += decoded.size();
+        decodeTile(encoding, encodedTiles[i].data(), decoded.size(), decoded.data());
+        for (auto row = 0; row < tileHeight; row++) {
+            for (auto column = 0; column < tileWidth; column++) {
+                float expected = image[size_t(top + row) * imageWidth + left + column];
+                float actual = decoded[size_t(row) * tileWidth + column];
+                if (isnan(expected) != isnan(actual)) {
+                    maxError = INFINITY;
+                } else if (!isnan(expected)) {
+                    maxError = max(maxError, double(fabs(actual - expected)));
+                }
+            }
+        }
+    }
+    double range = stats.count ? stats.maxVal - stats.minVal : 0;
+
+    sort(result.tileMs.begin(), result.tileMs.end());
+    auto name = fmt::format("Viewport tiles ({})", tileEncodingName(encoding));
+    printResult(stats.mean);
+    printTrial("Ran {} trial (z={}, x{} at {},{}) in {:.2f} ms: {} tiles, {} bytes; full plane {:.2f} ms, {} bytes\n", name, z, mip, x, y,
+               result.totalMs, tiles.size(), result.outputBytes, fullPlaneMs, fullPlaneBytes);
+    // Fetch and encode times are summed over tiles, so they are split per thread
+    TrialResult trialResult = {name, result.totalMs, result.outputBytes, result.fetchMs / threads, result.encodeMs / threads};
+    trialResult.metrics = {{"mip", double(mip)}, {"tiles", double(tiles.size())}, {"threads", double(threads)},
+                           {"output_bytes", double(result.outputBytes)}, {"bytes_read", double(result.bytesRead)},
+                           {"first_tile_ms", result.firstTileMs}, {"tile_p50_ms", percentile(result.tileMs, 50)},
+                           {"tile_p99_ms", percentile(result.tileMs, 99)},
+                           {"encode_gb_per_sec", result.encodeMs > 0 ? pixels * sizeof(float) * 1.0e-6 / result.encodeMs : NAN},
+                           {"full_plane_ms", fullPlaneMs}, {"full_plane_bytes", double(fullPlaneBytes)},
+                           {"byte_reduction", result.outputBytes ? double(fullPlaneBytes) / result.outputBytes : NAN},
+                           {"speedup", result.totalMs > 0 ? fullPlaneMs / result.totalMs : NAN},
+                           {"max_error_pct", range > 0 ? maxError / range * 100.0 : maxError}};
+    return trialResult;
+}
+
+// Legacy options 100, 101 and 200 select the mmap and raw-file variants of the XY and Z-profile trials
+Backend trialBackend(int val, Backend backend) {
+    if (val >= 200) {
+        return Backend::Pread;
+    } else if (val >= 100) {
+        return Backend::Mmap;
+    }
+    return backend;
+}
+
+TrialResult dispatchTrial(int val, Backend backend, bool& badopt) {
+    int mipLevel = 8;
+    int regionSmall(ceil(sqrt(0.0001) * min(width, height)));
+    int regionMedium(ceil(sqrt(0.001) * min(width, height)));
+    int regionLarge(ceil(sqrt(0.01) * min(width, height)));
+
+    badopt = false;
+    backend = trialBackend(val, backend);
+
+    switch (val) {
+        case 0: return trialXY(backend);
+        case 1: return trialYZ(backend);
+        case 2: return trialYZSwizzled(backend);
+        case 3: return trialZ(backend);
+        case 4: return trialZSwizzled(backend);
+        case 5: return trialRegion(backend, regionSmall);
+        case 6: return trialRegionSwizzled(backend, regionSmall);
+        case 7: return trialRegion(backend, regionMedium);
+        case 8: return trialRegionSwizzled(backend, regionMedium);
+        case 9: return trialRegion(backend, regionLarge);
+        case 10: return trialRegionSwizzled(backend, regionLarge);
+        case 11: return trialDownSample(backend, mipLevel, DownsampleFilter::Mean);
+        case 12: return trialReadMip(backend, mipLevel);
+        case 13: return trialXZ(backend);
+        case 14: return trialReadMip(backend, 32);
+        case 15: return trialDownSample(backend, 16, DownsampleFilter::Mean, 4096);
+        case 16: return trialDownSample(backend, 8, DownsampleFilter::Mean, 2048);
+        case 17: return trialDownSample(backend, 4, DownsampleFilter::Mean, 1024);
+        case 18: return trialDownSample(backend, mipLevel, DownsampleFilter::Nearest);
+        case 19: return trialDownSample(backend, mipLevel, DownsampleFilter::Min);
+        case 20: return trialDownSample(backend, mipLevel, DownsampleFilter::Max);
+        case 21: return trialDownSample(backend, mipLevel, DownsampleFilter::Median);
+        case 22: return trialDownSampleStrided(backend, 4);
+        case 23: return trialDownSampleStrided(backend, mipLevel);
+        case 24: return trialDownSampleStrided(backend, 16);
+        case 25: return trialDownSample(backend, 4, DownsampleFilter::Nearest);
+        case 26: return trialDownSample(backend, 16, DownsampleFilter::Nearest);
+        case 27: return trialAnimation(backend, PlaybackMode::Forward, true);
+        case 28: return trialAnimation(backend, PlaybackMode::Backward, true);
+        case 29: return trialAnimation(backend, PlaybackMode::Bounce, true);
+        case 30: return trialAnimation(backend, PlaybackMode::Forward, false);
+        case 31: return trialViewerSession(backend);
+        case 32: return trialStatistics(backend);
+        case 33: return trialFirstStatistics(backend);
+        case 34: return trialMoments(backend, MomentTraversal::Planes);
+        case 35: return trialMoments(backend, MomentTraversal::Spectra);
+        case 36: return trialRegionProfile(backend, regionLarge, RegionShape::Rectangle, false);
+        case 37: return trialRegionProfile(backend, regionLarge, RegionShape::Rectangle, true);
+        case 38: return trialRegionProfile(backend, regionLarge, RegionShape::Ellipse, false);
+        case 39: return trialRegionProfile(backend, regionLarge, RegionShape::Ellipse, true);
+        case 40: return trialRegionProfile(backend, regionLarge, RegionShape::Polygon, false);
+        case 41: return trialRegionProfile(backend, regionLarge, RegionShape::Polygon, true);
+        case 42: return trialStartup(backend, StartupMode::Sequential);
+        case 43: return trialStartup(backend, StartupMode::Overlapped);
+        case 44: return trialStartup(backend, StartupMode::Paged);
+        case 45: return trialPolarization(backend, PolarizationQuantity::Intensity, false, false);
+        case 46: return trialPolarization(backend, PolarizationQuantity::Fraction, false, false);
+        case 47: return trialPolarization(backend, PolarizationQuantity::Angle, false, false);
+        case 48: return trialPolarization(backend, PolarizationQuantity::Intensity, true, false);
+        case 49: return trialPolarization(backend, PolarizationQuantity::Fraction, true, false);
+        case 50: return trialPolarization(backend, PolarizationQuantity::Angle, true, false);
+        case 51: return trialPolarization(backend, PolarizationQuantity::Intensity, true, true);
+        case 52: return trialPolarization(backend, PolarizationQuantity::Fraction, true, true);
+        case 53: return trialPolarization(backend, PolarizationQuantity::Angle, true, true);
+        case 54: return trialViewport(backend, TileEncoding::Float32);
+        case 55: return trialViewport(backend, TileEncoding::Float16);
+        case 56: return trialViewport(backend, TileEncoding::Uint16);
+        case 57: return trialViewport(backend, TileEncoding::Uint8);
+        case 100: return trialXY(backend);
+        case 101: return trialZ(backend);
+        case 200: return trialXY(backend);
+        default: fmt::print("No such option: {}.\n", val);
+            badopt = true;
+            return {"", 0, 0};
+    }
+}
+
+ReaderTotals readerTotals() {
+    ReaderTotals totals = retiredReaders;
+    for (auto& reader : readers) {
+        totals.chunksTouched += reader.second->chunksTouched;
+        totals.setupSeconds += reader.second->setupSeconds;
+        totals.transferSeconds += reader.second->transferSeconds;
+        totals.decodeSeconds += reader.second->decodeSeconds;
+        totals.decodedBytes += reader.second->decodedBytes;
+    }
+    return totals;
+}
+
+// Runs a trial, recording the bytes it read from the file, the chunks its selections visited, its use of the tile
+// cache and its resource counters. Trials that do not split their timing are split into reader time and the rest.
+TrialResult runTrial(int val, Backend backend, bool& badopt) {
+    trialStokes = (stokesIndex >= 0) ? stokesIndex : rand() % stokes;
+    TileCacheStats tilesBefore;
+    if (tileCache) {
+        tilesBefore = tileCache->stats();
+    }
+    auto readersBefore = readerTotals();
+    long long referencesBefore = 0, missesBefore = 0;
+    bool perfValid = perfCounters && perfCounters->read(referencesBefore, missesBefore);
+    auto usageBefore = resourceUsage();
+    auto tStart = std::chrono::high_resolution_clock::now();
+
+    // A trial that cannot run (e.g. a reader that fails to open, or a selection outside the dataset) stops the run
+    TrialResult result;
+    try {
+        result = dispatchTrial(val, backend, badopt);
+    } catch (const exception& error) {
+        fmt::print("Trial {} failed: {}. Aborting.\n", val, error.what());
+        badopt = true;
+        return {"", 0, 0};
+    } catch (const Exception& error) {
+        fmt::print("Trial {} failed: {}. Aborting.\n", val, error.getDetailMsg());
+        badopt = true;
+        return {"", 0, 0};
+    }
+
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    auto usageAfter = resourceUsage();
+    long long referencesAfter = 0, missesAfter = 0;
+    perfValid = perfValid && perfCounters->read(referencesAfter, missesAfter);
+    auto readersAfter = readerTotals();
+
+    bool ioValid = usageBefore.readChars >= 0 && usageAfter.readChars >= 0;
+    result.fileBytes = ioValid ? usageAfter.readChars - usageBefore.readChars : NAN;
+    result.chunksTouched = readersAfter.chunksTouched - readersBefore.chunksTouched;
+    double setupMs = (readersAfter.setupSeconds - readersBefore.setupSeconds) * 1.0e3;
+    double transferMs = (readersAfter.transferSeconds - readersBefore.transferSeconds) * 1.0e3;
+    // Trials that read outside their timed section (e.g. the uncached pass of a viewer session) are not split
+    if (isnan(result.ioMs) && setupMs + transferMs > 0 && setupMs + transferMs <= result.ms) {
+        result.ioMs = setupMs + transferMs;
+        result.computeMs = max(0.0, result.ms - result.ioMs);
+    }
+    if (tileCache) {
+        auto tilesAfter = tileCache->stats();
+        size_t hits = tilesAfter.hits - tilesBefore.hits;
+        size_t lookups = hits + tilesAfter.misses - tilesBefore.misses;
+        if (lookups) {
+            result.metrics.push_back({"tile_hit_pct", hits * 100.0 / lookups});
+            result.metrics.push_back({"tile_evictions", double(tilesAfter.evictions - tilesBefore.evictions)});
+        }
+    }
+
+    string filterNames;
+    double compressionRatio = mainCompression(filterNames);
+    if (!filterNames.empty()) {
+        result.metrics.push_back({"compression_ratio", compressionRatio});
+    }
+    if (dimensions == 4) {
+        result.metrics.push_back({"stokes", double(trialStokes)});
+    }
+    double decodeMs = (readersAfter.decodeSeconds - readersBefore.decodeSeconds) * 1.0e3;
+    if (readersAfter.decodedBytes > readersBefore.decodedBytes) {
+        result.metrics.push_back({"decode_ms", decodeMs});
+        result.metrics.push_back({"decode_gb_per_sec", decodeMs > 0 ? (readersAfter.decodedBytes - readersBefore.decodedBytes) * 1.0e-6 / decodeMs : NAN});
+    }
+
+    double wallMs = std::chrono::duration<double, milli>(tEnd - tStart).count();
+    double cpuMs = (usageAfter.userSeconds - usageBefore.userSeconds + usageAfter.systemSeconds - usageBefore.systemSeconds) * 1.0e3;
+    result.counters = {{"setup_ms", setupMs}, {"transfer_ms", transferMs}, {"cpu_ms", cpuMs},
+                       {"system_ms", (usageAfter.systemSeconds - usageBefore.systemSeconds) * 1.0e3},
+                       {"cpu_pct", wallMs > 0 ? cpuMs / wallMs * 100.0 : NAN},
+                       {"major_faults", double(usageAfter.majorFaults - usageBefore.majorFaults)},
+                       {"minor_faults", double(usageAfter.minorFaults - usageBefore.minorFaults)},
+                       {"voluntary_switches", double(usageAfter.voluntarySwitches - usageBefore.voluntarySwitches)},
+                       {"involuntary_switches", double(usageAfter.involuntarySwitches - usageBefore.involuntarySwitches)}};
+    if (ioValid) {
+        result.counters.push_back({"read_calls", double(usageAfter.readCalls - usageBefore.readCalls)});
+        result.counters.push_back({"storage_mb", (usageAfter.storageBytes - usageBefore.storageBytes) * 1.0e-6});
+    }
+    if (perfValid) {
+        double references = referencesAfter - referencesBefore;
+        double misses = missesAfter - missesBefore;
+        result.counters.push_back({"cache_references", references});
+        result.counters.push_back({"cache_misses", misses});
+        result.counters.push_back({"cache_miss_pct", references > 0 ? misses / references * 100.0 : NAN});
+    }
+    return result;
+}
+
+void openDataSets(H5File& file) {
+    auto hduGroup = file.openGroup("0");
+    dataSets["main"] = hduGroup.openDataSet("DATA", dataSetAccess);
+
+    vector<hsize_t> dims(dataSets["main"].getSpace().getSimpleExtentNdims(), 0);
+    dataSets["main"].getSpace().getSimpleExtentDims(dims.data(), nullptr);
+    // The swizzled dataset is optional; trials that need it fail if it is missing
+    if (dims.size() > 2 && dims[dims.size() - 3] > 1 && hduGroup.nameExists("SwizzledData")) {
+        auto swizzledGroup = hduGroup.openGroup("SwizzledData");
+        string swizzledName = (dims.size() == 4) ? "ZYXW" : "ZYX";
+        if (swizzledGroup.nameExists(swizzledName)) {
+            dataSets["swizzled"] = swizzledGroup.openDataSet(swizzledName, dataSetAccess);
+        }
+    }
+
+    statisticsIndex.reset(new StatisticsIndex(file));
+
+    if (hduGroup.nameExists("MipMaps")) {
+        auto mipGroup = hduGroup.openGroup("MipMaps");
+        for (hsize_t mip = 2; mip <= min(dims[dims.size() - 1], dims[dims.size() - 2]); mip *= 2) {
+            if (mipGroup.nameExists(mipDataSetName(mip))) {
+                dataSets[fmt::format("mip{}", mip)] = mipGroup.openDataSet(mipDataSetName(mip), dataSetAccess);
+            }
+        }
+    }
+
+    if (hduGroup.nameExists("Polarization")) {
+        auto polarizationGroup = hduGroup.openGroup("Polarization");
+        bool swizzled = polarizationGroup.nameExists("Swizzled");
+        for (auto quantity : {PolarizationQuantity::Intensity, PolarizationQuantity::Fraction, PolarizationQuantity::Angle}) {
+            auto name = polarizationDataSetName(quantity);
+            if (polarizationGroup.nameExists(name)) {
+                dataSets["polarization/" + name] = polarizationGroup.openDataSet(name, dataSetAccess);
+            }
+            if (swizzled && polarizationGroup.openGroup("Swizzled").nameExists(name)) {
+                dataSets["polarization/swizzled/" + name] = polarizationGroup.openGroup("Swizzled").openDataSet(name, dataSetAccess);
+            }
+        }
+    }
+}
+
+vector<hsize_t> parseDims(const string& list) {
+    vector<hsize_t> dims;
+    for (auto val : parseTrialList(list)) {
+        dims.push_back(val);
+    }
+    return dims;
+}
+
+bool createReaders(const string& filename, Backend backend) {
+    for (auto& dataSet : dataSets) {
+        auto reader = createReader(backend, filename, dataSet.second, queueDepth);
+        if (!reader) {
+            return false;
+        }
+        readers[make_pair(backend, dataSet.first)] = move(reader);
+    }
+    // The polarization trials read I, Q and U of 4D cubes at once, so those datasets get a reader per plane
+    for (auto name : {"main", "swizzled"}) {
+        if (!dataSets.count(name) || dataSets[name].getSpace().getSimpleExtentNdims() != 4) {
+            continue;
+        }
+        for (auto k = 1; k < 3; k++) {
+            auto reader = createReader(backend, filename, dataSets[name], queueDepth);
+            if (!reader) {
+                return false;
+            }
+            readers[make_pair(backend, stokesReaderName(name, k))] = move(reader);
+        }
+    }
+    return true;
+}
+
+void reopenDataSets(H5File& file, const string& filename) {
+    vector<Backend> backends;
+    for (auto& reader : readers) {
+        backends.push_back(reader.first.first);
+    }
+    retiredReaders = readerTotals();
+    readers.clear();
+    dataSets.clear();
+    // Tiles decoded from the old handles would hide the effect of the new settings
+    if (tileCache) {
+        tileCache->clear();
+    }
+    openDataSets(file);
+    for (auto backend : backends) {
+        createReaders(filename, backend);
+    }
+}
+
+double dropFileCache(H5File& file, const string& filename) {
+    // Reopening the datasets discards their HDF5 chunk caches. The metadata cache belongs to the file and is kept.
+    // Recreating the readers also releases mapped pages, which would otherwise not be evicted.
+    reopenDataSets(file, filename);
+    if (!evictFile(filename)) {
+        fmt::print(stderr, "Could not evict {} from the page cache\n", filename);
+    }
+    return residentFraction(filename);
+}
+
+// Returns the size of a chunk of the main dataset in bytes (0 if it is contiguous), and its shape as x, y, z in layout,
+// followed by its filters if it is compressed
+size_t mainChunkShape(string& layout) {
+    layout = "contiguous";
+    auto createProperties = dataSets["main"].getCreatePlist();
+    if (createProperties.getLayout() != H5D_CHUNKED) {
+        return 0;
+    }
+    vector<hsize_t> chunkDims(dimensions);
+    createProperties.getChunk(dimensions, chunkDims.data());
+    layout = fmt::format("{}", chunkDims[dimensions - 1]);
+    size_t chunkBytes = chunkDims[dimensions - 1] * sizeof(float);
+    for (auto i = dimensions - 2; i >= 0; i--) {
+        // The stokes dimension of 4D cubes is left out of the shape
+        if (i >= dimensions - 3) {
+            layout += fmt::format("x{}", chunkDims[i]);
+        }
+        chunkBytes *= chunkDims[i];
+    }
+    string filterNames;
+    mainCompression(filterNames);
+    if (!filterNames.empty()) {
+        layout += " " + filterNames;
+    }
+    return chunkBytes;
+}
+
+// Returns the chunk cache size and hash slots of the main dataset, e.g. "1MiB/521", and its size in bytes
+string chunkCacheSetting(size_t& cacheBytes) {
+    size_t cacheSlots;
+    double cachePreemption;
+    dataSets["main"].getAccessPlist().getChunkCache(cacheSlots, cacheBytes, cachePreemption);
+    return fmt::format("{:g}MiB/{}", cacheBytes / (1024.0 * 1024.0), cacheSlots);
+}
+
+size_t nextPrime(size_t n) {
+    auto isPrime = [](size_t val) {
+        for (size_t d = 2; d * d <= val; d++) {
+            if (val % d == 0) {
+                return false;
+            }
+        }
+        return val > 1;
+    };
+    while (!isPrime(n)) {
+        n++;
+    }
+    return n;
+}
+
+// Reopens the datasets with a chunk cache of the given size (MiB) and hash slots
+void setChunkCache(H5File& file, const string& filename, int sizeMiB, int slots) {
+    string layout;
+    size_t chunkBytes = mainChunkShape(layout);
+    size_t cacheBytes = sizeMiB * size_t(1024 * 1024);
+    if (slots == 0) {
+        // HDF5 recommends a prime number of slots, about 100 times the number of chunks that fit.
+        // The cache is not used for contiguous datasets.
+        slots = chunkBytes ? nextPrime(max<size_t>(1, cacheBytes / chunkBytes) * 100) : 521;
+    }
+    dataSetAccess.setChunkCache(slots, cacheBytes, 0.75);
+    reopenDataSets(file, filename);
+}
+
+// Replays a trace in the given page cache mode, once for each mode it covers
+vector<LoadResult> replayInCacheMode(H5File& file, const string& filename, const vector<TraceEntry>& entries, Backend backend,
+                                     CacheMode cacheMode, const ReplayOptions& options) {
+    auto readerFor = [&](const string& dataSetName) { return getReader(dataSetName, backend); };
+    vector<LoadResult> results;
+    size_t cacheBytes;
+    auto record = [&](const string& cache) {
+        auto result = replayTrace(entries, readerFor, mainDims(), options, tileCache.get());
+        result.cache = cache;
+        result.chunkCache = chunkCacheSetting(cacheBytes);
+        results.push_back(result);
+    };
+
+    if (cacheMode == CacheMode::None) {
+        record("none");
+    }
+    if (cacheMode == CacheMode::Cold || cacheMode == CacheMode::Both) {
+        dropFileCache(file, filename);
+        record("cold");
+    }
+    if (cacheMode == CacheMode::Warm || cacheMode == CacheMode::Both) {
+        // Without a preceding cold pass, an unmeasured pass populates the caches
+        if (cacheMode == CacheMode::Warm) {
+            replayTrace(entries, readerFor, mainDims(), options, tileCache.get());
+        }
+        record("warm");
+    }
+    return results;
+}
+
+// Runs every iteration of each trial in the given page cache mode. Iterations draw their coordinates from a
+// generator seeded with seed, so repeated calls (e.g. for each chunk cache setting) make the same selections.
+vector<TrialSummary> runTrials(H5File& file, const string& filename, const vector<int>& trialIds, Backend backend, CacheMode cacheMode,
+                               int warmup, int iterations, unsigned int seed, bool& badopt) {
+    // Each iteration reseeds rand() from this generator, so that the cold and warm
+    // passes of an iteration make the same selection
+    mt19937 seedGenerator(seed);
+    vector<TrialSummary> summaries;
+
+    string layout;
+    size_t chunkBytes = mainChunkShape(layout);
+    size_t cacheBytes;
+    string chunkCacheName = chunkCacheSetting(cacheBytes);
+    if (cacheBytes < chunkBytes) {
+        // Chunks that do not fit bypass the cache, and only the selected part of each is read
+        chunkBytes = 0;
+    }
+    // The chunk cache holds decompressed chunks, but compressed ones are smaller in the file
+    string filterNames;
+    chunkBytes /= mainCompression(filterNames);
+
+    for (auto val : trialIds) {
+        TrialSamples samples, coldSamples, warmSamples;
+        samples.id = coldSamples.id = warmSamples.id = val;
+        samples.backend = coldSamples.backend = warmSamples.backend = getReader("main", trialBackend(val, backend))->name();
+        coldSamples.cache = "cold";
+        warmSamples.cache = "warm";
+        samples.layout = coldSamples.layout = warmSamples.layout = layout;
+        samples.chunkCache = coldSamples.chunkCache = warmSamples.chunkCache = chunkCacheName;
+        // Only the HDF5 backend goes through the chunk cache
+        bool chunkCacheUsed = trialBackend(val, backend) == Backend::Hdf5;
+        samples.chunkBytes = coldSamples.chunkBytes = warmSamples.chunkBytes = chunkCacheUsed ? chunkBytes : 0;
+
+        auto record = [](TrialSamples& target, const TrialResult& result) {
+            target.name = result.name;
+            target.ms.push_back(result.ms);
+            target.bytes.push_back(result.bytes);
+            if (!isnan(result.ioMs)) {
+                target.ioMs.push_back(result.ioMs);
+                target.computeMs.push_back(result.computeMs);
+            }
+            if (!isnan(result.fileBytes)) {
+                target.fileBytes.push_back(result.fileBytes);
+            }
+            target.chunksTouched.push_back(result.chunksTouched);
+            recordMetrics(target, result);
+        };
+
+        for (auto i = 0; i < warmup + iterations && !badopt; i++) {
+            auto iterationSeed = seedGenerator();
+            bool measured = i >= warmup;
+
+            if (cacheMode == CacheMode::None) {
+                srand(iterationSeed);
+                auto result = runTrial(val, backend, badopt);
+                if (measured) {
+                    record(samples, result);
+                }
+                continue;
+            }
+
+            if (cacheMode == CacheMode::Cold || cacheMode == CacheMode::Both) {
+                double resident = dropFileCache(file, filename);
+                srand(iterationSeed);
+                coldPass = true;
+                auto result = runTrial(val, backend, badopt);
+                coldPass = false;
+                if (measured && !badopt) {
+                    record(coldSamples, result);
+                    coldSamples.residentAfterEviction.push_back(resident);
+                }
+            }
+
+            if ((cacheMode == CacheMode::Warm || cacheMode == CacheMode::Both) && !badopt) {
+                // Without a preceding cold pass, an unmeasured pass over the same selection populates the cache
+                if (cacheMode == CacheMode::Warm) {
+                    srand(iterationSeed);
+                    runTrial(val, backend, badopt);
+                }
+                srand(iterationSeed);
+                auto result = runTrial(val, backend, badopt);
+                if (measured && !badopt) {
+                    record(warmSamples, result);
+                }
+            }
+        }
+        if (badopt) {
+            break;
+        }
+        if (cacheMode == CacheMode::None) {
+            summaries.push_back(summarise(samples));
+        }
+        if (cacheMode == CacheMode::Cold || cacheMode == CacheMode::Both) {
+            summaries.push_back(summarise(coldSamples));
+        }
+        if (cacheMode == CacheMode::Warm || cacheMode == CacheMode::Both) {
+            summaries.push_back(summarise(warmSamples));
+        }
+    }
+
+    return summaries;
+}
+
+void printUsage(const char* program) {
+    fmt::print("Usage: {} <filename> <option>\n", program);
+    fmt::print("       {} <filename> --trials <ids> [runner options]\n", program);
+    fmt::print("       {} <filename> --swizzle [--swizzle-chunks x,y,z] [--memory MB]\n", program);
+    fmt::print("       {} <filename> --build-mips [--max-mip N]\n", program);
+    fmt::print("       {} <filename> --build-stats [--stats-bins N]\n", program);
+    fmt::print("       {} <filename> --build-polarization [--memory MB]\n", program);
+    fmt::print("       {} <filename> --generate --dims w,h,d[,s] [generator options]\n", program);
+    fmt::print("       {} <filename> --load <mix> [load options]\n", program);
+    fmt::print("       {} <filename> --record-trace <trace> [--load mix] [--requests N] [--rate R] [--seed S]\n", program);
+    fmt::print("       {} <filename> --replay <trace> [replay options]\n", program);
+    fmt::print("Runner options:\n");
+    fmt::print("  --warmup N                  unmeasured iterations per trial (default 1)\n");
+    fmt::print("  --iterations N              measured iterations per trial (default 10)\n");
+    fmt::print("  --seed S                    random seed for trial coordinates (default: current time)\n");
+    fmt::print("  --format json|csv|text      summary output format (default json)\n");
+    fmt::print("  --backend hdf5|mmap|pread|direct|uring|pool|decode\n");
+    fmt::print("                              I/O backend used by the trials (default hdf5)\n");
+    fmt::print("  --queue-depth N             reads in flight for the uring and pool backends (default 32)\n");
+    fmt::print("  --frames N                  frames per animation run (default 64)\n");
+    fmt::print("  --fps F                     target animation frame rate, 0 for unthrottled (default 30)\n");
+    fmt::print("  --prefetch N                frames read ahead during animation (default 4)\n");
+    fmt::print("  --io-threads N              animation read-ahead threads (default 2)\n");
+    fmt::print("  --chunk-cache MB,...        rerun the trials with each HDF5 chunk cache size, e.g. 1,4,16,64\n");
+    fmt::print("  --chunk-cache-slots N,...   chunk cache hash slots to combine with each size (default: ~100 per chunk)\n");
+    fmt::print("  --simd scalar|avx2|avx512   down-sampling and statistics kernels (default: best supported by the CPU)\n");
+    fmt::print("  --perf                      record hardware cache references and misses of the main thread\n");
+    fmt::print("  --tile-cache MB             read XY, region and mean down-sampling trials through a tile cache\n");
+    fmt::print("                              of this size, which also sets the viewer session's (default 256)\n");
+    fmt::print("  --tile-size N               tile edge in pixels (default 256)\n");
+    fmt::print("  --session-views N           views per viewer session (default 100)\n");
+    fmt::print("  --viewport-mip N            zoom level of the viewport tile trials (default 0: random power of two)\n");
+    fmt::print("  --moment-threads N,...      thread counts to time the moment map trials with (default 1, 2, 4, ... all)\n");
+    fmt::print("  --stokes N|random           stokes plane the trials of 4D cubes read, or a random one per iteration (default 0)\n");
+    fmt::print("  --profile-block N           channels per block of the region profile trials, streamed (default 0: all)\n");
+    fmt::print("  --view-width N              largest width and height of the startup trials' first image (default 1024)\n");
+    fmt::print("  --page-buffer MB            HDF5 page buffer of the paged startup trial (default 16)\n");
+    fmt::print("  --precomputed-stats         fetch XY-Image statistics from 0/Statistics instead of computing them\n");
+    fmt::print("  --cache none|cold|warm|both evict the file from the page cache before each iteration (cold),\n");
+    fmt::print("                              re-read a cached selection (warm), or run both back to back\n");
+    fmt::print("Swizzle options:\n");
+    fmt::print("  --swizzle-chunks x,y,z      chunk shape of the swizzled dataset (default contiguous)\n");
+    fmt::print("  --memory MB                 memory budget for slab buffers, moment maps and polarization (default 1024)\n");
+    fmt::print("Mipmap options:\n");
+    fmt::print("  --max-mip N                 largest down-sampling factor to build (default 32)\n");
+    fmt::print("Statistics options:\n");
+    fmt::print("  --stats-bins N              histogram bins (default: square root of the pixels in a channel)\n");
+    fmt::print("Generator options (--seed, --memory and --swizzle-chunks also apply):\n");
+    fmt::print("  --chunks x,y,z              chunk shape of 0/DATA (default contiguous)\n");
+    fmt::print("  --pattern noise|gradient|waves|constant\n");
+    fmt::print("                              pixel values (default noise)\n");
+    fmt::print("  --nan-box x,y,w,h           blank a rectangle in every channel (repeatable)\n");
+    fmt::print("  --nan-channels ids          blank whole channels, e.g. 0,10-19\n");
+    fmt::print("  --nan-fraction F            blank a random fraction of the remaining pixels\n");
+    fmt::print("  --no-swizzle                do not write 0/SwizzledData\n");
+    fmt::print("  --header-cards N            header attributes written on 0 (default 100)\n");
+    fmt::print("  --page-size BYTES           file space page size for paged aggregation (default 0: not paged)\n");
+    fmt::print("  --compression SPEC          filters of the chunked datasets, e.g. shuffle+deflate:4, lz4, zstd:3 or\n");
+    fmt::print("                              filter:<id>[,values] for any other plugin (default none)\n");
+    fmt::print("Load options (--backend, --queue-depth, --seed and --format also apply):\n");
+    fmt::print("  --load mix                  weighted request mix, e.g. xy:2,yz,z:4,region,downsample\n");
+    fmt::print("  --clients N,...             concurrent clients to run the mix with (default 1,2,4,8)\n");
+    fmt::print("  --rate R                    total open-loop arrival rate in requests/s (default 0: closed-loop)\n");
+    fmt::print("  --duration S                seconds of arrivals per number of clients (default 10)\n");
+    fmt::print("Trace options (--load, --rate and --seed also apply to recording):\n");
+    fmt::print("  --requests N                requests in a recorded trace (default 1000)\n");
+    fmt::print("Replay options (--backend, --queue-depth, --cache, --chunk-cache, --tile-cache and --format also apply):\n");
+    fmt::print("  --pacing fast|original      issue requests back to back, or at their recorded times (default fast)\n");
+    fmt::print("  --speed X                   divide recorded times by X when pacing (default 1)\n");
 }
 
 int main(int argc, char* argv[]) {
 
-    if (argc != 3) {
+    if (argc < 3) {
         fmt::print("Two parameters required: filename and option. Aborting.\n");
+        printUsage(argv[0]);
         return 1;
     }
 
-    int mipLevel = 8;
-    
     string filename(argv[1]);
+    vector<int> trialIds;
+    bool runnerMode = argv[2][0] == '-';
+    int warmup = 1;
+    int iterations = 10;
+    unsigned int seed = time(nullptr);
+    OutputFormat format = OutputFormat::Json;
+    CacheMode cacheMode = CacheMode::None;
+    Backend backend = Backend::Hdf5;
+    bool swizzleMode = false;
+    SwizzleOptions swizzleOptions;
+    bool mipmapMode = false;
+    MipmapOptions mipmapOptions;
+    bool statisticsMode = false;
+    StatisticsOptions statisticsOptions;
+    bool polarizationMode = false;
+    bool generateMode = false;
+    GenerateOptions generateOptions;
+    bool startupProbe = false;
+    // Chunk cache sizes (MiB) and hash slot counts to sweep; 0 slots picks a count to suit the size
+    vector<int> chunkCacheSizes;
+    vector<int> chunkCacheSlots = {0};
+    bool useTileCache = false;
+    bool loadMode = false;
+    LoadOptions loadOptions;
+    string recordTraceFile, replayFile;
+    size_t traceRequests = 1000;
+    ReplayOptions replayOptions;
+
+    if (runnerMode) {
+        // Options without a short form, as every letter is taken
+        enum {
+            StokesOption = 256,
+            BuildPolarizationOption,
+            ViewportMipOption
+        };
+        static struct option longOptions[] = {
+            {"trials", required_argument, nullptr, 't'},
+            {"warmup", required_argument, nullptr, 'w'},
+            {"iterations", required_argument, nullptr, 'n'},
+            {"seed", required_argument, nullptr, 's'},
+            {"format", required_argument, nullptr, 'f'},
+            {"cache", required_argument, nullptr, 'c'},
+            {"backend", required_argument, nullptr, 'b'},
+            {"queue-depth", required_argument, nullptr, 'q'},
+            {"swizzle", no_argument, nullptr, 'S'},
+            {"swizzle-chunks", required_argument, nullptr, 'C'},
+            {"memory", required_argument, nullptr, 'M'},
+            {"build-mips", no_argument, nullptr, 'B'},
+            {"max-mip", required_argument, nullptr, 'X'},
+            {"build-stats", no_argument, nullptr, 'A'},
+            {"stats-bins", required_argument, nullptr, 'h'},
+            {"precomputed-stats", no_argument, nullptr, 'U'},
+            {"moment-threads", required_argument, nullptr, 'm'},
+            {"profile-block", required_argument, nullptr, 'j'},
+            {"stokes", required_argument, nullptr, StokesOption},
+            {"build-polarization", no_argument, nullptr, BuildPolarizationOption},
+            {"viewport-mip", required_argument, nullptr, ViewportMipOption},
+            {"view-width", required_argument, nullptr, 'Y'},
+            {"page-buffer", required_argument, nullptr, 'Q'},
+            // Measures the startup of the file in this process and prints the times, for the startup trials
+            {"startup-probe", required_argument, nullptr, 'O'},
+            {"simd", required_argument, nullptr, 'V'},
+            {"frames", required_argument, nullptr, 'a'},
+            {"fps", required_argument, nullptr, 'r'},
+            {"prefetch", required_argument, nullptr, 'p'},
+            {"io-threads", required_argument, nullptr, 'i'},
+            {"chunk-cache", required_argument, nullptr, 'H'},
+            {"chunk-cache-slots", required_argument, nullptr, 'L'},
+            {"generate", no_argument, nullptr, 'G'},
+            {"dims", required_argument, nullptr, 'D'},
+            {"chunks", required_argument, nullptr, 'K'},
+            {"pattern", required_argument, nullptr, 'P'},
+            {"nan-box", required_argument, nullptr, 'N'},
+            {"nan-channels", required_argument, nullptr, 'Z'},
+            {"nan-fraction", required_argument, nullptr, 'F'},
+            {"no-swizzle", no_argument, nullptr, 'W'},
+            {"header-cards", required_argument, nullptr, 'I'},
+            {"page-size", required_argument, nullptr, 'J'},
+            {"compression", required_argument, nullptr, 'z'},
+            {"perf", no_argument, nullptr, 'E'},
+            {"tile-cache", required_argument, nullptr, 'T'},
+            {"tile-size", required_argument, nullptr, 'e'},
+            {"session-views", required_argument, nullptr, 'v'},
+            {"record-trace", required_argument, nullptr, 'o'},
+            {"requests", required_argument, nullptr, 'k'},
+            {"replay", required_argument, nullptr, 'y'},
+            {"pacing", required_argument, nullptr, 'g'},
+            {"speed", required_argument, nullptr, 'x'},
+            {"load", required_argument, nullptr, 'l'},
+            {"clients", required_argument, nullptr, 'u'},
+            {"rate", required_argument, nullptr, 'R'},
+            {"duration", required_argument, nullptr, 'd'},
+            {nullptr, 0, nullptr, 0}
+        };
+        // Skip the filename, so that getopt sees it as the program name
+        int opt;
+        while ((opt = getopt_long(argc - 1, argv + 1, "t:w:n:s:f:c:b:q:SC:M:BX:Ah:Um:j:Y:Q:O:V:a:r:p:i:H:L:GD:K:P:N:Z:F:WI:J:z:l:u:R:d:T:e:v:o:k:y:g:x:E", longOptions, nullptr)) != -1) {
+            switch (opt) {
+                case 't': trialIds = parseTrialList(optarg);
+                    break;
+                case 'w': warmup = max(0, atoi(optarg));
+                    break;
+                case 'n': iterations = max(1, atoi(optarg));
+                    break;
+                case 's': seed = strtoul(optarg, nullptr, 10);
+                    break;
+                case 'f':
+                    if (!parseOutputFormat(optarg, format)) {
+                        fmt::print("Unknown output format: {}. Aborting.\n", optarg);
+                        return 1;
+                    }
+                    break;
+                case 'c':
+                    if (!parseCacheMode(optarg, cacheMode)) {
+                        fmt::print("Unknown cache mode: {}. Aborting.\n", optarg);
+                        return 1;
+                    }
+                    break;
+                case 'b':
+                    if (!parseBackend(optarg, backend)) {
+                        fmt::print("Unknown backend: {}. Aborting.\n", optarg);
+                        return 1;
+                    }
+                    break;
+                case 'q': queueDepth = max(1, atoi(optarg));
+                    break;
+                case 'S': swizzleMode = true;
+                    break;
+                case 'C': swizzleOptions.chunkDims = parseDims(optarg);
+                    break;
+                case 'M': swizzleOptions.memoryBudget = max(1, atoi(optarg)) * size_t(1024 * 1024);
+                    break;
+                case 'B': mipmapMode = true;
+                    break;
+                case 'X': mipmapOptions.maxMip = max(2, atoi(optarg));
+                    break;
+                case 'A': statisticsMode = true;
+                    break;
+                case 'h': statisticsOptions.bins = max(0, atoi(optarg));
+                    break;
+                case 'U': usePrecomputedStats = true;
+                    break;
+                case 'm': momentThreads = parseTrialList(optarg);
+                    break;
+                case 'j': profileBlock = max(0, atoi(optarg));
+                    break;
+                case BuildPolarizationOption: polarizationMode = true;
+                    break;
+                case ViewportMipOption: viewportMip = max(0, atoi(optarg));
+                    break;
+                case StokesOption: stokesIndex = (string(optarg) == "random") ? -1 : max(0, atoi(optarg));
+                    break;
+                case 'Y': startupOptions.viewWidth = max(1, atoi(optarg));
+                    break;
+                case 'Q': startupOptions.pageBufferBytes = max(1, atoi(optarg)) * size_t(1024 * 1024);
+                    break;
+                case 'O':
+                    if (!parseStartupMode(optarg, startupOptions.mode)) {
+                        fmt::print("Unknown startup mode: {}. Aborting.\n", optarg);
+                        return 1;
+                    }
+                    startupProbe = true;
+                    break;
+                case 'a': animationOptions.frames = max(1, atoi(optarg));
+                    break;
+                case 'r': animationOptions.fps = max(0.0, atof(optarg));
+                    break;
+                case 'p': animationOptions.prefetch = max(0, atoi(optarg));
+                    break;
+                case 'i': animationOptions.ioThreads = max(1, atoi(optarg));
+                    break;
+                case 'H': chunkCacheSizes = parseTrialList(optarg);
+                    break;
+                case 'L': chunkCacheSlots = parseTrialList(optarg);
+                    break;
+                case 'G': generateMode = true;
+                    break;
+                case 'D': generateOptions.dims = parseDims(optarg);
+                    break;
+                case 'K': generateOptions.chunkDims = parseDims(optarg);
+                    break;
+                case 'P':
+                    if (!parseFillPattern(optarg, generateOptions.pattern)) {
+                        fmt::print("Unknown fill pattern: {}. Aborting.\n", optarg);
+                        return 1;
+                    }
+                    break;
+                case 'N': {
+                    auto box = parseDims(optarg);
+                    if (box.size() != 4) {
+                        fmt::print("NaN boxes must be given as x,y,width,height. Aborting.\n");
+                        return 1;
+                    }
+                    generateOptions.nanBoxes.push_back({box[0], box[1], box[2], box[3]});
+                    break;
+                }
+                case 'Z': generateOptions.nanChannels = parseTrialList(optarg);
+                    break;
+                case 'F': generateOptions.nanFraction = atof(optarg);
+                    break;
+                case 'W': generateOptions.swizzled = false;
+                    break;
+                case 'I': generateOptions.headerCards = max(0, atoi(optarg));
+                    break;
+                case 'J': generateOptions.pageSize = strtoull(optarg, nullptr, 10);
+                    break;
+                case 'z':
+                    if (!parseCompression(optarg, generateOptions.compression)) {
+                        fmt::print("Unknown compression: {}. Aborting.\n", optarg);
+                        return 1;
+                    }
+                    break;
+                case 'E':
+                    perfCounters.reset(new PerfCounters());
+                    if (!perfCounters->valid()) {
+                        fmt::print(stderr, "Hardware cache counters are unavailable (perf_event_open: {})\n", strerror(errno));
+                        perfCounters.reset();
+                    }
+                    break;
+                case 'T':
+                    tileCacheBytes = max(1, atoi(optarg)) * size_t(1024 * 1024);
+                    useTileCache = true;
+                    break;
+                case 'e': tileSize = max(16, atoi(optarg));
+                    break;
+                case 'v': sessionViews = max(1, atoi(optarg));
+                    break;
+                case 'o': recordTraceFile = optarg;
+                    break;
+                case 'k': traceRequests = max(1, atoi(optarg));
+                    break;
+                case 'y': replayFile = optarg;
+                    break;
+                case 'g':
+                    if (string(optarg) != "fast" && string(optarg) != "original") {
+                        fmt::print("Unknown pacing: {}. Aborting.\n", optarg);
+                        return 1;
+                    }
+                    replayOptions.paced = string(optarg) == "original";
+                    break;
+                case 'x': replayOptions.speed = atof(optarg) > 0 ? atof(optarg) : 1.0;
+                    break;
+                case 'l':
+                    if (!parseLoadMix(optarg, loadOptions.mix)) {
+                        fmt::print("Invalid request mix: {}. Aborting.\n", optarg);
+                        return 1;
+                    }
+                    loadMode = true;
+                    break;
+                case 'u': loadOptions.clients = parseTrialList(optarg);
+                    break;
+                case 'R': loadOptions.rate = max(0.0, atof(optarg));
+                    break;
+                case 'd': loadOptions.seconds = max(0.1, atof(optarg));
+                    break;
+                case 'V': {
+                    SimdLevel level;
+                    if (!parseSimdLevel(optarg, level)) {
+                        fmt::print("Unknown SIMD level: {}. Aborting.\n", optarg);
+                        return 1;
+                    }
+                    setSimdLevel(level);
+                    if (getSimdLevel() != level) {
+                        fmt::print(stderr, "{} is not supported by this CPU; using {}\n", simdLevelName(level), simdLevelName(getSimdLevel()));
+                    }
+                    break;
+                }
+                default: printUsage(argv[0]);
+                    return 1;
+            }
+        }
+        momentMemory = swizzleOptions.memoryBudget;
+        if (useTileCache) {
+            tileCache.reset(new TileCache(tileCacheBytes, tileSize));
+        }
+        if (generateMode) {
+            generateOptions.seed = seed;
+            generateOptions.swizzledChunkDims = swizzleOptions.chunkDims;
+            generateOptions.memoryBudget = swizzleOptions.memoryBudget;
+            return generateCube(filename, generateOptions) ? 0 : 1;
+        }
+        if (startupProbe) {
+            startupOptions.backend = backend;
+            StartupTimes times;
+            if (!measureStartup(filename, startupOptions, times)) {
+                return 1;
+            }
+            fmt::print("{}\n", formatStartupTimes(times));
+            return 0;
+        }
+        if (swizzleMode) {
+            auto file = H5File(filename, H5F_ACC_RDWR);
+            bool success = swizzle(file, swizzleOptions);
+            file.close();
+            return success ? 0 : 1;
+        }
+        if (mipmapMode) {
+            auto file = H5File(filename, H5F_ACC_RDWR);
+            bool success = buildMipmaps(file, mipmapOptions);
+            file.close();
+            return success ? 0 : 1;
+        }
+        if (statisticsMode) {
+            auto file = H5File(filename, H5F_ACC_RDWR);
+            bool success = buildStatistics(file, statisticsOptions);
+            file.close();
+            return success ? 0 : 1;
+        }
+        if (polarizationMode) {
+            auto file = H5File(filename, H5F_ACC_RDWR);
+            PolarizationOptions polarizationOptions;
+            polarizationOptions.memoryBudget = swizzleOptions.memoryBudget;
+            bool success = buildPolarization(file, polarizationOptions);
+            file.close();
+            return success ? 0 : 1;
+        }
+        if (trialIds.empty() && !loadMode && recordTraceFile.empty() && replayFile.empty()) {
+            fmt::print("No trials specified. Aborting.\n");
+            printUsage(argv[0]);
+            return 1;
+        }
+        quiet = true;
+    } else {
+        if (argc != 3) {
+            fmt::print("Two parameters required: filename and option. Aborting.\n");
+            return 1;
+        }
+        trialIds = {atoi(argv[2])};
+        warmup = 0;
+        iterations = 1;
+    }
 
+    dataFilename = filename;
     auto file = H5File(filename, H5F_ACC_RDONLY);
-    auto hduGroup = file.openGroup("0");
-    dataSets["main"] = hduGroup.openDataSet("DATA");
+    dataFile = &file;
+    openDataSets(file);
     auto& dataSet = dataSets["main"];
 
     vector<hsize_t> dims(dataSet.getSpace().getSimpleExtentNdims(), 0);
@@ -494,89 +1955,122 @@ int main(int argc, char* argv[]) {
     height = dims[dimensions - 2];
     depth = (dimensions > 2) ? dims[dimensions - 3] : 1;
     stokes = (dimensions > 3) ? dims[dimensions - 4] : 1;
-    auto offset = dataSets["main"].getOffset();
-    if (depth > 1) {
-        if (dimensions == 3) {
-            dataSets["swizzled"] = hduGroup.openDataSet("SwizzledData/ZYX");
-        } else if (dimensions == 4) {
-            dataSets["swizzled"] = hduGroup.openDataSet("SwizzledData/ZYXW");
+    if (stokesIndex >= stokes) {
+        fmt::print("Stokes {} is out of range: the cube has {} stokes. Aborting.\n", stokesIndex, stokes);
+        return 1;
+    }
+
+    if (!recordTraceFile.empty()) {
+        loadOptions.seed = seed;
+        auto entries = generateTrace(dims, loadOptions, traceRequests);
+        file.close();
+        if (!writeTrace(recordTraceFile, entries)) {
+            return 1;
         }
+        fmt::print("Wrote {} requests (seed {}) to {}\n", entries.size(), seed, recordTraceFile);
+        return 0;
     }
 
-    int regionSmall(ceil(sqrt(0.0001) * min(width, height)));
-    int regionMedium(ceil(sqrt(0.001) * min(width, height)));
-    int regionLarge(ceil(sqrt(0.01) * min(width, height)));
+    if (loadMode) {
+        // Every client gets a handle of its own: a separately opened dataset, or a raw reader with its own descriptor
+        auto openReader = [&]() -> unique_ptr<DataReader> {
+            if (backend == Backend::Hdf5) {
+                return unique_ptr<DataReader>(new Hdf5Reader(file.openGroup("0").openDataSet("DATA", dataSetAccess)));
+            }
+            return createReader(backend, filename, dataSet, queueDepth);
+        };
+        loadOptions.seed = seed;
+        auto loadResults = runLoad(openReader, dims, loadOptions);
+        size_t cacheBytes;
+        for (auto& result : loadResults) {
+            result.chunkCache = chunkCacheSetting(cacheBytes);
+        }
+        printLoadResults(loadResults, format, backendName(backend), loadOptions);
+        file.close();
+        return loadResults.size() == loadOptions.clients.size() ? 0 : 1;
+    }
 
-    srand(time(nullptr));
+    if (!replayFile.empty()) {
+        vector<TraceEntry> entries;
+        if (!readTrace(replayFile, entries) || !createReaders(filename, backend)) {
+            return 1;
+        }
+        for (auto i = 0; i < entries.size(); i++) {
+            auto& request = entries[i].request;
+            if (!requestFits(request, dims) || !dataSets.count(request.dataSet) || (request.dataSet != "main" && request.dataSet != "swizzled")) {
+                fmt::print("Request {} of {} does not fit the datasets of {}. Aborting.\n", i + 1, replayFile, filename);
+                return 1;
+            }
+        }
+        vector<LoadResult> replayResults;
+        if (chunkCacheSizes.empty()) {
+            replayResults = replayInCacheMode(file, filename, entries, backend, cacheMode, replayOptions);
+        } else {
+            for (auto size : chunkCacheSizes) {
+                for (auto slots : chunkCacheSlots) {
+                    setChunkCache(file, filename, size, slots);
+                    auto configResults = replayInCacheMode(file, filename, entries, backend, cacheMode, replayOptions);
+                    replayResults.insert(replayResults.end(), configResults.begin(), configResults.end());
+                }
+            }
+        }
+        LoadOptions replaySettings;
+        replaySettings.seed = seed;
+        replaySettings.rate = replayResults.empty() || isnan(replayResults[0].offeredRate) ? 0 : replayResults[0].offeredRate;
+        replaySettings.seconds = entries.empty() ? 0 : entries.back().timeMs * 1.0e-3 / replayOptions.speed;
+        printLoadResults(replayResults, format, getReader("main", backend)->name(), replaySettings);
+        readers.clear();
+        file.close();
+        return 0;
+    }
 
-    int val = atoi(argv[2]);
-    
-    // Memory map or open file for trials that require it
-    if (val >= 200) {
-        fileStream = openFile(filename);
-        fileStream.seekg(offset);
+    // Open readers for every backend the selected trials use
+    for (auto val : trialIds) {
+        auto trialReaderBackend = trialBackend(val, backend);
+        if (!readers.count(make_pair(trialReaderBackend, string("main"))) && !createReaders(filename, trialReaderBackend)) {
+            return 1;
+        }
     }
-    else if (val >= 100) {
-        filePtr = mapFile(filename);
+
+    // Trials that need something the file lacks are refused before any is run, so that no measured result is lost
+    for (auto val : trialIds) {
+        if (val == 33 && !(statisticsIndex && statisticsIndex->valid())) {
+            fmt::print("Trial {} needs precomputed statistics; run --build-stats first. Aborting.\n", val);
+            return 1;
+        }
+        if (val >= 45 && val <= 53 && (dimensions != 4 || stokes < 3)) {
+            fmt::print("Trial {} needs a 4D cube with I, Q and U. Aborting.\n", val);
+            return 1;
+        }
     }
-    
+
     bool badopt(false);
+    vector<TrialSummary> summaries;
 
-    switch (val) {
-        case 0: trialXY();
-            break;
-        case 1: trialYZ();
-            break;
-        case 2: trialYZSwizzled();
-            break;
-        case 3: trialZ();
-            break;
-        case 4: trialZSwizzled();
-            break;
-        case 5: trialRegion(regionSmall);
-            break;
-        case 6: trialRegionSwizzled(regionSmall);
-            break;
-        case 7: trialRegion(regionMedium);
-            break;
-        case 8: trialRegionSwizzled(regionMedium);
-            break;
-        case 9: trialRegion(regionLarge);
-            break;
-        case 10: trialRegionSwizzled(regionLarge);
-            break;
-        case 11: trialDownSample(mipLevel, true);
-            break;
-        case 12: trialReadMip(mipLevel);
-            break;
-        case 13: trialXZ();
-            break;
-        case 14: trialReadMip(32);
-            break;
-        case 15: trialDownSample(16, true, 4096);
-            break;
-        case 16: trialDownSample(8, true, 2048);
-            break;
-        case 17: trialDownSample(4, true, 1024);
-            break;
-        case 100: trialXYMmap();
-            break;
-        case 101: trialZMmap();
-            break;
-        case 200: trialXYRaw();
-            break;
-        default: fmt::print("No such option: {}.\n", val);
-            badopt = true;
-            break;
+    if (chunkCacheSizes.empty()) {
+        summaries = runTrials(file, filename, trialIds, backend, cacheMode, warmup, iterations, seed, badopt);
+    } else {
+        // Reopen the datasets with each chunk cache setting in turn
+        for (auto i = 0; i < chunkCacheSizes.size() && !badopt; i++) {
+            for (auto slots : chunkCacheSlots) {
+                setChunkCache(file, filename, chunkCacheSizes[i], slots);
+                auto configSummaries = runTrials(file, filename, trialIds, backend, cacheMode, warmup, iterations, seed, badopt);
+                summaries.insert(summaries.end(), configSummaries.begin(), configSummaries.end());
+                if (badopt) {
+                    break;
+                }
+            }
+        }
     }
 
-    if (val >= 200) {
-        fileStream.close();
-    }
-    else if (val >= 100) {
-        unmapFile(filename, filePtr);
+    if (runnerMode && !badopt) {
+        printSummaries(summaries, format, seed, warmup);
+        if (format == OutputFormat::Text && !chunkCacheSizes.empty()) {
+            printSweepMatrix(summaries);
+        }
     }
 
+    readers.clear();
     file.close();
     return badopt;
 }
@@ -0,0 +1,172 @@
+#include "mipmap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <fmt/format.h>
+
+#include "resources.h"
+
+using namespace std;
+using namespace H5;
+
+string mipDataSetName(int mip) {
+    return fmt::format("DATA_XY_{}", mip);
+}
+
+bool buildMipmaps(H5File& file, const MipmapOptions& options) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    auto hduGroup = file.openGroup("0");
+    auto source = hduGroup.openDataSet("DATA");
+
+    vector<hsize_t> dims(source.getSpace().getSimpleExtentNdims(), 0);
+    source.getSpace().getSimpleExtentDims(dims.data(), nullptr);
+    int rank = dims.size();
+    hsize_t width = dims[rank - 1];
+    hsize_t height = dims[rank - 2];
+    hsize_t depth = (rank > 2) ? dims[rank - 3] : 1;
+    hsize_t stokes = (rank > 3) ? dims[rank - 4] : 1;
+
+    vector<int> mips;
+    for (int mip = 2; mip <= options.maxMip && width / mip > 0 && height / mip > 0; mip *= 2) {
+        mips.push_back(mip);
+    }
+    if (mips.empty()) {
+        fmt::print("Image is too small for mipmaps. Aborting.\n");
+        return false;
+    }
+    int bandRows = mips.back();
+
+    if (!hduGroup.nameExists("MipMaps")) {
+        hduGroup.createGroup("MipMaps");
+    }
+    auto mipGroup = hduGroup.openGroup("MipMaps");
+    vector<DataSet> targets;
+    for (auto mip : mips) {
+        auto name = mipDataSetName(mip);
+        if (mipGroup.nameExists(name)) {
+            mipGroup.unlink(name);
+        }
+        vector<hsize_t> mipDims(dims);
+        mipDims[rank - 1] = width / mip;
+        mipDims[rank - 2] = height / mip;
+        targets.push_back(mipGroup.createDataSet(name, PredType::NATIVE_FLOAT, DataSpace(rank, mipDims.data())));
+    }
+
+    // Per-level sums and counts of non-NaN pixels for the current band, and the resulting means
+    vector<vector<double>> sums(mips.size());
+    vector<vector<int>> counts(mips.size());
+    vector<vector<float>> means(mips.size());
+    for (auto l = 0; l < mips.size(); l++) {
+        size_t levelSize = (bandRows / mips[l]) * (width / mips[l]);
+        sums[l].resize(levelSize);
+        counts[l].resize(levelSize);
+        means[l].resize(levelSize);
+    }
+    vector<float> band(bandRows * width);
+    double readSeconds = 0, reduceSeconds = 0, writeSeconds = 0;
+
+    for (hsize_t s = 0; s < stokes; s++) {
+        for (hsize_t z = 0; z < depth; z++) {
+            for (hsize_t y = 0; y < height; y += bandRows) {
+                hsize_t numRows = min<hsize_t>(bandRows, height - y);
+
+                auto t0 = std::chrono::high_resolution_clock::now();
+                vector<hsize_t> count = {numRows, width};
+                vector<hsize_t> start = {y, 0};
+                if (rank > 2) {
+                    count.insert(count.begin(), 1);
+                    start.insert(start.begin(), z);
+                }
+                if (rank > 3) {
+                    count.insert(count.begin(), 1);
+                    start.insert(start.begin(), s);
+                }
+                DataSpace memspace(count.size(), count.data());
+                auto sourceSpace = source.getSpace();
+                sourceSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+                source.read(band.data(), PredType::NATIVE_FLOAT, memspace, sourceSpace);
+
+                auto t1 = std::chrono::high_resolution_clock::now();
+                for (auto l = 0; l < mips.size(); l++) {
+                    long long levelRows = numRows / mips[l];
+                    long long levelColumns = width / mips[l];
+                    auto& levelSums = sums[l];
+                    auto& levelCounts = counts[l];
+                    if (l == 0) {
+                        // Level 2 is reduced from the full-resolution band
+#pragma omp parallel for schedule(static)
+                        for (long long j = 0; j < levelRows; j++) {
+                            const float* row0 = band.data() + (2 * j) * width;
+                            const float* row1 = row0 + width;
+                            for (long long i = 0; i < levelColumns; i++) {
+                                double sum = 0;
+                                int pixelCount = 0;
+                                for (auto val : {row0[2 * i], row0[2 * i + 1], row1[2 * i], row1[2 * i + 1]}) {
+                                    if (!isnan(val)) {
+                                        sum += val;
+                                        pixelCount++;
+                                    }
+                                }
+                                levelSums[j * levelColumns + i] = sum;
+                                levelCounts[j * levelColumns + i] = pixelCount;
+                            }
+                        }
+                    } else {
+                        // Higher levels combine 2x2 blocks of the level below
+                        auto& lowerSums = sums[l - 1];
+                        auto& lowerCounts = counts[l - 1];
+                        long long lowerColumns = width / mips[l - 1];
+#pragma omp parallel for schedule(static)
+                        for (long long j = 0; j < levelRows; j++) {
+                            for (long long i = 0; i < levelColumns; i++) {
+                                size_t i0 = (2 * j) * lowerColumns + 2 * i;
+                                size_t i1 = i0 + lowerColumns;
+                                levelSums[j * levelColumns + i] = lowerSums[i0] + lowerSums[i0 + 1] + lowerSums[i1] + lowerSums[i1 + 1];
+                                levelCounts[j * levelColumns + i] = lowerCounts[i0] + lowerCounts[i0 + 1] + lowerCounts[i1] + lowerCounts[i1 + 1];
+                            }
+                        }
+                    }
+                    auto& levelMeans = means[l];
+                    for (long long k = 0; k < levelRows * levelColumns; k++) {
+                        levelMeans[k] = levelCounts[k] ? levelSums[k] / levelCounts[k] : NAN;
+                    }
+                }
+
+                auto t2 = std::chrono::high_resolution_clock::now();
+                for (auto l = 0; l < mips.size(); l++) {
+                    hsize_t levelRows = numRows / mips[l];
+                    if (levelRows == 0) {
+                        continue;
+                    }
+                    vector<hsize_t> levelCount(count), levelStart(start);
+                    levelCount[rank - 1] = width / mips[l];
+                    levelCount[rank - 2] = levelRows;
+                    levelStart[rank - 2] = y / mips[l];
+                    DataSpace levelMemspace(levelCount.size(), levelCount.data());
+                    auto targetSpace = targets[l].getSpace();
+                    targetSpace.selectHyperslab(H5S_SELECT_SET, levelCount.data(), levelStart.data());
+                    targets[l].write(means[l].data(), PredType::NATIVE_FLOAT, levelMemspace, targetSpace);
+                }
+                auto t3 = std::chrono::high_resolution_clock::now();
+
+                readSeconds += std::chrono::duration<double>(t1 - t0).count();
+                reduceSeconds += std::chrono::duration<double>(t2 - t1).count();
+                writeSeconds += std::chrono::duration<double>(t3 - t2).count();
+            }
+        }
+    }
+    targets.clear();
+    file.flush(H5F_SCOPE_LOCAL);
+
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    double totalSeconds = std::chrono::duration<double>(tEnd - tStart).count();
+    double cubeMb = width * height * depth * stokes * sizeof(float) * 1.0e-6;
+    fmt::print("Built mipmaps x{} to x{} for {}x{}x{}x{} cube in {:.2f} s: {:.1f} MB/s\n", mips.front(), mips.back(), width, height,
+               depth, stokes, totalSeconds, cubeMb / totalSeconds);
+    fmt::print("Bands of {} rows; read {:.2f} s, reduce {:.2f} s ({:.1f} MB/s), write {:.2f} s\n", bandRows, readSeconds,
+               reduceSeconds, cubeMb / reduceSeconds, writeSeconds);
+    fmt::print("Peak RSS {:.1f} MB\n", peakResidentMb());
+    return true;
+}
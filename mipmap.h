@@ -0,0 +1,20 @@
+#ifndef ADASS_HDF5_BENCHMARK_MIPMAP_H
+#define ADASS_HDF5_BENCHMARK_MIPMAP_H
+
+#include <H5Cpp.h>
+#include <string>
+
+struct MipmapOptions {
+    // Largest down-sampling factor; levels are built for every power of two from 2 up to this
+    int maxMip = 32;
+};
+
+// Name of the dataset in 0/MipMaps that holds the given level
+std::string mipDataSetName(int mip);
+
+// Writes 0/MipMaps/DATA_XY_<n> datasets with NaN-aware mean mipmaps of every channel, replacing existing ones.
+// The cube is read once, in bands of maxMip rows. Each level is reduced from the sums and counts of the level
+// below, so every level is the exact mean of the non-NaN full-resolution pixels in its block.
+bool buildMipmaps(H5::H5File& file, const MipmapOptions& options);
+
+#endif //ADASS_HDF5_BENCHMARK_MIPMAP_H
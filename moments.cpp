@@ -0,0 +1,185 @@
+#include "moments.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+string momentTraversalName(MomentTraversal traversal) {
+    switch (traversal) {
+        case MomentTraversal::Planes: return "planes";
+        case MomentTraversal::Spectra: return "spectra";
+    }
+    return "unknown";
+}
+
+static double secondsBetween(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+// Moments of one pixel from its sums of I, I*z and I*z^2
+static void finishPixel(double sum, double weightedSum, double squaredSum, bool valid, float* moment0, float* moment1,
+                        float* moment2) {
+    if (!valid) {
+        *moment0 = *moment1 = *moment2 = NAN;
+        return;
+    }
+    *moment0 = sum;
+    if (sum == 0) {
+        *moment1 = *moment2 = NAN;
+        return;
+    }
+    double mean = weightedSum / sum;
+    *moment1 = mean;
+    *moment2 = sqrt(max(0.0, squaredSum / sum - mean * mean));
+}
+
+static void momentsByPlanes(DataReader* reader, const vector<hsize_t>& dims, int stokes, size_t memoryBudget, MomentMaps& maps,
+                            MomentResult& result) {
+    int rank = dims.size();
+    hsize_t width = dims[rank - 1];
+    hsize_t height = dims[rank - 2];
+    hsize_t depth = (rank > 2) ? dims[rank - 3] : 1;
+
+    // Each pixel of a band needs three double accumulators and a float of the channel being read
+    size_t pixelBytes = 3 * sizeof(double) + sizeof(float);
+    hsize_t bandRows = min<hsize_t>(height, max<size_t>(1, memoryBudget / (pixelBytes * width)));
+    size_t bandSize = bandRows * width;
+    vector<double> sums(bandSize), weightedSums(bandSize), squaredSums(bandSize);
+    vector<float> band(bandSize);
+    result.bufferBytes = bandSize * pixelBytes;
+
+    for (hsize_t y = 0; y < height; y += bandRows) {
+        hsize_t numRows = min(bandRows, height - y);
+        long long n = numRows * width;
+        float* peak = maps.peak.data() + y * width;
+        float* peakChannel = maps.peakChannel.data() + y * width;
+        fill(sums.begin(), sums.end(), 0.0);
+        fill(weightedSums.begin(), weightedSums.end(), 0.0);
+        fill(squaredSums.begin(), squaredSums.end(), 0.0);
+        fill(peak, peak + n, -INFINITY);
+        fill(peakChannel, peakChannel + n, NAN);
+
+        for (hsize_t z = 0; z < depth; z++) {
+            auto t0 = Clock::now();
+            vector<hsize_t> count = {1, numRows, width};
+            vector<hsize_t> start = {z, y, 0};
+            if (rank == 4) {
+                count.insert(count.begin(), 1);
+                start.insert(start.begin(), stokes);
+            }
+            reader->read(start, count, band.data());
+            auto t1 = Clock::now();
+
+            double channel = z;
+#pragma omp parallel for schedule(static)
+            for (long long i = 0; i < n; i++) {
+                float val = band[i];
+                if (!isnan(val)) {
+                    sums[i] += val;
+                    weightedSums[i] += val * channel;
+                    squaredSums[i] += val * channel * channel;
+                    if (val > peak[i]) {
+                        peak[i] = val;
+                        peakChannel[i] = channel;
+                    }
+                }
+            }
+            result.readSeconds += secondsBetween(t0, t1);
+            result.computeSeconds += secondsBetween(t1, Clock::now());
+        }
+
+        auto t0 = Clock::now();
+#pragma omp parallel for schedule(static)
+        for (long long i = 0; i < n; i++) {
+            size_t pixel = y * width + i;
+            bool valid = !isnan(peakChannel[i]);
+            if (!valid) {
+                peak[i] = NAN;
+            }
+            finishPixel(sums[i], weightedSums[i], squaredSums[i], valid, &maps.moment0[pixel], &maps.moment1[pixel], &maps.moment2[pixel]);
+        }
+        result.computeSeconds += secondsBetween(t0, Clock::now());
+    }
+    result.bytes = width * height * depth * sizeof(float);
+}
+
+static void momentsBySpectra(DataReader* reader, const vector<hsize_t>& dims, int stokes, size_t memoryBudget, MomentMaps& maps,
+                             MomentResult& result) {
+    int rank = dims.size();
+    hsize_t width = dims[rank - 1];
+    hsize_t height = dims[rank - 2];
+    hsize_t depth = (rank > 2) ? dims[rank - 3] : 1;
+
+    // The swizzled dataset is in (x, y, channel) order, so a band of columns holds whole spectra
+    size_t columnBytes = height * depth * sizeof(float);
+    hsize_t bandColumns = min<hsize_t>(width, max<size_t>(1, memoryBudget / columnBytes));
+    vector<float> band(bandColumns * height * depth);
+    result.bufferBytes = band.size() * sizeof(float);
+
+    for (hsize_t x = 0; x < width; x += bandColumns) {
+        hsize_t numColumns = min(bandColumns, width - x);
+        auto t0 = Clock::now();
+        vector<hsize_t> count = {numColumns, height, depth};
+        vector<hsize_t> start = {x, 0, 0};
+        if (rank == 4) {
+            count.insert(count.begin(), 1);
+            start.insert(start.begin(), stokes);
+        }
+        reader->read(start, count, band.data());
+        auto t1 = Clock::now();
+
+        long long spectra = numColumns * height;
+#pragma omp parallel for schedule(static)
+        for (long long k = 0; k < spectra; k++) {
+            const float* spectrum = band.data() + k * depth;
+            // Spectrum k is at column x + k / height of row k % height
+            size_t pixel = (k % height) * width + x + k / height;
+            double sum = 0, weightedSum = 0, squaredSum = 0;
+            float peak = -INFINITY;
+            float peakChannel = NAN;
+            for (hsize_t z = 0; z < depth; z++) {
+                float val = spectrum[z];
+                if (!isnan(val)) {
+                    double channel = z;
+                    sum += val;
+                    weightedSum += val * channel;
+                    squaredSum += val * channel * channel;
+                    if (val > peak) {
+                        peak = val;
+                        peakChannel = z;
+                    }
+                }
+            }
+            bool valid = !isnan(peakChannel);
+            maps.peak[pixel] = valid ? peak : NAN;
+            maps.peakChannel[pixel] = peakChannel;
+            finishPixel(sum, weightedSum, squaredSum, valid, &maps.moment0[pixel], &maps.moment1[pixel], &maps.moment2[pixel]);
+        }
+        result.readSeconds += secondsBetween(t0, t1);
+        result.computeSeconds += secondsBetween(t1, Clock::now());
+    }
+    result.bytes = width * height * depth * sizeof(float);
+}
+
+MomentResult computeMoments(DataReader* reader, const vector<hsize_t>& dims, int stokes, MomentTraversal traversal,
+                            size_t memoryBudget, MomentMaps& maps) {
+    int rank = dims.size();
+    size_t mapSize = dims[rank - 1] * dims[rank - 2];
+    for (auto map : {&maps.moment0, &maps.moment1, &maps.moment2, &maps.peak, &maps.peakChannel}) {
+        map->resize(mapSize);
+    }
+
+    MomentResult result = {0, 0, 0, 0, 0};
+    auto tStart = Clock::now();
+    if (traversal == MomentTraversal::Planes) {
+        momentsByPlanes(reader, dims, stokes, memoryBudget, maps, result);
+    } else {
+        momentsBySpectra(reader, dims, stokes, memoryBudget, maps, result);
+    }
+    result.seconds = secondsBetween(tStart, Clock::now());
+    return result;
+}
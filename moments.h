@@ -0,0 +1,41 @@
+#ifndef ADASS_HDF5_BENCHMARK_MOMENTS_H
+#define ADASS_HDF5_BENCHMARK_MOMENTS_H
+
+#include <H5Cpp.h>
+#include <string>
+#include <vector>
+
+#include "reader.h"
+
+enum class MomentTraversal {
+    // Channel by channel through the main dataset, accumulating into per-pixel arrays
+    Planes,
+    // Spectrum by spectrum through the swizzled dataset
+    Spectra
+};
+
+std::string momentTraversalName(MomentTraversal traversal);
+
+// Height x width maps of one stokes, with the spectral coordinate in channels. Pixels without valid values are NaN.
+struct MomentMaps {
+    // Integrated intensity, intensity-weighted mean channel and intensity-weighted dispersion about it
+    std::vector<float> moment0, moment1, moment2;
+    // Largest value and the channel it is in
+    std::vector<float> peak, peakChannel;
+};
+
+struct MomentResult {
+    double seconds, readSeconds, computeSeconds;
+    size_t bytes;
+    // Read buffers and accumulators, which stay within the memory budget (the maps themselves are not included)
+    size_t bufferBytes;
+};
+
+// Computes all moment maps of one stokes of a ([stokes,] depth, height, width) cube in a single pass, reading it
+// in bands that fit in memoryBudget bytes: bands of rows of each channel in turn for planes, or bands of columns
+// of whole spectra for spectra (with a reader of the swizzled dataset). Each band is reduced in parallel over its
+// pixels. Moment 2 is derived from the sums of I, I*z and I*z^2, accumulated in double.
+MomentResult computeMoments(DataReader* reader, const std::vector<hsize_t>& dims, int stokes, MomentTraversal traversal,
+                            size_t memoryBudget, MomentMaps& maps);
+
+#endif //ADASS_HDF5_BENCHMARK_MOMENTS_H
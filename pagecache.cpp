@@ -0,0 +1,69 @@
+#include "pagecache.h"
+
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+bool parseCacheMode(const string& name, CacheMode& mode) {
+    if (name == "none") {
+        mode = CacheMode::None;
+    } else if (name == "cold") {
+        mode = CacheMode::Cold;
+    } else if (name == "warm") {
+        mode = CacheMode::Warm;
+    } else if (name == "both") {
+        mode = CacheMode::Both;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool evictFile(const string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    // Dirty pages cannot be dropped, so make sure nothing is pending first
+    fdatasync(fd);
+    bool success = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return success;
+}
+
+double residentFraction(const string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t filesize = st.st_size;
+    void* ptr = mmap(nullptr, filesize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return -1;
+    }
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t numPages = (filesize + pageSize - 1) / pageSize;
+    vector<unsigned char> residency(numPages);
+    double fraction = -1;
+    if (mincore(ptr, filesize, residency.data()) == 0) {
+        size_t residentPages = 0;
+        for (auto page : residency) {
+            residentPages += page & 1;
+        }
+        fraction = double(residentPages) / numPages;
+    }
+    munmap(ptr, filesize);
+    return fraction;
+}
@@ -0,0 +1,25 @@
+#ifndef ADASS_HDF5_BENCHMARK_PAGECACHE_H
+#define ADASS_HDF5_BENCHMARK_PAGECACHE_H
+
+#include <string>
+#include <cstddef>
+
+enum class CacheMode {
+    None,
+    Cold,
+    Warm,
+    Both
+};
+
+bool parseCacheMode(const std::string& name, CacheMode& mode);
+
+// Asks the kernel to drop the page cache entries of a single file. Unlike writing to
+// /proc/sys/vm/drop_caches, this needs no privileges and leaves other files untouched.
+// Pages that are still mapped by a process are skipped, so mappings must be released
+// (e.g. with madvise(MADV_DONTNEED)) beforehand.
+bool evictFile(const std::string& filename);
+
+// Fraction (0-1) of the file's pages that are currently resident in the page cache, or -1 on failure
+double residentFraction(const std::string& filename);
+
+#endif //ADASS_HDF5_BENCHMARK_PAGECACHE_H
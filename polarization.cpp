@@ -0,0 +1,304 @@
+#include "polarization.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fmt/format.h>
+#include <immintrin.h>
+
+#include "downsample.h"
+#include "resources.h"
+
+using namespace std;
+using namespace H5;
+
+// Values derived by each kernel call, as in the statistics kernels
+static const size_t blockSize = 1 << 16;
+
+// Coefficients of the odd minimax polynomial for atan(a) on [0, 1], lowest order first, and the scale from radians
+// to half the angle in degrees
+static const float atanCoefficients[6] = {0.99997726f, -0.33262347f, 0.19354346f, -0.11643287f, 0.05265332f, -0.01172120f};
+static const float halfDegrees = 90.0f / float(M_PI);
+
+string polarizationName(PolarizationQuantity quantity) {
+    switch (quantity) {
+        case PolarizationQuantity::Intensity: return "polarized intensity";
+        case PolarizationQuantity::Fraction: return "fractional polarization";
+        case PolarizationQuantity::Angle: return "polarization angle";
+    }
+    return "unknown";
+}
+
+string polarizationDataSetName(PolarizationQuantity quantity) {
+    switch (quantity) {
+        case PolarizationQuantity::Intensity: return "PI";
+        case PolarizationQuantity::Fraction: return "PFRAC";
+        case PolarizationQuantity::Angle: return "PA";
+    }
+    return "unknown";
+}
+
+vector<int> polarizationInputs(PolarizationQuantity quantity) {
+    if (quantity == PolarizationQuantity::Fraction) {
+        return {0, 1, 2};
+    }
+    return {1, 2};
+}
+
+typedef void (*DeriveFunction)(PolarizationQuantity quantity, const float* const* inputs, size_t n, float* out);
+
+// The atan2 of the kernels: the octant is reduced to [0, 1] by dividing the smaller magnitude by the larger, and the
+// result reflected back. Adding 0 * x + 0 * y keeps NaNs that min and max would drop.
+static inline float atan2Scalar(float y, float x) {
+    float ax = fabsf(x), ay = fabsf(y);
+    float a = min(ax, ay) / max(max(ax, ay), FLT_MIN);
+    float s = a * a;
+    float p = atanCoefficients[5];
+    for (auto i = 4; i >= 0; i--) {
+        p = p * s + atanCoefficients[i];
+    }
+    float r = p * a;
+    r = (ay > ax) ? float(M_PI_2) - r : r;
+    r = (x < 0) ? float(M_PI) - r : r;
+    r = copysignf(r, y);
+    return r + (x * 0.0f + y * 0.0f);
+}
+
+static void deriveScalar(PolarizationQuantity quantity, const float* const* inputs, size_t n, float* out) {
+    switch (quantity) {
+        case PolarizationQuantity::Intensity:
+            for (size_t i = 0; i < n; i++) {
+                out[i] = sqrtf(inputs[0][i] * inputs[0][i] + inputs[1][i] * inputs[1][i]);
+            }
+            break;
+        case PolarizationQuantity::Fraction:
+            for (size_t i = 0; i < n; i++) {
+                out[i] = sqrtf(inputs[1][i] * inputs[1][i] + inputs[2][i] * inputs[2][i]) / inputs[0][i];
+            }
+            break;
+        case PolarizationQuantity::Angle:
+            for (size_t i = 0; i < n; i++) {
+                out[i] = atan2Scalar(inputs[1][i], inputs[0][i]) * halfDegrees;
+            }
+            break;
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256 atan2Avx2(__m256 y, __m256 x) {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 ax = _mm256_andnot_ps(signMask, x);
+    __m256 ay = _mm256_andnot_ps(signMask, y);
+    __m256 a = _mm256_div_ps(_mm256_min_ps(ax, ay), _mm256_max_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(FLT_MIN)));
+    __m256 s = _mm256_mul_ps(a, a);
+    __m256 p = _mm256_set1_ps(atanCoefficients[5]);
+    for (auto i = 4; i >= 0; i--) {
+        p = _mm256_add_ps(_mm256_mul_ps(p, s), _mm256_set1_ps(atanCoefficients[i]));
+    }
+    __m256 r = _mm256_mul_ps(p, a);
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(float(M_PI_2)), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(float(M_PI)), r), _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+    r = _mm256_or_ps(r, _mm256_and_ps(y, signMask));
+    return _mm256_add_ps(r, _mm256_add_ps(_mm256_mul_ps(x, zero), _mm256_mul_ps(y, zero)));
+}
+
+__attribute__((target("avx2")))
+static void deriveAvx2(PolarizationQuantity quantity, const float* const* inputs, size_t n, float* out) {
+    size_t i = 0;
+    switch (quantity) {
+        case PolarizationQuantity::Intensity:
+            for (; i + 8 <= n; i += 8) {
+                __m256 q = _mm256_loadu_ps(inputs[0] + i);
+                __m256 u = _mm256_loadu_ps(inputs[1] + i);
+                _mm256_storeu_ps(out + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(q, q), _mm256_mul_ps(u, u))));
+            }
+            break;
+        case PolarizationQuantity::Fraction:
+            for (; i + 8 <= n; i += 8) {
+                __m256 q = _mm256_loadu_ps(inputs[1] + i);
+                __m256 u = _mm256_loadu_ps(inputs[2] + i);
+                __m256 intensity = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(q, q), _mm256_mul_ps(u, u)));
+                _mm256_storeu_ps(out + i, _mm256_div_ps(intensity, _mm256_loadu_ps(inputs[0] + i)));
+            }
+            break;
+        case PolarizationQuantity::Angle:
+            for (; i + 8 <= n; i += 8) {
+                __m256 angle = atan2Avx2(_mm256_loadu_ps(inputs[1] + i), _mm256_loadu_ps(inputs[0] + i));
+                _mm256_storeu_ps(out + i, _mm256_mul_ps(angle, _mm256_set1_ps(halfDegrees)));
+            }
+            break;
+    }
+    const float* rest[3] = {inputs[0] + i, inputs[1] + i, quantity == PolarizationQuantity::Fraction ? inputs[2] + i : nullptr};
+    deriveScalar(quantity, rest, n - i, out + i);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 atan2Avx512(__m512 y, __m512 x) {
+    const __m512 zero = _mm512_setzero_ps();
+    __m512 ax = _mm512_abs_ps(x);
+    __m512 ay = _mm512_abs_ps(y);
+    __m512 a = _mm512_div_ps(_mm512_min_ps(ax, ay), _mm512_max_ps(_mm512_max_ps(ax, ay), _mm512_set1_ps(FLT_MIN)));
+    __m512 s = _mm512_mul_ps(a, a);
+    __m512 p = _mm512_set1_ps(atanCoefficients[5]);
+    for (auto i = 4; i >= 0; i--) {
+        p = _mm512_add_ps(_mm512_mul_ps(p, s), _mm512_set1_ps(atanCoefficients[i]));
+    }
+    __m512 r = _mm512_mul_ps(p, a);
+    r = _mm512_mask_sub_ps(r, _mm512_cmp_ps_mask(ay, ax, _CMP_GT_OQ), _mm512_set1_ps(float(M_PI_2)), r);
+    r = _mm512_mask_sub_ps(r, _mm512_cmp_ps_mask(x, zero, _CMP_LT_OQ), _mm512_set1_ps(float(M_PI)), r);
+    r = _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(r),
+                                            _mm512_and_si512(_mm512_castps_si512(y), _mm512_set1_epi32(0x80000000))));
+    return _mm512_add_ps(r, _mm512_add_ps(_mm512_mul_ps(x, zero), _mm512_mul_ps(y, zero)));
+}
+
+__attribute__((target("avx512f")))
+static void deriveAvx512(PolarizationQuantity quantity, const float* const* inputs, size_t n, float* out) {
+    size_t i = 0;
+    switch (quantity) {
+        case PolarizationQuantity::Intensity:
+            for (; i + 16 <= n; i += 16) {
+                __m512 q = _mm512_loadu_ps(inputs[0] + i);
+                __m512 u = _mm512_loadu_ps(inputs[1] + i);
+                _mm512_storeu_ps(out + i, _mm512_sqrt_ps(_mm512_add_ps(_mm512_mul_ps(q, q), _mm512_mul_ps(u, u))));
+            }
+            break;
+        case PolarizationQuantity::Fraction:
+            for (; i + 16 <= n; i += 16) {
+                __m512 q = _mm512_loadu_ps(inputs[1] + i);
+                __m512 u = _mm512_loadu_ps(inputs[2] + i);
+                __m512 intensity = _mm512_sqrt_ps(_mm512_add_ps(_mm512_mul_ps(q, q), _mm512_mul_ps(u, u)));
+                _mm512_storeu_ps(out + i, _mm512_div_ps(intensity, _mm512_loadu_ps(inputs[0] + i)));
+            }
+            break;
+        case PolarizationQuantity::Angle:
+            for (; i + 16 <= n; i += 16) {
+                __m512 angle = atan2Avx512(_mm512_loadu_ps(inputs[1] + i), _mm512_loadu_ps(inputs[0] + i));
+                _mm512_storeu_ps(out + i, _mm512_mul_ps(angle, _mm512_set1_ps(halfDegrees)));
+            }
+            break;
+    }
+    const float* rest[3] = {inputs[0] + i, inputs[1] + i, quantity == PolarizationQuantity::Fraction ? inputs[2] + i : nullptr};
+    deriveScalar(quantity, rest, n - i, out + i);
+}
+
+void derivePolarization(PolarizationQuantity quantity, const vector<const float*>& inputs, size_t n, float* out) {
+    static const DeriveFunction functions[3] = {deriveScalar, deriveAvx2, deriveAvx512};
+    auto derive = functions[(int) getSimdLevel()];
+
+    long long blocks = (n + blockSize - 1) / blockSize;
+#pragma omp parallel for schedule(static) if (blocks > 1)
+    for (long long b = 0; b < blocks; b++) {
+        size_t offset = b * blockSize;
+        const float* blockInputs[3] = {};
+        for (size_t k = 0; k < inputs.size(); k++) {
+            blockInputs[k] = inputs[k] + offset;
+        }
+        derive(quantity, blockInputs, min(blockSize, n - offset), out + offset);
+    }
+}
+
+static const vector<PolarizationQuantity> quantities = {PolarizationQuantity::Intensity, PolarizationQuantity::Fraction,
+                                                        PolarizationQuantity::Angle};
+
+// Derives every quantity from a [stokes, slow, mid, fast] source dataset into [slow, mid, fast] datasets in group,
+// in slabs of whole chunks along the slow and mid axes. Returns the bytes read.
+static size_t deriveDataSets(const DataSet& source, Group& group, size_t memoryBudget, double& readSeconds, double& computeSeconds) {
+    vector<hsize_t> dims(4);
+    source.getSpace().getSimpleExtentDims(dims.data(), nullptr);
+    hsize_t slow = dims[1], mid = dims[2], fast = dims[3];
+    vector<hsize_t> chunkDims = {1, 1, 1, 1};
+    auto sourceProperties = source.getCreatePlist();
+    DSetCreatPropList createProperties;
+    if (sourceProperties.getLayout() == H5D_CHUNKED) {
+        sourceProperties.getChunk(4, chunkDims.data());
+        createProperties.setChunk(3, chunkDims.data() + 1);
+    }
+
+    // Each element of a slab is read for I, Q and U and written for each quantity
+    size_t elementBytes = 6 * sizeof(float);
+    hsize_t slabSlow = chunkDims[1];
+    hsize_t slabMid = max<hsize_t>(1, memoryBudget / (elementBytes * slabSlow * fast));
+    slabMid = min(mid, slabMid >= chunkDims[2] ? slabMid / chunkDims[2] * chunkDims[2] : slabMid);
+    size_t slabSize = slabSlow * slabMid * fast;
+    vector<float> stokesSlab(3 * slabSize);
+    vector<vector<float>> derived(quantities.size(), vector<float>(slabSize));
+
+    vector<DataSet> targets;
+    vector<hsize_t> targetDims(dims.begin() + 1, dims.end());
+    for (auto quantity : quantities) {
+        targets.push_back(group.createDataSet(polarizationDataSetName(quantity), PredType::NATIVE_FLOAT,
+                                              DataSpace(3, targetDims.data()), createProperties));
+    }
+
+    size_t bytes = 0;
+    for (hsize_t a = 0; a < slow; a += slabSlow) {
+        for (hsize_t b = 0; b < mid; b += slabMid) {
+            auto t0 = std::chrono::high_resolution_clock::now();
+            vector<hsize_t> count = {3, min(slabSlow, slow - a), min(slabMid, mid - b), fast};
+            vector<hsize_t> start = {0, a, b, 0};
+            DataSpace memspace(4, count.data());
+            auto sourceSpace = source.getSpace();
+            sourceSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+            source.read(stokesSlab.data(), PredType::NATIVE_FLOAT, memspace, sourceSpace);
+            size_t n = count[1] * count[2] * count[3];
+            bytes += 3 * n * sizeof(float);
+            auto t1 = std::chrono::high_resolution_clock::now();
+
+            // The slab holds the I, Q and U parts one after another
+            for (size_t k = 0; k < quantities.size(); k++) {
+                vector<const float*> inputs;
+                for (auto s : polarizationInputs(quantities[k])) {
+                    inputs.push_back(stokesSlab.data() + s * n);
+                }
+                derivePolarization(quantities[k], inputs, n, derived[k].data());
+            }
+            auto t2 = std::chrono::high_resolution_clock::now();
+
+            DataSpace targetMemspace(3, count.data() + 1);
+            for (size_t k = 0; k < quantities.size(); k++) {
+                auto targetSpace = targets[k].getSpace();
+                targetSpace.selectHyperslab(H5S_SELECT_SET, count.data() + 1, start.data() + 1);
+                targets[k].write(derived[k].data(), PredType::NATIVE_FLOAT, targetMemspace, targetSpace);
+            }
+            readSeconds += std::chrono::duration<double>(t1 - t0).count();
+            computeSeconds += std::chrono::duration<double>(t2 - t1).count();
+        }
+    }
+    return bytes;
+}
+
+bool buildPolarization(H5File& file, const PolarizationOptions& options) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    auto hduGroup = file.openGroup("0");
+    auto source = hduGroup.openDataSet("DATA");
+    vector<hsize_t> dims(source.getSpace().getSimpleExtentNdims());
+    source.getSpace().getSimpleExtentDims(dims.data(), nullptr);
+    if (dims.size() != 4 || dims[0] < 3) {
+        fmt::print("Polarization quantities require a 4D cube with at least I, Q and U. Aborting.\n");
+        return false;
+    }
+
+    if (hduGroup.nameExists("Polarization")) {
+        hduGroup.unlink("Polarization");
+    }
+    auto polarizationGroup = hduGroup.createGroup("Polarization");
+    double readSeconds = 0, computeSeconds = 0;
+    size_t bytes = deriveDataSets(source, polarizationGroup, options.memoryBudget, readSeconds, computeSeconds);
+
+    bool swizzled = hduGroup.nameExists("SwizzledData") && hduGroup.openGroup("SwizzledData").nameExists("ZYXW");
+    if (swizzled) {
+        auto swizzledGroup = polarizationGroup.createGroup("Swizzled");
+        auto swizzledSource = hduGroup.openGroup("SwizzledData").openDataSet("ZYXW");
+        bytes += deriveDataSets(swizzledSource, swizzledGroup, options.memoryBudget, readSeconds, computeSeconds);
+    }
+    file.flush(H5F_SCOPE_LOCAL);
+
+    double totalSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+    fmt::print("Derived {} for {}x{}x{} cube{} in {:.2f} s: {:.1f} MB/s read\n", "polarized intensity, fraction and angle", dims[3],
+               dims[2], dims[1], swizzled ? " and its swizzled copy" : "", totalSeconds, bytes * 1.0e-6 / totalSeconds);
+    fmt::print("Read {:.2f} s, compute {:.2f} s, write {:.2f} s\n", readSeconds, computeSeconds, totalSeconds - readSeconds - computeSeconds);
+    fmt::print("Peak RSS {:.1f} MB\n", peakResidentMb());
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef ADASS_HDF5_BENCHMARK_POLARIZATION_H
+#define ADASS_HDF5_BENCHMARK_POLARIZATION_H
+
+#include <H5Cpp.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class PolarizationQuantity {
+    // sqrt(Q^2 + U^2)
+    Intensity,
+    // Polarized intensity over I
+    Fraction,
+    // 0.5 atan2(U, Q), in degrees
+    Angle
+};
+
+std::string polarizationName(PolarizationQuantity quantity);
+// Name of the precomputed dataset in 0/Polarization and 0/Polarization/Swizzled
+std::string polarizationDataSetName(PolarizationQuantity quantity);
+// Stokes indices (I = 0, Q = 1, U = 2) the quantity is derived from, in the order derivePolarization takes them
+std::vector<int> polarizationInputs(PolarizationQuantity quantity);
+
+// Computes n values of the quantity from the matching values of its inputs, in blocks reduced in parallel with the
+// SIMD kernels selected by setSimdLevel (see downsample.h). NaN in any input gives NaN. The angle uses a polynomial
+// approximation of atan2, accurate to 2e-6 rad.
+void derivePolarization(PolarizationQuantity quantity, const std::vector<const float*>& inputs, size_t n, float* out);
+
+struct PolarizationOptions {
+    // Memory for the stokes slabs read and the derived slabs written, in bytes
+    size_t memoryBudget = 1024 * 1024 * 1024;
+};
+
+// Writes every derived quantity of a 4D cube to 0/Polarization in the (z, y, x) order of 0/DATA, and to
+// 0/Polarization/Swizzled in the (x, y, z) order of 0/SwizzledData/ZYXW if present, replacing existing ones. Each
+// is chunked like its source and read from it once, in slabs of whole chunks along the two slowest axes.
+bool buildPolarization(H5::H5File& file, const PolarizationOptions& options);
+
+#endif //ADASS_HDF5_BENCHMARK_POLARIZATION_H
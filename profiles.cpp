@@ -0,0 +1,155 @@
+#include "profiles.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "stats.h"
+
+using namespace std;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// Fewest channels each thread sums spectra over, so that the SIMD kernels have whole vectors to work on
+static const int minChannelSpan = 16;
+
+string regionShapeName(RegionShape shape) {
+    switch (shape) {
+        case RegionShape::Rectangle: return "rectangle";
+        case RegionShape::Ellipse: return "ellipse";
+        case RegionShape::Polygon: return "polygon";
+    }
+    return "unknown";
+}
+
+vector<PixelRun> regionRuns(RegionShape shape, int width, int height) {
+    double centerX = width / 2.0, centerY = height / 2.0;
+    vector<pair<double, double>> vertices;
+    if (shape == RegionShape::Polygon) {
+        for (auto i = 0; i < 10; i++) {
+            double angle = M_PI * (i / 5.0 - 0.5);
+            double radius = (i % 2) ? 0.4 : 1.0;
+            vertices.push_back({centerX * (1 + radius * cos(angle)), centerY * (1 + radius * sin(angle))});
+        }
+    }
+
+    vector<PixelRun> runs;
+    // Pixel i of a row is inside a span [from, to) of the shape if its centre i + 0.5 is
+    auto addRun = [&](int row, double from, double to) {
+        int start = max(0, int(ceil(from - 0.5)));
+        int end = min(width, int(ceil(to - 0.5)));
+        if (end > start) {
+            runs.push_back({row, start, end});
+        }
+    };
+    for (auto row = 0; row < height; row++) {
+        double y = row + 0.5;
+        if (shape == RegionShape::Rectangle) {
+            runs.push_back({row, 0, width});
+        } else if (shape == RegionShape::Ellipse) {
+            double dy = (y - centerY) / centerY;
+            if (dy * dy <= 1) {
+                double halfWidth = centerX * sqrt(1 - dy * dy);
+                addRun(row, centerX - halfWidth, centerX + halfWidth);
+            }
+        } else {
+            // Even-odd rule: the row is inside between alternate crossings of the polygon's edges
+            vector<double> crossings;
+            for (size_t i = 0; i < vertices.size(); i++) {
+                auto& a = vertices[i];
+                auto& b = vertices[(i + 1) % vertices.size()];
+                if ((a.second <= y) != (b.second <= y)) {
+                    crossings.push_back(a.first + (y - a.second) * (b.first - a.first) / (b.second - a.second));
+                }
+            }
+            sort(crossings.begin(), crossings.end());
+            for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+                addRun(row, crossings[i], crossings[i + 1]);
+            }
+        }
+    }
+    return runs;
+}
+
+ProfileResult regionProfile(DataReader* reader, bool swizzled, const vector<hsize_t>& dims, int stokes, int x, int y, int width,
+                            int height, const vector<PixelRun>& runs, int channelBlock, vector<float>& profile,
+                            const function<void(const vector<float>& profile, int channelsDone)>& onPartial) {
+    int rank = dims.size();
+    int depth = (rank > 2) ? dims[rank - 3] : 1;
+    int block = channelBlock > 0 ? min(channelBlock, depth) : depth;
+    size_t boxSize = size_t(width) * height;
+    vector<float> buffer(boxSize * block);
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+
+    profile.assign(depth, NAN);
+    ProfileResult result = {NAN, NAN, 0, 0, 0, 0};
+    auto tStart = Clock::now();
+    for (auto firstChannel = 0; firstChannel < depth; firstChannel += block) {
+        int channels = min(block, depth - firstChannel);
+        vector<hsize_t> count = {hsize_t(channels), hsize_t(height), hsize_t(width)};
+        vector<hsize_t> start = {hsize_t(firstChannel), hsize_t(y), hsize_t(x)};
+        if (swizzled) {
+            reverse(count.begin(), count.end());
+            reverse(start.begin(), start.end());
+        }
+        if (rank == 4) {
+            count.insert(count.begin(), 1);
+            start.insert(start.begin(), stokes);
+        }
+        auto t0 = Clock::now();
+        reader->read(start, count, buffer.data());
+        auto t1 = Clock::now();
+
+        float* blockProfile = profile.data() + firstChannel;
+        if (!swizzled) {
+#pragma omp parallel for schedule(static)
+            for (auto c = 0; c < channels; c++) {
+                const float* plane = buffer.data() + c * boxSize;
+                double sum = 0;
+                size_t valid = 0;
+                for (auto& run : runs) {
+                    addNanSum(plane + size_t(run.row) * width + run.start, run.end - run.start, sum, valid);
+                }
+                blockProfile[c] = valid ? sum / valid : NAN;
+            }
+        } else {
+            // Spectra are contiguous, so each thread adds a range of channels of every spectrum in the region
+            int span = max(minChannelSpan, (channels + threads - 1) / threads);
+            int spans = (channels + span - 1) / span;
+#pragma omp parallel for schedule(static)
+            for (auto k = 0; k < spans; k++) {
+                int first = k * span;
+                int n = min(span, channels - first);
+                vector<double> sums(n), counts(n);
+                for (auto& run : runs) {
+                    for (auto column = run.start; column < run.end; column++) {
+                        const float* spectrum = buffer.data() + (size_t(column) * height + run.row) * channels;
+                        addNanValues(spectrum + first, n, sums.data(), counts.data());
+                    }
+                }
+                for (auto i = 0; i < n; i++) {
+                    blockProfile[first + i] = counts[i] ? sums[i] / counts[i] : NAN;
+                }
+            }
+        }
+        auto t2 = Clock::now();
+
+        result.readMs += std::chrono::duration<double, milli>(t1 - t0).count();
+        result.computeMs += std::chrono::duration<double, milli>(t2 - t1).count();
+        result.bytes += boxSize * channels * sizeof(float);
+        if (result.blocks++ == 0) {
+            result.firstPartialMs = std::chrono::duration<double, milli>(t2 - tStart).count();
+        }
+        if (onPartial) {
+            onPartial(profile, firstChannel + channels);
+        }
+    }
+    result.completeMs = std::chrono::duration<double, milli>(Clock::now() - tStart).count();
+    return result;
+}
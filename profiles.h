@@ -0,0 +1,46 @@
+#ifndef ADASS_HDF5_BENCHMARK_PROFILES_H
+#define ADASS_HDF5_BENCHMARK_PROFILES_H
+
+#include <H5Cpp.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "reader.h"
+
+enum class RegionShape {
+    Rectangle,
+    Ellipse,
+    // A five-pointed star, as an example of a concave region
+    Polygon
+};
+
+std::string regionShapeName(RegionShape shape);
+
+// Pixels [start, end) of one row of a region's bounding box
+struct PixelRun {
+    int row, start, end;
+};
+
+// Runs of the pixels whose centres are inside the shape inscribed in a width x height box
+std::vector<PixelRun> regionRuns(RegionShape shape, int width, int height);
+
+struct ProfileResult {
+    // From the start of the first read until the first block's partial profile, and the whole profile, were ready
+    double firstPartialMs, completeMs;
+    double readMs, computeMs;
+    size_t bytes;
+    int blocks;
+};
+
+// Computes the NaN-aware mean spectral profile of a region of one stokes of a ([stokes,] depth, height, width)
+// cube. The region's bounding box [x, x + width) x [y, y + height) is read from the main dataset or, if swizzled,
+// from the swizzled dataset, in blocks of channelBlock channels (0 reads every channel at once). After each block,
+// onPartial (if set) is called with the profile so far, in which the channels still to come are NaN.
+// Channels of the main dataset are reduced in parallel, each summing the region's runs of pixels with SIMD kernels;
+// spectra of the swizzled dataset are added to per-channel sums by threads that each take a range of channels.
+ProfileResult regionProfile(DataReader* reader, bool swizzled, const std::vector<hsize_t>& dims, int stokes, int x, int y,
+                            int width, int height, const std::vector<PixelRun>& runs, int channelBlock, std::vector<float>& profile,
+                            const std::function<void(const std::vector<float>& profile, int channelsDone)>& onPartial = nullptr);
+
+#endif //ADASS_HDF5_BENCHMARK_PROFILES_H
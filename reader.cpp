@@ -0,0 +1,1012 @@
+#include "reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <fmt/format.h>
+#include <zlib.h>
+
+using namespace std;
+using namespace H5;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double secondsBetween(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+// Number of extents collected before they are handed to the backend
+static const size_t extentBatchSize = 65536;
+static const size_t directAlignment = 4096;
+static const size_t directMaxWindow = 16 * 1024 * 1024;
+
+// The raw and decode backends compute file offsets from the selection, so one outside the dataset would return
+// stray bytes (or fill values for chunks past the edge) where HDF5 fails. An empty stride is a unit stride.
+static void checkSelection(const vector<hsize_t>& dims, const vector<hsize_t>& start, const vector<hsize_t>& count,
+                           const vector<hsize_t>& stride) {
+    if (start.size() != dims.size() || count.size() != dims.size() || (!stride.empty() && stride.size() != dims.size())) {
+        throw runtime_error(fmt::format("Selection of rank {} does not match the dataset's rank {}", count.size(), dims.size()));
+    }
+    for (auto i = 0; i < dims.size(); i++) {
+        hsize_t step = stride.empty() ? 1 : stride[i];
+        if (count[i] && (start[i] >= dims[i] || (count[i] - 1) * step >= dims[i] - start[i])) {
+            throw runtime_error(fmt::format("Selection of {} from {} (stride {}) on axis {} is outside the dataset's extent of {}",
+                                            count[i], start[i], step, i, dims[i]));
+        }
+    }
+}
+
+bool parseBackend(const string& name, Backend& backend) {
+    if (name == "hdf5") {
+        backend = Backend::Hdf5;
+    } else if (name == "mmap") {
+        backend = Backend::Mmap;
+    } else if (name == "pread") {
+        backend = Backend::Pread;
+    } else if (name == "direct") {
+        backend = Backend::Direct;
+    } else if (name == "uring") {
+        backend = Backend::Uring;
+    } else if (name == "pool") {
+        backend = Backend::Pool;
+    } else if (name == "decode") {
+        backend = Backend::Decode;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+string backendName(Backend backend) {
+    switch (backend) {
+        case Backend::Hdf5: return "hdf5";
+        case Backend::Mmap: return "mmap";
+        case Backend::Pread: return "pread";
+        case Backend::Direct: return "direct";
+        case Backend::Uring: return "uring";
+        case Backend::Pool: return "pool";
+        case Backend::Decode: return "decode";
+    }
+    return "unknown";
+}
+
+Hdf5Reader::Hdf5Reader(const DataSet& dataSet) : dataSet(dataSet) {
+    auto createProperties = dataSet.getCreatePlist();
+    if (createProperties.getLayout() == H5D_CHUNKED) {
+        chunkDims.resize(dataSet.getSpace().getSimpleExtentNdims());
+        createProperties.getChunk(chunkDims.size(), chunkDims.data());
+    }
+}
+
+void Hdf5Reader::countChunks(const vector<hsize_t>& start, const vector<hsize_t>& span) {
+    if (chunkDims.empty()) {
+        return;
+    }
+    size_t chunks = 1;
+    for (auto i = 0; i < chunkDims.size(); i++) {
+        chunks *= (start[i] + span[i] - 1) / chunkDims[i] - start[i] / chunkDims[i] + 1;
+    }
+    chunksTouched += chunks;
+}
+
+string Hdf5Reader::name() const {
+    return backendName(Backend::Hdf5);
+}
+
+void Hdf5Reader::read(const vector<hsize_t>& start, const vector<hsize_t>& count, float* dest) {
+    auto t0 = Clock::now();
+    DataSpace memspace(count.size(), count.data());
+    auto sliceDataSpace = dataSet.getSpace();
+    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+    auto t1 = Clock::now();
+    dataSet.read(dest, PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
+    setupSeconds += secondsBetween(t0, t1);
+    transferSeconds += secondsBetween(t1, Clock::now());
+    countChunks(start, count);
+}
+
+void Hdf5Reader::readStrided(const vector<hsize_t>& start, const vector<hsize_t>& count, const vector<hsize_t>& stride, float* dest) {
+    auto t0 = Clock::now();
+    DataSpace memspace(count.size(), count.data());
+    auto sliceDataSpace = dataSet.getSpace();
+    sliceDataSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data(), stride.data());
+    auto t1 = Clock::now();
+    dataSet.read(dest, PredType::NATIVE_FLOAT, memspace, sliceDataSpace);
+    setupSeconds += secondsBetween(t0, t1);
+    transferSeconds += secondsBetween(t1, Clock::now());
+    // Strides smaller than the chunk shape visit every chunk the selection spans
+    vector<hsize_t> span(count.size());
+    for (auto i = 0; i < count.size(); i++) {
+        span[i] = (count[i] - 1) * stride[i] + 1;
+    }
+    countChunks(start, span);
+}
+
+RawReader::RawReader(const string& filename, const DataSet& dataSet) : dataSet(dataSet), fillValue(0) {
+    auto dataSpace = dataSet.getSpace();
+    dims.resize(dataSpace.getSimpleExtentNdims());
+    dataSpace.getSimpleExtentDims(dims.data(), nullptr);
+
+    auto createProperties = dataSet.getCreatePlist();
+    if (createProperties.getLayout() == H5D_CHUNKED) {
+        chunkDims.resize(dims.size());
+        createProperties.getChunk(chunkDims.size(), chunkDims.data());
+        dataOffset = HADDR_UNDEF;
+    } else {
+        dataOffset = dataSet.getOffset();
+    }
+
+    if (createProperties.isFillValueDefined() != H5D_FILL_VALUE_UNDEFINED) {
+        createProperties.getFillValue(PredType::NATIVE_FLOAT, &fillValue);
+    }
+}
+
+bool RawReader::supports(const DataSet& dataSet, string& reason) {
+    auto createProperties = dataSet.getCreatePlist();
+    auto layout = createProperties.getLayout();
+    if (layout != H5D_CONTIGUOUS && layout != H5D_CHUNKED) {
+        reason = "only contiguous and chunked layouts are supported";
+        return false;
+    }
+    if (createProperties.getNfilters() > 0) {
+        reason = "filtered (compressed) datasets are not supported";
+        return false;
+    }
+    if (!(dataSet.getDataType() == PredType::NATIVE_FLOAT)) {
+        reason = "the data type is not native float32";
+        return false;
+    }
+    if (layout == H5D_CONTIGUOUS && dataSet.getOffset() == HADDR_UNDEF) {
+        reason = "the dataset has no storage allocated";
+        return false;
+    }
+    return true;
+}
+
+void RawReader::read(const vector<hsize_t>& start, const vector<hsize_t>& count, float* dest) {
+    // Time not spent in readExtents (see flushExtents) is selection setup
+    auto t0 = Clock::now();
+    checkSelection(dims, start, count, {});
+    double transferBefore = transferSeconds;
+    if (chunkDims.empty()) {
+        readContiguous(start, count, dest);
+    } else {
+        readChunked(start, count, dest);
+    }
+    flushExtents();
+    setupSeconds += secondsBetween(t0, Clock::now()) - (transferSeconds - transferBefore);
+}
+
+void RawReader::readStrided(const vector<hsize_t>& start, const vector<hsize_t>& count, const vector<hsize_t>& stride, float* dest) {
+    auto t0 = Clock::now();
+    checkSelection(dims, start, count, stride);
+    double transferBefore = transferSeconds;
+    int rank = dims.size();
+    hsize_t columns = count[rank - 1];
+    hsize_t columnStride = stride[rank - 1];
+    hsize_t span = (columns - 1) * columnStride + 1;
+    hsize_t numRows = 1;
+    for (auto i = 0; i < rank - 1; i++) {
+        numRows *= count[i];
+    }
+    // Without a column stride, rows are read straight into the destination
+    float* rowDest = dest;
+    if (columnStride > 1) {
+        stridedRows.resize(numRows * span);
+        rowDest = stridedRows.data();
+    }
+
+    vector<hsize_t> rowStart(start), rowCount(rank, 1);
+    rowCount[rank - 1] = span;
+    vector<hsize_t> position(rank, 0);
+    for (hsize_t row = 0; row < numRows; row++) {
+        for (auto i = 0; i < rank - 1; i++) {
+            rowStart[i] = start[i] + position[i] * stride[i];
+        }
+        if (chunkDims.empty()) {
+            readContiguous(rowStart, rowCount, rowDest + row * span);
+        } else {
+            readChunked(rowStart, rowCount, rowDest + row * span);
+        }
+        int i = rank - 2;
+        while (i >= 0 && ++position[i] == count[i]) {
+            position[i] = 0;
+            i--;
+        }
+    }
+    flushExtents();
+    setupSeconds += secondsBetween(t0, Clock::now()) - (transferSeconds - transferBefore);
+
+    if (columnStride > 1) {
+        long long rows = numRows;
+#pragma omp parallel for schedule(static) if (rows * columns > 65536)
+        for (long long row = 0; row < rows; row++) {
+            const float* src = stridedRows.data() + row * span;
+            float* rowOut = dest + row * columns;
+            for (hsize_t x = 0; x < columns; x++) {
+                rowOut[x] = src[x * columnStride];
+            }
+        }
+    }
+}
+
+void RawReader::addExtent(hsize_t offset, size_t length, char* dest) {
+    extents.push_back({offset, length, dest});
+    if (extents.size() >= extentBatchSize) {
+        flushExtents();
+    }
+}
+
+void RawReader::flushExtents() {
+    if (!extents.empty()) {
+        auto t0 = Clock::now();
+        readExtents(extents);
+        transferSeconds += secondsBetween(t0, Clock::now());
+        extents.clear();
+    }
+}
+
+void RawReader::readContiguous(const vector<hsize_t>& start, const vector<hsize_t>& count, float* dest) {
+    int rank = dims.size();
+    // Trailing dimensions that are selected in full are merged into a single run
+    int k = rank - 1;
+    while (k > 0 && start[k] == 0 && count[k] == dims[k]) {
+        k--;
+    }
+    hsize_t innerElements = 1;
+    for (auto i = k + 1; i < rank; i++) {
+        innerElements *= dims[i];
+    }
+    hsize_t runElements = count[k] * innerElements;
+
+    vector<hsize_t> strides(rank, 1);
+    for (auto i = rank - 2; i >= 0; i--) {
+        strides[i] = strides[i + 1] * dims[i + 1];
+    }
+
+    // Runs are visited in row-major order of the selection, so the destination advances linearly
+    vector<hsize_t> position(start.begin(), start.begin() + k);
+    char* destPtr = (char*) dest;
+    while (true) {
+        hsize_t element = start[k] * strides[k];
+        for (auto i = 0; i < k; i++) {
+            element += position[i] * strides[i];
+        }
+        addExtent(dataOffset + element * sizeof(float), runElements * sizeof(float), destPtr);
+        destPtr += runElements * sizeof(float);
+
+        int i = k - 1;
+        while (i >= 0 && ++position[i] == start[i] + count[i]) {
+            position[i] = start[i];
+            i--;
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+}
+
+haddr_t RawReader::chunkAddress(const vector<hsize_t>& chunkOrigin) {
+    hsize_t chunkIndex = 0;
+    for (auto i = 0; i < dims.size(); i++) {
+        hsize_t chunksInDim = (dims[i] + chunkDims[i] - 1) / chunkDims[i];
+        chunkIndex = chunkIndex * chunksInDim + chunkOrigin[i] / chunkDims[i];
+    }
+    auto it = chunkAddresses.find(chunkIndex);
+    if (it != chunkAddresses.end()) {
+        return it->second;
+    }
+
+    unsigned filterMask;
+    haddr_t address;
+    hsize_t size;
+    if (H5Dget_chunk_info_by_coord(dataSet.getId(), chunkOrigin.data(), &filterMask, &address, &size) < 0) {
+        throw runtime_error("Chunk index lookup failed");
+    }
+    chunkAddresses[chunkIndex] = address;
+    return address;
+}
+
+void RawReader::readChunked(const vector<hsize_t>& start, const vector<hsize_t>& count, float* dest) {
+    int rank = dims.size();
+    vector<hsize_t> chunkStrides(rank, 1), selectionStrides(rank, 1);
+    for (auto i = rank - 2; i >= 0; i--) {
+        chunkStrides[i] = chunkStrides[i + 1] * chunkDims[i + 1];
+        selectionStrides[i] = selectionStrides[i + 1] * count[i + 1];
+    }
+
+    vector<hsize_t> firstChunk(rank), lastChunk(rank);
+    for (auto i = 0; i < rank; i++) {
+        firstChunk[i] = start[i] / chunkDims[i];
+        lastChunk[i] = (start[i] + count[i] - 1) / chunkDims[i];
+    }
+
+    vector<hsize_t> chunk(firstChunk);
+    vector<hsize_t> chunkOrigin(rank), low(rank), high(rank), position(rank);
+    while (true) {
+        // Intersection of this chunk with the selection
+        for (auto i = 0; i < rank; i++) {
+            chunkOrigin[i] = chunk[i] * chunkDims[i];
+            low[i] = max(start[i], chunkOrigin[i]);
+            high[i] = min(start[i] + count[i], chunkOrigin[i] + chunkDims[i]);
+        }
+        auto address = chunkAddress(chunkOrigin);
+        chunksTouched++;
+        size_t runElements = high[rank - 1] - low[rank - 1];
+
+        // Visit each row of the intersection along the fastest-varying dimension
+        position = low;
+        while (true) {
+            hsize_t chunkElement = 0, destElement = 0;
+            for (auto i = 0; i < rank; i++) {
+                chunkElement += (position[i] - chunkOrigin[i]) * chunkStrides[i];
+                destElement += (position[i] - start[i]) * selectionStrides[i];
+            }
+            if (address == HADDR_UNDEF) {
+                // Unallocated chunks read as the fill value, as they would through HDF5
+                fill(dest + destElement, dest + destElement + runElements, fillValue);
+            } else {
+                addExtent(address + chunkElement * sizeof(float), runElements * sizeof(float), (char*) (dest + destElement));
+            }
+
+            int i = rank - 2;
+            while (i >= 0 && ++position[i] == high[i]) {
+                position[i] = low[i];
+                i--;
+            }
+            if (i < 0) {
+                break;
+            }
+        }
+
+        int i = rank - 1;
+        while (i >= 0 && ++chunk[i] > lastChunk[i]) {
+            chunk[i] = firstChunk[i];
+            i--;
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+}
+
+static size_t getFilesize(const string& filename) {
+    struct stat st;
+    stat(filename.c_str(), &st);
+    return st.st_size;
+}
+
+MmapReader::MmapReader(const string& filename, const DataSet& dataSet) : RawReader(filename, dataSet), filePtr(nullptr) {
+    filesize = getFilesize(filename);
+    int fd = open(filename.c_str(), O_RDONLY, 0);
+    if (fd == -1) {
+        return;
+    }
+    auto ptr = mmap(nullptr, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr != MAP_FAILED) {
+        filePtr = (unsigned char*) ptr;
+    }
+}
+
+MmapReader::~MmapReader() {
+    if (filePtr) {
+        munmap(filePtr, filesize);
+    }
+}
+
+string MmapReader::name() const {
+    return backendName(Backend::Mmap);
+}
+
+bool MmapReader::valid() const {
+    return filePtr != nullptr;
+}
+
+void MmapReader::readExtents(vector<Extent>& extents) {
+    // Page faults on many small extents (e.g. Z-profiles) are latency-bound, so they are spread across threads
+#pragma omp parallel for if (extents.size() > 64)
+    for (auto i = 0; i < extents.size(); i++) {
+        memcpy(extents[i].dest, filePtr + extents[i].offset, extents[i].length);
+    }
+}
+
+PreadReader::PreadReader(const string& filename, const DataSet& dataSet, bool direct) : RawReader(filename, dataSet) {
+    fd = open(filename.c_str(), O_RDONLY | (direct ? O_DIRECT : 0));
+}
+
+PreadReader::~PreadReader() {
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+string PreadReader::name() const {
+    return backendName(Backend::Pread);
+}
+
+bool PreadReader::valid() const {
+    return fd != -1;
+}
+
+bool PreadReader::readExtent(const Extent& extent) {
+    size_t done = 0;
+    while (done < extent.length) {
+        auto n = pread(fd, extent.dest + done, extent.length - done, extent.offset + done);
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+void PreadReader::readExtents(vector<Extent>& extents) {
+    for (auto& extent : extents) {
+        if (!readExtent(extent)) {
+            throw runtime_error(fmt::format("pread failed at offset {}", extent.offset));
+        }
+    }
+}
+
+DirectReader::DirectReader(const string& filename, const DataSet& dataSet) : PreadReader(filename, dataSet, true), buffer(nullptr), bufferSize(0) {
+}
+
+DirectReader::~DirectReader() {
+    free(buffer);
+}
+
+string DirectReader::name() const {
+    return backendName(Backend::Direct);
+}
+
+void DirectReader::loadWindow(hsize_t windowStart, hsize_t windowEnd, hsize_t requiredEnd) {
+    size_t windowSize = windowEnd - windowStart;
+    if (windowSize > bufferSize) {
+        free(buffer);
+        buffer = nullptr;
+        if (posix_memalign((void**) &buffer, directAlignment, windowSize) != 0) {
+            bufferSize = 0;
+            throw runtime_error("Could not allocate aligned buffer");
+        }
+        bufferSize = windowSize;
+    }
+
+    size_t done = 0;
+    while (done < windowSize) {
+        auto n = pread(fd, buffer + done, windowSize - done, windowStart + done);
+        if (n < 0) {
+            throw runtime_error(fmt::format("O_DIRECT pread failed at offset {}", windowStart + done));
+        }
+        done += n;
+        // A short read only happens at the end of the file, which need not be block-aligned
+        if (n == 0 || done % directAlignment) {
+            break;
+        }
+    }
+    if (windowStart + done < requiredEnd) {
+        throw runtime_error(fmt::format("O_DIRECT read ended early at offset {}", windowStart + done));
+    }
+}
+
+static hsize_t alignDown(hsize_t offset) {
+    return offset / directAlignment * directAlignment;
+}
+
+static hsize_t alignUp(hsize_t offset) {
+    return (offset + directAlignment - 1) / directAlignment * directAlignment;
+}
+
+void DirectReader::readExtents(vector<Extent>& extents) {
+    size_t i = 0;
+    while (i < extents.size()) {
+        auto& first = extents[i];
+        hsize_t windowStart = alignDown(first.offset);
+        hsize_t windowEnd = alignUp(first.offset + first.length);
+
+        if (windowEnd - windowStart > directMaxWindow) {
+            // Extents larger than the window are read in pieces
+            size_t pieceSize = directMaxWindow - directAlignment;
+            for (size_t done = 0; done < first.length; done += pieceSize) {
+                size_t length = min(pieceSize, first.length - done);
+                hsize_t offset = first.offset + done;
+                loadWindow(alignDown(offset), alignUp(offset + length), offset + length);
+                memcpy(first.dest + done, buffer + (offset - alignDown(offset)), length);
+            }
+            i++;
+            continue;
+        }
+
+        // Extend the window over following extents that start inside it or directly after it
+        size_t j = i + 1;
+        hsize_t requiredEnd = first.offset + first.length;
+        while (j < extents.size()) {
+            auto& next = extents[j];
+            if (next.offset < windowStart || next.offset > windowEnd) {
+                break;
+            }
+            hsize_t nextEnd = alignUp(next.offset + next.length);
+            if (nextEnd - windowStart > directMaxWindow) {
+                break;
+            }
+            windowEnd = max(windowEnd, nextEnd);
+            requiredEnd = max(requiredEnd, next.offset + next.length);
+            j++;
+        }
+
+        loadWindow(windowStart, windowEnd, requiredEnd);
+        for (auto k = i; k < j; k++) {
+            memcpy(extents[k].dest, buffer + (extents[k].offset - windowStart), extents[k].length);
+        }
+        i = j;
+    }
+}
+
+UringReader::UringReader(const string& filename, const DataSet& dataSet, unsigned queueDepth)
+    : PreadReader(filename, dataSet), queueDepth(max(1u, queueDepth)), ringFd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED),
+      sqes((io_uring_sqe*) MAP_FAILED) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd = syscall(__NR_io_uring_setup, this->queueDepth, &params);
+    if (ringFd < 0) {
+        return;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap) {
+        sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+    }
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    cqRing = singleMap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*) mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        return;
+    }
+
+    auto sqBase = (char*) sqRing;
+    auto cqBase = (char*) cqRing;
+    sqTail = (unsigned*) (sqBase + params.sq_off.tail);
+    sqMask = (unsigned*) (sqBase + params.sq_off.ring_mask);
+    sqArray = (unsigned*) (sqBase + params.sq_off.array);
+    cqHead = (unsigned*) (cqBase + params.cq_off.head);
+    cqTail = (unsigned*) (cqBase + params.cq_off.tail);
+    cqMask = (unsigned*) (cqBase + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*) (cqBase + params.cq_off.cqes);
+    // The kernel may round the number of entries up, but never down
+    this->queueDepth = min(this->queueDepth, params.sq_entries);
+}
+
+UringReader::~UringReader() {
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != MAP_FAILED && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != MAP_FAILED) {
+        munmap(sqRing, sqRingSize);
+    }
+    if (ringFd >= 0) {
+        close(ringFd);
+    }
+}
+
+string UringReader::name() const {
+    return backendName(Backend::Uring);
+}
+
+bool UringReader::valid() const {
+    return PreadReader::valid() && ringFd >= 0 && sqRing != MAP_FAILED && cqRing != MAP_FAILED && sqes != MAP_FAILED;
+}
+
+void UringReader::readExtents(vector<Extent>& extents) {
+    // Bytes read so far for each extent. Short reads are resubmitted for the remainder.
+    vector<size_t> progress(extents.size(), 0);
+    vector<size_t> resubmit;
+    size_t next = 0, completed = 0;
+    unsigned inFlight = 0;
+
+    while (completed < extents.size()) {
+        unsigned tail = *sqTail;
+        unsigned toSubmit = 0;
+        while (inFlight < queueDepth && (!resubmit.empty() || next < extents.size())) {
+            size_t index;
+            if (resubmit.empty()) {
+                index = next++;
+            } else {
+                index = resubmit.back();
+                resubmit.pop_back();
+            }
+            auto& extent = extents[index];
+            unsigned slot = tail & *sqMask;
+            auto sqe = &sqes[slot];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->off = extent.offset + progress[index];
+            sqe->addr = (unsigned long) (extent.dest + progress[index]);
+            // Lengths are 32-bit; anything larger completes as a short read and is resubmitted
+            sqe->len = min<size_t>(extent.length - progress[index], 1u << 30);
+            sqe->user_data = index;
+            sqArray[slot] = slot;
+            tail++;
+            toSubmit++;
+            inFlight++;
+        }
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+        if (syscall(__NR_io_uring_enter, ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("io_uring_enter failed");
+        }
+
+        unsigned head = *cqHead;
+        while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            auto& cqe = cqes[head & *cqMask];
+            size_t index = cqe.user_data;
+            if (cqe.res <= 0) {
+                throw runtime_error(fmt::format("io_uring read failed at offset {}", extents[index].offset + progress[index]));
+            }
+            progress[index] += cqe.res;
+            inFlight--;
+            if (progress[index] < extents[index].length) {
+                resubmit.push_back(index);
+            } else {
+                completed++;
+            }
+            head++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+PoolReader::PoolReader(const string& filename, const DataSet& dataSet, unsigned queueDepth)
+    : PreadReader(filename, dataSet), queueDepth(max(1u, queueDepth)) {
+}
+
+string PoolReader::name() const {
+    return backendName(Backend::Pool);
+}
+
+void PoolReader::readExtents(vector<Extent>& extents) {
+    // The OpenMP worker threads act as the pool, each issuing blocking preads
+    atomic<bool> failed(false);
+#pragma omp parallel for num_threads(queueDepth) schedule(dynamic, 16)
+    for (auto i = 0; i < extents.size(); i++) {
+        if (!readExtent(extents[i])) {
+            failed = true;
+        }
+    }
+    if (failed) {
+        throw runtime_error("pread failed");
+    }
+}
+
+DecodeReader::DecodeReader(const DataSet& dataSet) : dataSet(dataSet), fillValue(0) {
+    auto dataSpace = dataSet.getSpace();
+    dims.resize(dataSpace.getSimpleExtentNdims());
+    dataSpace.getSimpleExtentDims(dims.data(), nullptr);
+    auto createProperties = dataSet.getCreatePlist();
+    chunkDims.resize(dims.size());
+    createProperties.getChunk(chunkDims.size(), chunkDims.data());
+    chunkBytes = sizeof(float);
+    for (auto dim : chunkDims) {
+        chunkBytes *= dim;
+    }
+    for (auto i = 0; i < createProperties.getNfilters(); i++) {
+        unsigned flags, filterConfig;
+        size_t numValues = 0;
+        char filterName[64];
+        filters.push_back(createProperties.getFilter(i, flags, numValues, nullptr, sizeof(filterName), filterName, filterConfig));
+    }
+    if (createProperties.isFillValueDefined() != H5D_FILL_VALUE_UNDEFINED) {
+        createProperties.getFillValue(PredType::NATIVE_FLOAT, &fillValue);
+    }
+}
+
+string DecodeReader::name() const {
+    return backendName(Backend::Decode);
+}
+
+bool DecodeReader::supports(const DataSet& dataSet, string& reason) {
+    auto createProperties = dataSet.getCreatePlist();
+    if (createProperties.getLayout() != H5D_CHUNKED) {
+        reason = "only chunked datasets are supported";
+        return false;
+    }
+    if (!(dataSet.getDataType() == PredType::NATIVE_FLOAT)) {
+        reason = "the data type is not native float32";
+        return false;
+    }
+    for (auto i = 0; i < createProperties.getNfilters(); i++) {
+        unsigned flags, filterConfig;
+        size_t numValues = 0;
+        char filterName[64];
+        auto filter = createProperties.getFilter(i, flags, numValues, nullptr, sizeof(filterName), filterName, filterConfig);
+        if (filter != H5Z_FILTER_SHUFFLE && filter != H5Z_FILTER_DEFLATE && filter != H5Z_FILTER_FLETCHER32) {
+            reason = fmt::format("filter {} ({}) can only be decoded through HDF5", filter, filterName);
+            return false;
+        }
+    }
+    return true;
+}
+
+const unsigned char* DecodeReader::decodeChunk(const vector<unsigned char>& stored, unsigned filterMask, unsigned char* scratch[2]) {
+    const unsigned char* data = stored.data();
+    size_t size = stored.size();
+    int next = 0;
+    for (int i = int(filters.size()) - 1; i >= 0; i--) {
+        // Filters skipped when the chunk was written (optional filters that failed) have their bit set in the mask
+        if (filterMask & (1u << i)) {
+            continue;
+        }
+        if (filters[i] == H5Z_FILTER_FLETCHER32) {
+            // The checksum is appended to the chunk, and is not verified
+            if (size < 4) {
+                return nullptr;
+            }
+            size -= 4;
+        } else if (filters[i] == H5Z_FILTER_DEFLATE) {
+            uLongf length = chunkBytes;
+            if (uncompress(scratch[next], &length, data, size) != Z_OK) {
+                return nullptr;
+            }
+            data = scratch[next];
+            size = length;
+            next ^= 1;
+        } else if (filters[i] == H5Z_FILTER_SHUFFLE) {
+            if (size > chunkBytes) {
+                return nullptr;
+            }
+            // Bytes are stored grouped by their position in the element; each output element gathers one from each group
+            size_t n = size / sizeof(float);
+            const unsigned char* planes[4] = {data, data + n, data + 2 * n, data + 3 * n};
+            unsigned char* out = scratch[next];
+            for (size_t k = 0; k < n; k++) {
+                out[4 * k] = planes[0][k];
+                out[4 * k + 1] = planes[1][k];
+                out[4 * k + 2] = planes[2][k];
+                out[4 * k + 3] = planes[3][k];
+            }
+            memcpy(out + n * sizeof(float), data + n * sizeof(float), size - n * sizeof(float));
+            data = out;
+            next ^= 1;
+        }
+    }
+    return size == chunkBytes ? data : nullptr;
+}
+
+void DecodeReader::read(const vector<hsize_t>& start, const vector<hsize_t>& count, float* dest) {
+    auto t0 = Clock::now();
+    checkSelection(dims, start, count, {});
+    int rank = dims.size();
+    vector<hsize_t> firstChunk(rank), lastChunk(rank);
+    for (auto i = 0; i < rank; i++) {
+        firstChunk[i] = start[i] / chunkDims[i];
+        lastChunk[i] = (start[i] + count[i] - 1) / chunkDims[i];
+    }
+
+    // The stored bytes of every chunk the selection touches (none for unallocated chunks)
+    struct StoredChunk {
+        vector<hsize_t> origin;
+        vector<unsigned char> bytes;
+        unsigned filterMask;
+    };
+    vector<StoredChunk> chunks;
+    double readSeconds = 0;
+    vector<hsize_t> chunk(firstChunk);
+    while (true) {
+        StoredChunk stored = {vector<hsize_t>(rank), {}, 0};
+        hsize_t chunkIndex = 0;
+        for (auto i = 0; i < rank; i++) {
+            stored.origin[i] = chunk[i] * chunkDims[i];
+            chunkIndex = chunkIndex * ((dims[i] + chunkDims[i] - 1) / chunkDims[i]) + chunk[i];
+        }
+        auto it = chunkSizes.find(chunkIndex);
+        if (it == chunkSizes.end()) {
+            unsigned filterMask;
+            haddr_t address;
+            hsize_t size;
+            if (H5Dget_chunk_info_by_coord(dataSet.getId(), stored.origin.data(), &filterMask, &address, &size) < 0) {
+                throw runtime_error("Chunk index lookup failed");
+            }
+            it = chunkSizes.emplace(chunkIndex, address == HADDR_UNDEF ? 0 : size).first;
+        }
+        if (it->second) {
+            auto tRead = Clock::now();
+            stored.bytes.resize(it->second);
+            if (H5Dread_chunk(dataSet.getId(), H5P_DEFAULT, stored.origin.data(), &stored.filterMask, stored.bytes.data()) < 0) {
+                throw runtime_error("Raw chunk read failed");
+            }
+            readSeconds += secondsBetween(tRead, Clock::now());
+            compressedBytes += stored.bytes.size();
+            decodedBytes += chunkBytes;
+        }
+        chunks.push_back(move(stored));
+        chunksTouched++;
+
+        int i = rank - 1;
+        while (i >= 0 && ++chunk[i] > lastChunk[i]) {
+            chunk[i] = firstChunk[i];
+            i--;
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+
+    auto tDecode = Clock::now();
+    vector<hsize_t> chunkStrides(rank, 1), selectionStrides(rank, 1);
+    for (auto i = rank - 2; i >= 0; i--) {
+        chunkStrides[i] = chunkStrides[i + 1] * chunkDims[i + 1];
+        selectionStrides[i] = selectionStrides[i + 1] * count[i + 1];
+    }
+    atomic<bool> failed(false);
+#pragma omp parallel
+    {
+        vector<unsigned char> buffers(2 * chunkBytes);
+        unsigned char* scratch[2] = {buffers.data(), buffers.data() + chunkBytes};
+        vector<hsize_t> low(rank), high(rank), position(rank);
+#pragma omp for schedule(dynamic)
+        for (long long c = 0; c < (long long) chunks.size(); c++) {
+            auto& stored = chunks[c];
+            const float* values = nullptr;
+            if (!stored.bytes.empty()) {
+                values = (const float*) decodeChunk(stored.bytes, stored.filterMask, scratch);
+                if (!values) {
+                    failed = true;
+                    continue;
+                }
+            }
+
+            // Copy each row of the intersection of the chunk and the selection along the fastest-varying dimension
+            for (auto i = 0; i < rank; i++) {
+                low[i] = max(start[i], stored.origin[i]);
+                high[i] = min(start[i] + count[i], stored.origin[i] + chunkDims[i]);
+            }
+            size_t runElements = high[rank - 1] - low[rank - 1];
+            position = low;
+            while (true) {
+                hsize_t chunkElement = 0, destElement = 0;
+                for (auto i = 0; i < rank; i++) {
+                    chunkElement += (position[i] - stored.origin[i]) * chunkStrides[i];
+                    destElement += (position[i] - start[i]) * selectionStrides[i];
+                }
+                if (values) {
+                    memcpy(dest + destElement, values + chunkElement, runElements * sizeof(float));
+                } else {
+                    // Unallocated chunks read as the fill value, as they would through HDF5
+                    fill(dest + destElement, dest + destElement + runElements, fillValue);
+                }
+
+                int i = rank - 2;
+                while (i >= 0 && ++position[i] == high[i]) {
+                    position[i] = low[i];
+                    i--;
+                }
+                if (i < 0) {
+                    break;
+                }
+            }
+        }
+    }
+    if (failed) {
+        throw runtime_error("Could not decompress a chunk");
+    }
+
+    auto tEnd = Clock::now();
+    setupSeconds += secondsBetween(t0, tDecode) - readSeconds;
+    transferSeconds += readSeconds;
+    decodeSeconds += secondsBetween(tDecode, tEnd);
+}
+
+void DecodeReader::readStrided(const vector<hsize_t>& start, const vector<hsize_t>& count, const vector<hsize_t>& stride, float* dest) {
+    int rank = dims.size();
+    vector<hsize_t> spanCount(rank), spanStrides(rank, 1);
+    size_t spanElements = 1;
+    for (auto i = 0; i < rank; i++) {
+        spanCount[i] = (count[i] - 1) * stride[i] + 1;
+        spanElements *= spanCount[i];
+    }
+    for (auto i = rank - 2; i >= 0; i--) {
+        spanStrides[i] = spanStrides[i + 1] * spanCount[i + 1];
+    }
+    span.resize(spanElements);
+    read(start, spanCount, span.data());
+
+    auto t0 = Clock::now();
+    vector<hsize_t> position(rank, 0);
+    size_t out = 0;
+    while (true) {
+        size_t offset = 0;
+        for (auto i = 0; i < rank - 1; i++) {
+            offset += position[i] * stride[i] * spanStrides[i];
+        }
+        for (hsize_t k = 0; k < count[rank - 1]; k++) {
+            dest[out++] = span[offset + k * stride[rank - 1]];
+        }
+        int i = rank - 2;
+        while (i >= 0 && ++position[i] == count[i]) {
+            position[i] = 0;
+            i--;
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+    setupSeconds += secondsBetween(t0, Clock::now());
+}
+
+unique_ptr<DataReader> createReader(Backend backend, const string& filename, const DataSet& dataSet, unsigned queueDepth) {
+    if (backend == Backend::Hdf5) {
+        return unique_ptr<DataReader>(new Hdf5Reader(dataSet));
+    }
+
+    string reason;
+    if (backend == Backend::Decode) {
+        // Contiguous datasets (e.g. mipmaps) cannot be filtered, so they are read through HDF5 as they are
+        if (dataSet.getCreatePlist().getLayout() == H5D_CONTIGUOUS) {
+            return unique_ptr<DataReader>(new Hdf5Reader(dataSet));
+        }
+        if (!DecodeReader::supports(dataSet, reason)) {
+            fmt::print("The {} backend cannot read this dataset: {}.\n", backendName(backend), reason);
+            return nullptr;
+        }
+        return unique_ptr<DataReader>(new DecodeReader(dataSet));
+    }
+    if (!RawReader::supports(dataSet, reason)) {
+        fmt::print("The {} backend cannot read this dataset: {}.\n", backendName(backend), reason);
+        return nullptr;
+    }
+
+    if (backend == Backend::Mmap) {
+        auto reader = new MmapReader(filename, dataSet);
+        if (reader->valid()) {
+            return unique_ptr<DataReader>(reader);
+        }
+        delete reader;
+    } else if (backend == Backend::Pread) {
+        auto reader = new PreadReader(filename, dataSet);
+        if (reader->valid()) {
+            return unique_ptr<DataReader>(reader);
+        }
+        delete reader;
+    } else if (backend == Backend::Direct) {
+        auto reader = new DirectReader(filename, dataSet);
+        if (reader->valid()) {
+            return unique_ptr<DataReader>(reader);
+        }
+        delete reader;
+    } else if (backend == Backend::Uring) {
+        auto reader = new UringReader(filename, dataSet, queueDepth);
+        if (reader->valid()) {
+            return unique_ptr<DataReader>(reader);
+        }
+        delete reader;
+        fmt::print("io_uring is not available; falling back to a pool of {} pread threads.\n", queueDepth);
+        backend = Backend::Pool;
+    }
+    if (backend == Backend::Pool) {
+        auto reader = new PoolReader(filename, dataSet, queueDepth);
+        if (reader->valid()) {
+            return unique_ptr<DataReader>(reader);
+        }
+        delete reader;
+    }
+    fmt::print("Could not open {} for the {} backend.\n", filename, backendName(backend));
+    return nullptr;
+}
@@ -0,0 +1,235 @@
+#ifndef ADASS_HDF5_BENCHMARK_READER_H
+#define ADASS_HDF5_BENCHMARK_READER_H
+
+#include <H5Cpp.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class Backend {
+    Hdf5,
+    Mmap,
+    Pread,
+    Direct,
+    Uring,
+    Pool,
+    Decode
+};
+
+bool parseBackend(const std::string& name, Backend& backend);
+std::string backendName(Backend backend);
+
+// Reads hyperslabs of a float32 dataset. Selections follow the HDF5 convention of a start and count
+// per dimension (slowest-varying first), and are written to dest in row-major order.
+class DataReader {
+public:
+    virtual ~DataReader() = default;
+    // Name of the backend actually in use, which may differ from the one requested after a fallback
+    virtual std::string name() const = 0;
+    virtual void read(const std::vector<hsize_t>& start, const std::vector<hsize_t>& count, float* dest) = 0;
+    // Reads every stride-th element of each dimension, as selected by a strided HDF5 hyperslab.
+    // count is the number of elements read in each dimension, not the extent they span.
+    virtual void readStrided(const std::vector<hsize_t>& start, const std::vector<hsize_t>& count,
+                             const std::vector<hsize_t>& stride, float* dest) = 0;
+
+    // Number of chunk visits by the selections read so far (always 0 for contiguous datasets)
+    size_t chunksTouched = 0;
+    // Time spent so far translating selections (hyperslab setup, or extent lists and chunk index lookups)
+    // and transferring the data (the library read, or reading the extents)
+    double setupSeconds = 0;
+    double transferSeconds = 0;
+    // Time spent so far decompressing chunks, and their stored and decompressed bytes (decode backend only)
+    double decodeSeconds = 0;
+    size_t compressedBytes = 0;
+    size_t decodedBytes = 0;
+};
+
+class Hdf5Reader : public DataReader {
+public:
+    Hdf5Reader(const H5::DataSet& dataSet);
+    std::string name() const override;
+    void read(const std::vector<hsize_t>& start, const std::vector<hsize_t>& count, float* dest) override;
+    void readStrided(const std::vector<hsize_t>& start, const std::vector<hsize_t>& count,
+                     const std::vector<hsize_t>& stride, float* dest) override;
+
+private:
+    void countChunks(const std::vector<hsize_t>& start, const std::vector<hsize_t>& span);
+
+    H5::DataSet dataSet;
+    std::vector<hsize_t> chunkDims;
+};
+
+// A contiguous byte range in the file and its destination in memory
+struct Extent {
+    hsize_t offset;
+    size_t length;
+    char* dest;
+};
+
+// Reads the dataset's bytes from the file directly, bypassing the HDF5 library. Contiguous datasets
+// are located with DataSet::getOffset(), chunked datasets through a lookup in the chunk index.
+// Selections are translated into a list of extents, which the derived classes read. Selections outside the dataset
+// throw, as they do through HDF5.
+class RawReader : public DataReader {
+public:
+    RawReader(const std::string& filename, const H5::DataSet& dataSet);
+    void read(const std::vector<hsize_t>& start, const std::vector<hsize_t>& count, float* dest) override;
+    // Skipped rows (and planes) are not read at all. Selected rows are read over the span of the selection and
+    // decimated in memory, since reading single elements would cost one extent each.
+    void readStrided(const std::vector<hsize_t>& start, const std::vector<hsize_t>& count,
+                     const std::vector<hsize_t>& stride, float* dest) override;
+
+    // Checks that the dataset is uncompressed, native float32 and either contiguous or chunked
+    static bool supports(const H5::DataSet& dataSet, std::string& reason);
+
+protected:
+    virtual void readExtents(std::vector<Extent>& extents) = 0;
+
+private:
+    void readContiguous(const std::vector<hsize_t>& start, const std::vector<hsize_t>& count, float* dest);
+    void readChunked(const std::vector<hsize_t>& start, const std::vector<hsize_t>& count, float* dest);
+    haddr_t chunkAddress(const std::vector<hsize_t>& chunkOrigin);
+    void addExtent(hsize_t offset, size_t length, char* dest);
+    void flushExtents();
+
+    H5::DataSet dataSet;
+    std::vector<hsize_t> dims;
+    std::vector<hsize_t> chunkDims;
+    haddr_t dataOffset;
+    float fillValue;
+    // Chunk index lookups are expensive, so addresses are remembered by linear chunk index
+    std::unordered_map<hsize_t, haddr_t> chunkAddresses;
+    std::vector<Extent> extents;
+    // Full spans of the selected rows of a strided read, before decimation
+    std::vector<float> stridedRows;
+};
+
+class MmapReader : public RawReader {
+public:
+    MmapReader(const std::string& filename, const H5::DataSet& dataSet);
+    ~MmapReader() override;
+    std::string name() const override;
+    bool valid() const;
+
+protected:
+    void readExtents(std::vector<Extent>& extents) override;
+
+private:
+    unsigned char* filePtr;
+    size_t filesize;
+};
+
+class PreadReader : public RawReader {
+public:
+    PreadReader(const std::string& filename, const H5::DataSet& dataSet, bool direct = false);
+    ~PreadReader() override;
+    std::string name() const override;
+    bool valid() const;
+
+protected:
+    void readExtents(std::vector<Extent>& extents) override;
+    // Reads the whole extent, retrying after short reads
+    bool readExtent(const Extent& extent);
+    int fd;
+};
+
+// O_DIRECT reads must be block-aligned in offset, length and buffer address, so extents are read through
+// an aligned bounce buffer. Neighbouring extents that share blocks are merged into a single read.
+class DirectReader : public PreadReader {
+public:
+    DirectReader(const std::string& filename, const H5::DataSet& dataSet);
+    ~DirectReader() override;
+    std::string name() const override;
+
+protected:
+    void readExtents(std::vector<Extent>& extents) override;
+
+private:
+    void loadWindow(hsize_t windowStart, hsize_t windowEnd, hsize_t requiredEnd);
+
+    char* buffer;
+    size_t bufferSize;
+};
+
+// Submits all extents of a selection (e.g. one read per channel for a Z-profile) to an io_uring instance,
+// keeping up to queueDepth reads in flight. The ring is driven with raw system calls, so liburing is not needed.
+class UringReader : public PreadReader {
+public:
+    UringReader(const std::string& filename, const H5::DataSet& dataSet, unsigned queueDepth);
+    ~UringReader() override;
+    std::string name() const override;
+    bool valid() const;
+
+protected:
+    void readExtents(std::vector<Extent>& extents) override;
+
+private:
+    unsigned queueDepth;
+    int ringFd;
+    void* sqRing;
+    void* cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+};
+
+// Issues blocking preads for the extents of a selection from a pool of queueDepth threads.
+// Used where io_uring is unavailable.
+class PoolReader : public PreadReader {
+public:
+    PoolReader(const std::string& filename, const H5::DataSet& dataSet, unsigned queueDepth);
+    std::string name() const override;
+
+protected:
+    void readExtents(std::vector<Extent>& extents) override;
+
+private:
+    unsigned queueDepth;
+};
+
+// Reads the stored bytes of each chunk a selection touches with H5Dread_chunk, and undoes their filters (shuffle,
+// deflate and fletcher32) on parallel threads, instead of through HDF5's serial filter pipeline. Reading the chunks
+// takes the library lock, so only the decompression and the copy into the selection run in parallel.
+class DecodeReader : public DataReader {
+public:
+    DecodeReader(const H5::DataSet& dataSet);
+    std::string name() const override;
+    void read(const std::vector<hsize_t>& start, const std::vector<hsize_t>& count, float* dest) override;
+    // Reads the span of the selection and decimates it in memory
+    void readStrided(const std::vector<hsize_t>& start, const std::vector<hsize_t>& count,
+                     const std::vector<hsize_t>& stride, float* dest) override;
+
+    // Checks that the dataset is chunked, native float32 and uses only the filters decoded here
+    static bool supports(const H5::DataSet& dataSet, std::string& reason);
+
+private:
+    // Undoes the filters of a stored chunk in reverse order, returning its decompressed bytes, which are either the
+    // stored bytes or in one of the two scratch buffers
+    const unsigned char* decodeChunk(const std::vector<unsigned char>& stored, unsigned filterMask, unsigned char* scratch[2]);
+
+    H5::DataSet dataSet;
+    std::vector<hsize_t> dims;
+    std::vector<hsize_t> chunkDims;
+    size_t chunkBytes;
+    // Filters in the order they were applied when writing
+    std::vector<H5Z_filter_t> filters;
+    float fillValue;
+    // Stored sizes of the chunks by linear chunk index (0 if unallocated), as lookups are expensive
+    std::unordered_map<hsize_t, hsize_t> chunkSizes;
+    std::vector<float> span;
+};
+
+// Returns nullptr (after printing the reason) if the backend cannot read the dataset
+std::unique_ptr<DataReader> createReader(Backend backend, const std::string& filename, const H5::DataSet& dataSet,
+                                         unsigned queueDepth = 32);
+
+#endif //ADASS_HDF5_BENCHMARK_READER_H
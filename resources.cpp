@@ -0,0 +1,82 @@
+#include "resources.h"
+
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+double peakResidentMb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // ru_maxrss is reported in kilobytes on Linux
+    return usage.ru_maxrss / 1024.0;
+}
+
+ResourceUsage resourceUsage() {
+    ResourceUsage usage;
+    auto file = fopen("/proc/self/io", "r");
+    if (file) {
+        char name[64];
+        long long val;
+        while (fscanf(file, "%63[^:]: %lld\n", name, &val) == 2) {
+            if (!strcmp(name, "rchar")) {
+                usage.readChars = val;
+            } else if (!strcmp(name, "syscr")) {
+                usage.readCalls = val;
+            } else if (!strcmp(name, "read_bytes")) {
+                usage.storageBytes = val;
+            }
+        }
+        fclose(file);
+    }
+
+    struct rusage self;
+    getrusage(RUSAGE_SELF, &self);
+    usage.majorFaults = self.ru_majflt;
+    usage.minorFaults = self.ru_minflt;
+    usage.voluntarySwitches = self.ru_nvcsw;
+    usage.involuntarySwitches = self.ru_nivcsw;
+    usage.userSeconds = self.ru_utime.tv_sec + self.ru_utime.tv_usec * 1.0e-6;
+    usage.systemSeconds = self.ru_stime.tv_sec + self.ru_stime.tv_usec * 1.0e-6;
+    return usage;
+}
+
+static int openCounter(unsigned long long config, int groupFd) {
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.size = sizeof(attributes);
+    attributes.config = config;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.inherit = 1;
+    return syscall(SYS_perf_event_open, &attributes, 0, -1, groupFd, 0);
+}
+
+PerfCounters::PerfCounters() : missesFd(-1) {
+    leaderFd = openCounter(PERF_COUNT_HW_CACHE_REFERENCES, -1);
+    if (leaderFd >= 0) {
+        missesFd = openCounter(PERF_COUNT_HW_CACHE_MISSES, leaderFd);
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    if (missesFd >= 0) {
+        close(missesFd);
+    }
+    if (leaderFd >= 0) {
+        close(leaderFd);
+    }
+}
+
+bool PerfCounters::valid() const {
+    return leaderFd >= 0 && missesFd >= 0;
+}
+
+bool PerfCounters::read(long long& references, long long& misses) const {
+    return valid() && ::read(leaderFd, &references, sizeof(references)) == sizeof(references)
+           && ::read(missesFd, &misses, sizeof(misses)) == sizeof(misses);
+}
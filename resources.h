@@ -0,0 +1,37 @@
+#ifndef ADASS_HDF5_BENCHMARK_RESOURCES_H
+#define ADASS_HDF5_BENCHMARK_RESOURCES_H
+
+// Peak resident set size of this process so far, in MB
+double peakResidentMb();
+
+// Cumulative resource use of this process (all threads), from /proc/self/io and getrusage
+struct ResourceUsage {
+    // rchar, syscr and read_bytes from /proc/self/io: bytes requested through read system calls, the number of
+    // those calls, and bytes actually fetched from storage. -1 if /proc/self/io is unavailable.
+    long long readChars = -1;
+    long long readCalls = -1;
+    long long storageBytes = -1;
+    long majorFaults = 0, minorFaults = 0;
+    long voluntarySwitches = 0, involuntarySwitches = 0;
+    double userSeconds = 0, systemSeconds = 0;
+};
+
+ResourceUsage resourceUsage();
+
+// Hardware cache reference and miss counters of the calling thread, and of threads it creates after they
+// are opened, once those threads exit. Kernel activity is excluded. Unavailable without a PMU, or when
+// perf_event_paranoid forbids it.
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+    bool valid() const;
+    // Counts so far; false if they could not be read
+    bool read(long long& references, long long& misses) const;
+
+private:
+    int leaderFd;
+    int missesFd;
+};
+
+#endif //ADASS_HDF5_BENCHMARK_RESOURCES_H
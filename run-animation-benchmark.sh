@@ -0,0 +1,15 @@
+#!/bin/bash
+
+# Runs the channel animation trials with a range of read-ahead depths, both at a fixed frame rate and
+# as fast as possible. Usage: run-animation-benchmark.sh <filename> [backend]
+
+x=$1
+backend=${2:-hdf5}
+
+for p in 0 1 2 4 8
+do
+    for fps in 30 0
+    do
+        ./cmake-build-release/adass_hdf5_benchmark $x --trials 27-29 --iterations 5 --backend $backend --prefetch $p --fps $fps --format csv > $x.anim-$backend-p$p-fps$fps.csv
+    done
+done
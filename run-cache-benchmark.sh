@@ -0,0 +1,10 @@
+#!/bin/bash
+
+# Cold and warm runs of the ADASS trials without root: only the benchmarked file is evicted from the page cache
+
+filenames=$@
+
+for x in $filenames
+do
+    ./cmake-build-release/adass_hdf5_benchmark $x --trials 0-10,13 --iterations 10 --cache both --format json > ~/benchmarks/${x##*/}.cache.json
+done
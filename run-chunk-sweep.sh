@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# Generates a cube for each chunk shape and runs the XY, XZ, YZ, Z-profile and region trials on each
+# with a range of HDF5 chunk cache sizes. Usage: run-chunk-sweep.sh <width,height,depth> <chunk shape>...
+
+dims=$1
+shift
+chunks=$@
+
+for c in $chunks
+do
+    x=~/benchmarks/sweep-${dims//,/-}-${c//,/-}.hdf5
+    ./cmake-build-release/adass_hdf5_benchmark $x --generate --dims $dims --chunks $c --no-swizzle
+    ./cmake-build-release/adass_hdf5_benchmark $x --trials 0,13,1,3,7 --iterations 10 --cache both --chunk-cache 1,4,16,64,256 --format csv > $x.sweep.csv
+    rm $x
+done
@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# Generates a cube with each compression and runs the XY, Z-profile and region trials on it, through the HDF5
+# filter pipeline and through parallel raw chunk decoding. Usage: run-compression-benchmark.sh <width,height,depth> <chunk shape>
+
+dims=$1
+chunks=$2
+
+for z in none shuffle+deflate:1 shuffle+deflate:4 deflate:6
+do
+    x=~/benchmarks/compression-${dims//,/-}-${z//[:+]/-}.hdf5
+    if [ $z == none ]
+    then
+        ./cmake-build-release/adass_hdf5_benchmark $x --generate --dims $dims --chunks $chunks --pattern waves --no-swizzle
+    else
+        ./cmake-build-release/adass_hdf5_benchmark $x --generate --dims $dims --chunks $chunks --pattern waves --no-swizzle --compression $z
+    fi
+    for b in hdf5 decode
+    do
+        ./cmake-build-release/adass_hdf5_benchmark $x --trials 0,3,5,7,9 --iterations 10 --cache both --backend $b --format csv > $x.$b.csv
+    done
+    rm $x
+done
@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# Runs a request mix with a growing number of client threads in one process, and then with the same number
+# of single-client processes, for each backend. Usage: run-load-benchmark.sh <filename> [rate] [mix]
+
+x=$1
+rate=${2:-0}
+mix=${3:-xy,yz,z:4,region:2,downsample}
+levels="1 2 4 8 16"
+
+for backend in hdf5 mmap pread
+do
+    ./cmake-build-release/adass_hdf5_benchmark $x --load $mix --clients ${levels// /,} --rate $rate --backend $backend --format csv > $x.load-$backend-threads.csv
+    for n in $levels
+    do
+        # Each process is offered an equal share of the rate
+        for p in $(seq $n)
+        do
+            ./cmake-build-release/adass_hdf5_benchmark $x --load $mix --clients 1 --rate $(echo "$rate / $n" | bc -l) --backend $backend --seed $p --format csv > $x.load-$backend-processes-$n-$p.csv &
+        done
+        wait
+    done
+done
@@ -1,16 +1,13 @@
 #!/bin/bash
 
+# Pyramid reads from 0/MipMaps (12 at x8, 14 at x32) against down-sampling the full image on the fly (11 at x8,
+# and 15-17 on 4096, 2048 and 1024 pixel regions), cold and warm. The mipmaps are built once per file first, so
+# the MIP trials read real pyramid levels rather than the emulated corner.
+
 filenames=$@
 
-for i in {0..9}
+for x in $filenames
 do
-    for b in 0 14 15 16 17
-    do
-        for x in $filenames
-        do
-            sync; sudo sh -c 'echo 1 > /proc/sys/vm/drop_caches'
-            sleep 2
-            ./cmake-build-release/adass_hdf5_benchmark $x $b > ~/benchmarks/${x##*/}.benchmark$b.$i
-        done
-    done
+    ./cmake-build-release/adass_hdf5_benchmark $x --build-mips --max-mip 32 || exit 1
+    ./cmake-build-release/adass_hdf5_benchmark $x --trials 12,14,11,15-17 --iterations 10 --cache both --format json > ~/benchmarks/${x##*/}.mipmap.json
 done
@@ -0,0 +1,20 @@
+#!/bin/bash
+
+# Replays the same trace against each file (e.g. the same cube with different chunk shapes) with each backend.
+# The trace is recorded from the first file if it does not exist. Usage: run-replay-benchmark.sh <trace> <filename>...
+
+trace=$1
+shift
+
+if [ ! -f $trace ]
+then
+    ./cmake-build-release/adass_hdf5_benchmark $1 --record-trace $trace --load xy,yz,z:4,region:2,downsample --requests 2000 --rate 50 --seed 1
+fi
+
+for x in $@
+do
+    for backend in hdf5 mmap pread
+    do
+        ./cmake-build-release/adass_hdf5_benchmark $x --replay $trace --backend $backend --cache both --format csv > $x.replay-$backend.csv
+    done
+done
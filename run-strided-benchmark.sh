@@ -0,0 +1,14 @@
+#!/bin/bash
+
+# Nearest-neighbour down-sampling at x4, x8 and x16: strided selections (22-24) against reading the
+# full image and subsampling it in memory (25, 18, 26). Pass files with different chunk shapes to compare layouts.
+
+filenames=$@
+
+for x in $filenames
+do
+    for b in hdf5 mmap pread
+    do
+        ./cmake-build-release/adass_hdf5_benchmark $x --trials 22,25,23,18,24,26 --iterations 10 --cache both --backend $b --format json > ~/benchmarks/${x##*/}.strided.$b.json
+    done
+done
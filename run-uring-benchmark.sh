@@ -0,0 +1,14 @@
+#!/bin/bash
+
+# Z-profile and YZ-slice reads on the main dataset with batched asynchronous I/O, compared with
+# the HDF5, mmap and swizzled variants. Cold and warm passes run back to back in one process.
+
+filenames=$@
+
+for x in $filenames
+do
+    for b in hdf5 mmap pool uring
+    do
+        ./cmake-build-release/adass_hdf5_benchmark $x --trials 1,2,3,4 --iterations 10 --cache both --backend $b --queue-depth 64 --format json > ~/benchmarks/${x##*/}.uring.$b.json
+    done
+done
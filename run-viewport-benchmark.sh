@@ -0,0 +1,15 @@
+#!/bin/bash
+
+# Runs the viewport tile trials with every tile encoding at a range of zoom levels and tile sizes, each against
+# the float32 full-plane path. Usage: run-viewport-benchmark.sh <filename> [backend]
+
+x=$1
+backend=${2:-hdf5}
+
+for mip in 1 2 4 8
+do
+    for t in 128 256 512
+    do
+        ./cmake-build-release/adass_hdf5_benchmark $x --trials 54-57 --iterations 10 --backend $backend --viewport-mip $mip --tile-size $t --format csv > $x.viewport-$backend-x$mip-t$t.csv
+    done
+done
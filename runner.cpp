@@ -0,0 +1,258 @@
+#include "runner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <numeric>
+#include <sstream>
+#include <fmt/format.h>
+
+using namespace std;
+
+bool parseOutputFormat(const string& name, OutputFormat& format) {
+    if (name == "text") {
+        format = OutputFormat::Text;
+    } else if (name == "json") {
+        format = OutputFormat::Json;
+    } else if (name == "csv") {
+        format = OutputFormat::Csv;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+vector<int> parseTrialList(const string& list) {
+    // Comma-separated trial IDs, with optional inclusive ranges: "0,3,5-10"
+    vector<int> ids;
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+        auto dash = item.find('-', 1);
+        if (dash == string::npos) {
+            ids.push_back(atoi(item.c_str()));
+        } else {
+            int first = atoi(item.substr(0, dash).c_str());
+            int last = atoi(item.substr(dash + 1).c_str());
+            for (auto i = first; i <= last; i++) {
+                ids.push_back(i);
+            }
+        }
+    }
+    return ids;
+}
+
+static void appendValues(vector<pair<string, vector<double>>>& samples, const vector<pair<string, double>>& values) {
+    for (auto& value : values) {
+        auto it = find_if(samples.begin(), samples.end(),
+                          [&value](const pair<string, vector<double>>& entry) { return entry.first == value.first; });
+        if (it == samples.end()) {
+            samples.push_back({value.first, {}});
+            it = samples.end() - 1;
+        }
+        it->second.push_back(value.second);
+    }
+}
+
+void recordMetrics(TrialSamples& samples, const TrialResult& result) {
+    appendValues(samples.metrics, result.metrics);
+    appendValues(samples.counters, result.counters);
+}
+
+static vector<pair<string, double>> medians(const vector<pair<string, vector<double>>>& samples) {
+    vector<pair<string, double>> values;
+    for (auto& entry : samples) {
+        vector<double> sorted(entry.second);
+        sort(sorted.begin(), sorted.end());
+        values.push_back({entry.first, percentile(sorted, 50)});
+    }
+    return values;
+}
+
+double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return NAN;
+    }
+    double rank = p / 100.0 * (sorted.size() - 1);
+    size_t lower = floor(rank);
+    size_t upper = min(lower + 1, sorted.size() - 1);
+    double fraction = rank - lower;
+    return sorted[lower] + fraction * (sorted[upper] - sorted[lower]);
+}
+
+TrialSummary summarise(const TrialSamples& samples) {
+    vector<double> sorted(samples.ms);
+    sort(sorted.begin(), sorted.end());
+    double totalMs = accumulate(sorted.begin(), sorted.end(), 0.0);
+    double totalBytes = accumulate(samples.bytes.begin(), samples.bytes.end(), 0.0);
+
+    TrialSummary summary;
+    summary.id = samples.id;
+    summary.name = samples.name;
+    summary.backend = samples.backend;
+    summary.cache = samples.cache;
+    summary.layout = samples.layout;
+    summary.chunkCache = samples.chunkCache;
+    summary.iterations = sorted.size();
+    summary.minMs = sorted.empty() ? NAN : sorted.front();
+    summary.maxMs = sorted.empty() ? NAN : sorted.back();
+    summary.meanMs = sorted.empty() ? NAN : totalMs / sorted.size();
+    summary.medianMs = percentile(sorted, 50);
+    summary.p95Ms = percentile(sorted, 95);
+    summary.p99Ms = percentile(sorted, 99);
+    // Aggregate throughput over all measured iterations (1 MB = 1e6 bytes)
+    summary.mbPerSec = totalMs > 0 ? (totalBytes * 1.0e-6) / (totalMs * 1.0e-3) : NAN;
+    summary.maxResidentPct = samples.residentAfterEviction.empty()
+                             ? NAN : *max_element(samples.residentAfterEviction.begin(), samples.residentAfterEviction.end()) * 100.0;
+    vector<double> sortedIo(samples.ioMs), sortedCompute(samples.computeMs);
+    sort(sortedIo.begin(), sortedIo.end());
+    sort(sortedCompute.begin(), sortedCompute.end());
+    summary.medianIoMs = percentile(sortedIo, 50);
+    summary.medianComputeMs = percentile(sortedCompute, 50);
+    double totalFileBytes = accumulate(samples.fileBytes.begin(), samples.fileBytes.end(), 0.0);
+    double totalChunks = accumulate(samples.chunksTouched.begin(), samples.chunksTouched.end(), 0.0);
+    summary.meanReadMb = samples.fileBytes.empty() ? NAN : totalFileBytes * 1.0e-6 / samples.fileBytes.size();
+    summary.chunkHitPct = NAN;
+    if (samples.chunkBytes && totalChunks > 0) {
+        double chunksRead = totalFileBytes / samples.chunkBytes;
+        summary.chunkHitPct = max(0.0, 1.0 - chunksRead / totalChunks) * 100.0;
+    }
+    summary.metrics = medians(samples.metrics);
+    summary.counters = medians(samples.counters);
+    return summary;
+}
+
+static string escapeJson(const string& s) {
+    string escaped;
+    for (auto c : s) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+string jsonNumber(double val, int precision) {
+    return isfinite(val) ? fmt::format("{:.{}f}", val, precision) : "null";
+}
+
+// Formats each median measurement with the given name/value pattern
+static string metricList(const vector<pair<string, double>>& values, const string& pattern, const string& separator) {
+    string list;
+    for (auto& metric : values) {
+        if (!list.empty()) {
+            list += separator;
+        }
+        list += fmt::format(fmt::runtime(pattern), metric.first, jsonNumber(metric.second, 3));
+    }
+    return list;
+}
+
+void printSummaries(const vector<TrialSummary>& summaries, OutputFormat format, unsigned int seed, int warmup) {
+    switch (format) {
+        case OutputFormat::Json: {
+            fmt::print("{{\"seed\": {}, \"warmup\": {}, \"trials\": [\n", seed, warmup);
+            for (auto i = 0; i < summaries.size(); i++) {
+                auto& s = summaries[i];
+                fmt::print("  {{\"id\": {}, \"name\": \"{}\", \"backend\": \"{}\", \"cache\": \"{}\", \"iterations\": {}, \"min_ms\": {}, \"median_ms\": {}, "
+                           "\"mean_ms\": {}, \"p95_ms\": {}, \"p99_ms\": {}, \"max_ms\": {}, \"mb_per_s\": {}, \"max_resident_pct\": {}, "
+                           "\"median_io_ms\": {}, \"median_compute_ms\": {}, \"layout\": \"{}\", \"chunk_cache\": \"{}\", "
+                           "\"read_mb\": {}, \"chunk_hit_pct\": {}, \"metrics\": {{{}}}, \"counters\": {{{}}}}}{}\n",
+                           s.id, escapeJson(s.name), s.backend, s.cache, s.iterations, jsonNumber(s.minMs, 3), jsonNumber(s.medianMs, 3),
+                           jsonNumber(s.meanMs, 3), jsonNumber(s.p95Ms, 3), jsonNumber(s.p99Ms, 3), jsonNumber(s.maxMs, 3),
+                           jsonNumber(s.mbPerSec, 2), jsonNumber(s.maxResidentPct, 2),
+                           jsonNumber(s.medianIoMs, 3), jsonNumber(s.medianComputeMs, 3), s.layout, s.chunkCache,
+                           jsonNumber(s.meanReadMb, 3), jsonNumber(s.chunkHitPct, 2), metricList(s.metrics, "\"{}\": {}", ", "),
+                           metricList(s.counters, "\"{}\": {}", ", "), i + 1 < summaries.size() ? "," : "");
+            }
+            fmt::print("]}}\n");
+            break;
+        }
+        case OutputFormat::Csv: {
+            fmt::print("id,name,backend,cache,iterations,min_ms,median_ms,mean_ms,p95_ms,p99_ms,max_ms,mb_per_s,max_resident_pct,"
+                       "median_io_ms,median_compute_ms,layout,chunk_cache,read_mb,chunk_hit_pct,metrics,counters\n");
+            for (auto& s : summaries) {
+                fmt::print("{},\"{}\",{},{},{},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{:.2f},{:.2f},{:.3f},{:.3f},{},{},{:.3f},{:.2f},\"{}\",\"{}\"\n",
+                           s.id, s.name, s.backend, s.cache, s.iterations, s.minMs, s.medianMs, s.meanMs, s.p95Ms, s.p99Ms, s.maxMs,
+                           s.mbPerSec, s.maxResidentPct, s.medianIoMs, s.medianComputeMs, s.layout, s.chunkCache, s.meanReadMb,
+                           s.chunkHitPct, metricList(s.metrics, "{}={}", ";"), metricList(s.counters, "{}={}", ";"));
+            }
+            break;
+        }
+        default: {
+            fmt::print("Seed {}, {} warmup iteration(s)\n", seed, warmup);
+            for (auto& s : summaries) {
+                fmt::print("[{}] {} ({}, {} cache): {} iterations; min {:.2f} ms, median {:.2f} ms, p95 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms; {:.2f} MB/s\n",
+                           s.id, s.name, s.backend, s.cache, s.iterations, s.minMs, s.medianMs, s.p95Ms, s.p99Ms, s.maxMs, s.mbPerSec);
+                if (isfinite(s.maxResidentPct)) {
+                    fmt::print("    up to {:.2f}% of the file remained cached after eviction\n", s.maxResidentPct);
+                }
+                if (isfinite(s.chunkHitPct)) {
+                    fmt::print("    {} chunks, {} chunk cache: {:.2f} MB read per iteration, ~{:.1f}% chunk cache hits\n", s.layout,
+                               s.chunkCache, s.meanReadMb, s.chunkHitPct);
+                }
+                if (!s.metrics.empty()) {
+                    fmt::print("    {}\n", metricList(s.metrics, "{} {}", ", "));
+                }
+                if (!s.counters.empty()) {
+                    fmt::print("    counters: {}\n", metricList(s.counters, "{} {}", ", "));
+                }
+                if (isfinite(s.medianIoMs)) {
+                    fmt::print("    median I/O {:.2f} ms, compute {:.2f} ms\n", s.medianIoMs, s.medianComputeMs);
+                }
+            }
+            break;
+        }
+    }
+}
+
+static string sweepColumn(const TrialSummary& s) {
+    return (s.cache == "none") ? fmt::format("[{}]", s.id) : fmt::format("[{}] {}", s.id, s.cache);
+}
+
+static string sweepRow(const TrialSummary& s) {
+    return fmt::format("{} / {}", s.layout, s.chunkCache);
+}
+
+void printSweepMatrix(const vector<TrialSummary>& summaries) {
+    // Columns are trials (and page cache states), in the order they were run
+    vector<string> columns, rows;
+    for (auto& s : summaries) {
+        auto column = sweepColumn(s);
+        auto row = sweepRow(s);
+        if (find(columns.begin(), columns.end(), column) == columns.end()) {
+            columns.push_back(column);
+        }
+        if (find(rows.begin(), rows.end(), row) == rows.end()) {
+            rows.push_back(row);
+        }
+    }
+    size_t rowWidth = 0;
+    for (auto& row : rows) {
+        rowWidth = max(rowWidth, row.size());
+    }
+
+    fmt::print("\nMedian latency (ms) by chunk shape / chunk cache and trial\n");
+    fmt::print("{:<{}}", "", rowWidth);
+    for (auto& column : columns) {
+        fmt::print(" {:>12}", column);
+    }
+    fmt::print("\n");
+    for (auto& row : rows) {
+        fmt::print("{:<{}}", row, rowWidth);
+        for (auto& column : columns) {
+            double val = NAN;
+            for (auto& s : summaries) {
+                if (sweepColumn(s) == column && sweepRow(s) == row) {
+                    val = s.medianMs;
+                }
+            }
+            fmt::print(" {:>12.2f}", val);
+        }
+        fmt::print("\n");
+    }
+}
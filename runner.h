@@ -0,0 +1,96 @@
+#ifndef ADASS_HDF5_BENCHMARK_RUNNER_H
+#define ADASS_HDF5_BENCHMARK_RUNNER_H
+
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+// Timing and size of a single trial iteration
+struct TrialResult {
+    std::string name;
+    double ms;
+    size_t bytes;
+    // I/O and compute parts of ms, for trials that time them separately
+    double ioMs = NAN;
+    double computeMs = NAN;
+    // Bytes read from the file through system calls (NaN if unknown), and chunk visits by the selections
+    double fileBytes = NAN;
+    double chunksTouched = 0;
+    // Trial-specific measurements (e.g. frame rate), summarised by their median
+    std::vector<std::pair<std::string, double>> metrics;
+    // Resource use measured around the trial (page faults, CPU time, time spent in the readers, ...)
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+// All measured (non-warmup) iterations of one trial
+struct TrialSamples {
+    int id;
+    std::string name;
+    std::string backend;
+    // Page cache state the samples were measured in: "none" (uncontrolled), "cold" or "warm"
+    std::string cache = "none";
+    // Chunk shape of the main dataset as x, y, z ("contiguous" if it is not chunked)
+    std::string layout = "contiguous";
+    // HDF5 chunk cache size and hash slots the datasets were opened with, e.g. "1MiB/521"
+    std::string chunkCache;
+    std::vector<double> ms;
+    std::vector<size_t> bytes;
+    std::vector<double> ioMs;
+    std::vector<double> computeMs;
+    // Bytes read from the file through system calls, and chunks visited by the selections, per iteration
+    std::vector<double> fileBytes;
+    std::vector<double> chunksTouched;
+    std::vector<std::pair<std::string, std::vector<double>>> metrics;
+    std::vector<std::pair<std::string, std::vector<double>>> counters;
+    // Size of one chunk of the main dataset, used to estimate chunk cache misses (0 if it is contiguous or
+    // does not fit in the chunk cache)
+    size_t chunkBytes = 0;
+    // Fraction of the file still resident in the page cache after each eviction (cold samples only)
+    std::vector<double> residentAfterEviction;
+};
+
+struct TrialSummary {
+    int id;
+    std::string name;
+    std::string backend;
+    std::string cache;
+    std::string layout;
+    std::string chunkCache;
+    size_t iterations;
+    double minMs, medianMs, meanMs, p95Ms, p99Ms, maxMs;
+    double mbPerSec;
+    double maxResidentPct;
+    // NaN for trials that do not split their timing
+    double medianIoMs, medianComputeMs;
+    double meanReadMb;
+    // Estimated share of chunk visits served by the HDF5 chunk cache: chunks read from the file are
+    // estimated from the bytes read. NaN for contiguous datasets and chunks larger than the cache.
+    double chunkHitPct;
+    // Median of each trial-specific measurement and resource counter
+    std::vector<std::pair<std::string, double>> metrics;
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+enum class OutputFormat {
+    Text,
+    Json,
+    Csv
+};
+
+bool parseOutputFormat(const std::string& name, OutputFormat& format);
+std::vector<int> parseTrialList(const std::string& list);
+
+// Linearly interpolated percentile (0-100) of an ascending list of samples
+double percentile(const std::vector<double>& sorted, double p);
+TrialSummary summarise(const TrialSamples& samples);
+// Adds the trial-specific measurements and resource counters of one iteration to the samples
+void recordMetrics(TrialSamples& samples, const TrialResult& result);
+void printSummaries(const std::vector<TrialSummary>& summaries, OutputFormat format, unsigned int seed, int warmup);
+// Fixed-point number, or null if it is not finite
+std::string jsonNumber(double val, int precision);
+// Median latencies of each trial (columns) for each layout and chunk cache configuration (rows)
+void printSweepMatrix(const std::vector<TrialSummary>& summaries);
+
+#endif //ADASS_HDF5_BENCHMARK_RUNNER_H
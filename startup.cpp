@@ -0,0 +1,271 @@
+#include "startup.h"
+
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <fmt/format.h>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+#include "downsample.h"
+#include "mipmap.h"
+#include "stats.h"
+#include "statsindex.h"
+
+using namespace std;
+using namespace H5;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+bool parseStartupMode(const string& name, StartupMode& mode) {
+    if (name == "sequential") {
+        mode = StartupMode::Sequential;
+    } else if (name == "overlapped") {
+        mode = StartupMode::Overlapped;
+    } else if (name == "paged") {
+        mode = StartupMode::Paged;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+string startupModeName(StartupMode mode) {
+    switch (mode) {
+        case StartupMode::Sequential: return "sequential";
+        case StartupMode::Overlapped: return "overlapped";
+        case StartupMode::Paged: return "paged";
+    }
+    return "unknown";
+}
+
+static double msBetween(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, milli>(to - from).count();
+}
+
+// Reads the value of every attribute of the object, as a viewer does to parse the header
+static int readAttributes(H5Object& object) {
+    int numAttributes = object.getNumAttrs();
+    for (auto i = 0; i < numAttributes; i++) {
+        auto attribute = object.openAttribute(unsigned(i));
+        if (attribute.getTypeClass() == H5T_STRING) {
+            string value;
+            attribute.read(attribute.getStrType(), value);
+        } else {
+            vector<double> values(max<hssize_t>(1, attribute.getSpace().getSimpleExtentNpoints()));
+            attribute.read(PredType::NATIVE_DOUBLE, values.data());
+        }
+    }
+    return numAttributes;
+}
+
+// Selection of the first channel (of the first stokes) of a dataset of the given rank
+static void firstChannel(int rank, hsize_t rows, hsize_t columns, vector<hsize_t>& start, vector<hsize_t>& count) {
+    count = {rows, columns};
+    while (int(count.size()) < rank) {
+        count.insert(count.begin(), 1);
+    }
+    start.assign(rank, 0);
+}
+
+bool measureStartup(const string& filename, const StartupOptions& options, StartupTimes& times) {
+    times = {0, 0, 0, 0, 0, 0, 0, 0, false};
+    auto tStart = Clock::now();
+
+    FileAccPropList fileAccess;
+    if (options.mode == StartupMode::Paged) {
+        // A larger initial metadata cache avoids resizing it while the first objects are opened
+        H5AC_cache_config_t cacheConfig;
+        cacheConfig.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+        H5Pget_mdc_config(fileAccess.getId(), &cacheConfig);
+        cacheConfig.set_initial_size = true;
+        cacheConfig.initial_size = 16 * 1024 * 1024;
+        cacheConfig.max_size = max<size_t>(cacheConfig.max_size, cacheConfig.initial_size);
+        H5Pset_mdc_config(fileAccess.getId(), &cacheConfig);
+        H5Pset_page_buffer_size(fileAccess.getId(), options.pageBufferBytes, 0, 0);
+    }
+    H5File file;
+    try {
+        Exception::dontPrint();
+        file.openFile(filename, H5F_ACC_RDONLY, fileAccess);
+        times.paged = options.mode == StartupMode::Paged;
+    } catch (FileIException&) {
+        if (options.mode != StartupMode::Paged) {
+            fmt::print(stderr, "Could not open {}\n", filename);
+            return false;
+        }
+        // Files written without paged aggregation cannot be opened with a page buffer; the failed attempt is not timed
+        H5Pset_page_buffer_size(fileAccess.getId(), 0, 0, 0);
+        tStart = Clock::now();
+        file.openFile(filename, H5F_ACC_RDONLY, fileAccess);
+    }
+    auto tOpen = Clock::now();
+
+    auto hduGroup = file.openGroup("0");
+    auto dataSet = hduGroup.openDataSet("DATA");
+    auto dataSpace = dataSet.getSpace();
+    vector<hsize_t> dims(dataSpace.getSimpleExtentNdims());
+    dataSpace.getSimpleExtentDims(dims.data(), nullptr);
+    auto createProperties = dataSet.getCreatePlist();
+    if (createProperties.getLayout() == H5D_CHUNKED) {
+        vector<hsize_t> chunkDims(dims.size());
+        createProperties.getChunk(dims.size(), chunkDims.data());
+    }
+    auto tMetadata = Clock::now();
+
+    auto scanAttributes = [&]() {
+        auto t0 = Clock::now();
+        times.attributes = readAttributes(hduGroup) + readAttributes(dataSet);
+        times.attributesMs = msBetween(t0, Clock::now());
+    };
+    thread scanner;
+    if (options.mode == StartupMode::Overlapped) {
+        scanner = thread(scanAttributes);
+    } else {
+        scanAttributes();
+    }
+
+    // The first image: the smallest power-of-two down-sampling that fits the view, from a mipmap if there is one
+    auto tImage = Clock::now();
+    int rank = dims.size();
+    hsize_t width = dims[rank - 1];
+    hsize_t height = dims[rank - 2];
+    int mip = 1;
+    while (width / mip > hsize_t(options.viewWidth) || height / mip > hsize_t(options.viewWidth)) {
+        mip *= 2;
+    }
+    hsize_t imageWidth = width / mip;
+    hsize_t imageHeight = height / mip;
+    vector<float> image(imageWidth * imageHeight);
+    vector<float> plane;
+    vector<hsize_t> start, count;
+    unique_ptr<DataReader> reader;
+    if (mip > 1 && hduGroup.nameExists("MipMaps") && hduGroup.openGroup("MipMaps").nameExists(mipDataSetName(mip))) {
+        auto mipDataSet = hduGroup.openGroup("MipMaps").openDataSet(mipDataSetName(mip));
+        auto mipReader = createReader(options.backend, filename, mipDataSet);
+        if (!mipReader) {
+            return false;
+        }
+        firstChannel(rank, imageHeight, imageWidth, start, count);
+        mipReader->read(start, count, image.data());
+        times.bytes += image.size() * sizeof(float);
+    } else {
+        reader = createReader(options.backend, filename, dataSet);
+        if (!reader) {
+            return false;
+        }
+        plane.resize(width * height);
+        firstChannel(rank, height, width, start, count);
+        reader->read(start, count, plane.data());
+        times.bytes += plane.size() * sizeof(float);
+        if (mip > 1) {
+            downsample(plane.data(), height, width, width, mip, DownsampleFilter::Mean, image.data());
+        } else {
+            image = plane;
+        }
+    }
+    auto tStats = Clock::now();
+
+    // Statistics and histogram of the full-resolution channel, computed if the file has none stored
+    StatisticsIndex statisticsIndex(file);
+    BasicStats stats;
+    vector<size_t> histogram;
+    if (!statisticsIndex.channelStats(0, 0, stats, &histogram)) {
+        if (plane.empty()) {
+            reader = createReader(options.backend, filename, dataSet);
+            if (!reader) {
+                return false;
+            }
+            plane.resize(width * height);
+            firstChannel(rank, height, width, start, count);
+            reader->read(start, count, plane.data());
+            times.bytes += plane.size() * sizeof(float);
+        }
+        stats = calculateStats(plane.data(), plane.size());
+        int bins = max(2, int(sqrt(double(plane.size()))));
+        histogram = calculateHistogram(plane.data(), plane.size(), stats.minVal, stats.maxVal, bins);
+    }
+    auto tRendered = Clock::now();
+
+    if (scanner.joinable()) {
+        scanner.join();
+    }
+    auto tEnd = Clock::now();
+
+    times.openMs = msBetween(tStart, tOpen);
+    times.metadataMs = msBetween(tOpen, tMetadata);
+    times.imageMs = msBetween(tImage, tStats);
+    times.statsMs = msBetween(tStats, tRendered);
+    times.totalMs = msBetween(tStart, tEnd);
+    return true;
+}
+
+string formatStartupTimes(const StartupTimes& times) {
+    return fmt::format("startup open_ms {} metadata_ms {} attributes_ms {} image_ms {} stats_ms {} total_ms {} attributes {} bytes {} "
+                       "paged {}", times.openMs, times.metadataMs, times.attributesMs, times.imageMs, times.statsMs, times.totalMs,
+                       times.attributes, times.bytes, times.paged ? 1 : 0);
+}
+
+bool parseStartupTimes(const string& line, StartupTimes& times) {
+    istringstream stream(line);
+    string prefix, name;
+    double value;
+    stream >> prefix;
+    if (prefix != "startup") {
+        return false;
+    }
+    map<string, double> values;
+    while (stream >> name >> value) {
+        values[name] = value;
+    }
+    for (auto name : {"open_ms", "metadata_ms", "attributes_ms", "image_ms", "stats_ms", "total_ms", "attributes", "bytes", "paged"}) {
+        if (!values.count(name)) {
+            return false;
+        }
+    }
+    times.openMs = values["open_ms"];
+    times.metadataMs = values["metadata_ms"];
+    times.attributesMs = values["attributes_ms"];
+    times.imageMs = values["image_ms"];
+    times.statsMs = values["stats_ms"];
+    times.totalMs = values["total_ms"];
+    times.attributes = values["attributes"];
+    times.bytes = values["bytes"];
+    times.paged = values["paged"] != 0;
+    return true;
+}
+
+// Quotes an argument for the shell that popen runs
+static string shellQuote(const string& arg) {
+    string quoted = "'";
+    for (auto c : arg) {
+        quoted += (c == '\'') ? string("'\\''") : string(1, c);
+    }
+    return quoted + "'";
+}
+
+bool measureStartupInChild(const string& filename, const StartupOptions& options, StartupTimes& times) {
+    // /proc/self/exe would name the shell in the command, so it is resolved here
+    char executable[PATH_MAX];
+    auto length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    if (length < 0) {
+        return false;
+    }
+    executable[length] = '\0';
+    auto command = fmt::format("{} {} --startup-probe {} --backend {} --simd {} --view-width {} --page-buffer {}", shellQuote(executable),
+                               shellQuote(filename), startupModeName(options.mode), backendName(options.backend),
+                               simdLevelName(getSimdLevel()), options.viewWidth, options.pageBufferBytes / (1024 * 1024));
+    auto pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        return false;
+    }
+    bool found = false;
+    char line[1024];
+    while (fgets(line, sizeof(line), pipe)) {
+        found = found || parseStartupTimes(line, times);
+    }
+    return pclose(pipe) == 0 && found;
+}
@@ -0,0 +1,56 @@
+#ifndef ADASS_HDF5_BENCHMARK_STARTUP_H
+#define ADASS_HDF5_BENCHMARK_STARTUP_H
+
+#include <H5Cpp.h>
+#include <string>
+
+#include "reader.h"
+
+enum class StartupMode {
+    // Each phase after the previous one, as a viewer opening a file does
+    Sequential,
+    // The attribute scan on a separate thread, concurrently with the first image
+    Overlapped,
+    // Sequential, with an HDF5 page buffer and a larger initial metadata cache
+    Paged
+};
+
+bool parseStartupMode(const std::string& name, StartupMode& mode);
+std::string startupModeName(StartupMode mode);
+
+struct StartupOptions {
+    StartupMode mode = StartupMode::Sequential;
+    Backend backend = Backend::Hdf5;
+    // Largest width and height of the first image; larger channels are down-sampled by a power of two to fit
+    int viewWidth = 1024;
+    // Page buffer of the paged mode, in bytes
+    size_t pageBufferBytes = 16 * 1024 * 1024;
+};
+
+// Time of each phase until the first channel is displayed, in ms
+struct StartupTimes {
+    // H5Fopen; opening 0 and 0/DATA with their extents and layout; reading every attribute of both
+    double openMs, metadataMs, attributesMs;
+    // Reading the first channel (or its mipmap) into a down-sampled image, and its statistics and histogram
+    double imageMs, statsMs;
+    // Until the image, statistics and attributes were all available
+    double totalMs;
+    int attributes;
+    size_t bytes;
+    // Whether the paged mode's page buffer was used (files without paged aggregation cannot have one)
+    bool paged;
+};
+
+// Opens the file and measures the time to its first image. Down-sampled images come from 0/MipMaps if it has
+// a level that fits, and statistics from 0/Statistics if present. HDF5 shares a file's metadata cache between
+// all handles to it, so this must run in a process that does not already have the file open.
+bool measureStartup(const std::string& filename, const StartupOptions& options, StartupTimes& times);
+
+// Formats times as a single line of name-value pairs, and parses such a line
+std::string formatStartupTimes(const StartupTimes& times);
+bool parseStartupTimes(const std::string& line, StartupTimes& times);
+
+// Runs measureStartup in a child process: this executable, run with --startup-probe and the options
+bool measureStartupInChild(const std::string& filename, const StartupOptions& options, StartupTimes& times);
+
+#endif //ADASS_HDF5_BENCHMARK_STARTUP_H
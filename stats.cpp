@@ -0,0 +1,278 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+
+#include "downsample.h"
+
+using namespace std;
+
+// Values reduced by each kernel call; large enough to amortise the horizontal reductions, small enough to balance
+static const size_t blockSize = 1 << 16;
+
+// Adds n values to the count, sums and extrema of stats
+typedef void (*StatsFunction)(const float* data, size_t n, BasicStats& stats);
+
+static void accumulateStatsScalar(const float* data, size_t n, BasicStats& stats) {
+    double sum = 0, sumSquares = 0;
+    size_t count = 0;
+    float low = stats.minVal, high = stats.maxVal;
+    for (size_t i = 0; i < n; i++) {
+        float val = data[i];
+        if (!isnan(val)) {
+            sum += val;
+            sumSquares += double(val) * val;
+            count++;
+            low = min(low, val);
+            high = max(high, val);
+        }
+    }
+    stats.count += count;
+    stats.sum += sum;
+    stats.sumSquares += sumSquares;
+    stats.minVal = low;
+    stats.maxVal = high;
+}
+
+// Adds n values to the histogram counts, where value v falls in bin (v - minVal) * scale. The bin indices could be
+// computed with SIMD, but storing and reloading them for the scalar increments measured slower than this loop.
+static void accumulateHistogramScalar(const float* data, size_t n, float minVal, float maxVal, float scale, int bins, size_t* counts) {
+    for (size_t i = 0; i < n; i++) {
+        float val = data[i];
+        // Comparisons with NaN are false
+        if (val >= minVal && val <= maxVal) {
+            counts[min(int((val - minVal) * scale), bins - 1)]++;
+        }
+    }
+}
+
+// As in the down-sampling kernels, NaNs are masked out with an ordered self-comparison, and min/max with the
+// accumulator as second operand skip them. Each half of the valid values is widened to double before summing.
+__attribute__((target("avx2")))
+static void accumulateStatsAvx2(const float* data, size_t n, BasicStats& stats) {
+    __m256d sumLow = _mm256_setzero_pd(), sumHigh = _mm256_setzero_pd();
+    __m256d squaresLow = _mm256_setzero_pd(), squaresHigh = _mm256_setzero_pd();
+    __m256 low = _mm256_set1_ps(stats.minVal), high = _mm256_set1_ps(stats.maxVal);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 val = _mm256_loadu_ps(data + i);
+        __m256 valid = _mm256_cmp_ps(val, val, _CMP_ORD_Q);
+        __m256 masked = _mm256_and_ps(valid, val);
+        low = _mm256_min_ps(val, low);
+        high = _mm256_max_ps(val, high);
+        __m256d first = _mm256_cvtps_pd(_mm256_castps256_ps128(masked));
+        __m256d second = _mm256_cvtps_pd(_mm256_extractf128_ps(masked, 1));
+        sumLow = _mm256_add_pd(sumLow, first);
+        sumHigh = _mm256_add_pd(sumHigh, second);
+        squaresLow = _mm256_add_pd(squaresLow, _mm256_mul_pd(first, first));
+        squaresHigh = _mm256_add_pd(squaresHigh, _mm256_mul_pd(second, second));
+        count += __builtin_popcount(_mm256_movemask_ps(valid));
+    }
+
+    alignas(32) double sums[4], squares[4];
+    alignas(32) float lows[8], highs[8];
+    _mm256_store_pd(sums, _mm256_add_pd(sumLow, sumHigh));
+    _mm256_store_pd(squares, _mm256_add_pd(squaresLow, squaresHigh));
+    _mm256_store_ps(lows, low);
+    _mm256_store_ps(highs, high);
+    stats.count += count;
+    stats.sum += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    stats.sumSquares += (squares[0] + squares[1]) + (squares[2] + squares[3]);
+    stats.minVal = *min_element(lows, lows + 8);
+    stats.maxVal = *max_element(highs, highs + 8);
+    accumulateStatsScalar(data + i, n - i, stats);
+}
+
+__attribute__((target("avx512f")))
+static void accumulateStatsAvx512(const float* data, size_t n, BasicStats& stats) {
+    __m512d sumLow = _mm512_setzero_pd(), sumHigh = _mm512_setzero_pd();
+    __m512d squaresLow = _mm512_setzero_pd(), squaresHigh = _mm512_setzero_pd();
+    __m512 low = _mm512_set1_ps(stats.minVal), high = _mm512_set1_ps(stats.maxVal);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 val = _mm512_loadu_ps(data + i);
+        __mmask16 valid = _mm512_cmp_ps_mask(val, val, _CMP_ORD_Q);
+        __m512 masked = _mm512_maskz_mov_ps(valid, val);
+        low = _mm512_mask_min_ps(low, valid, low, val);
+        high = _mm512_mask_max_ps(high, valid, high, val);
+        __m512d first = _mm512_cvtps_pd(_mm512_castps512_ps256(masked));
+        __m512d second = _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(masked), 1)));
+        sumLow = _mm512_add_pd(sumLow, first);
+        sumHigh = _mm512_add_pd(sumHigh, second);
+        squaresLow = _mm512_fmadd_pd(first, first, squaresLow);
+        squaresHigh = _mm512_fmadd_pd(second, second, squaresHigh);
+        count += __builtin_popcount(valid);
+    }
+    stats.count += count;
+    stats.sum += _mm512_reduce_add_pd(_mm512_add_pd(sumLow, sumHigh));
+    stats.sumSquares += _mm512_reduce_add_pd(_mm512_add_pd(squaresLow, squaresHigh));
+    stats.minVal = _mm512_reduce_min_ps(low);
+    stats.maxVal = _mm512_reduce_max_ps(high);
+    accumulateStatsScalar(data + i, n - i, stats);
+}
+
+static void addNanSumScalar(const float* data, size_t n, double& sum, size_t& count) {
+    double total = 0;
+    size_t valid = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!isnan(data[i])) {
+            total += data[i];
+            valid++;
+        }
+    }
+    sum += total;
+    count += valid;
+}
+
+static void addNanValuesScalar(const float* data, size_t n, double* sums, double* counts) {
+    for (size_t i = 0; i < n; i++) {
+        float val = data[i];
+        bool valid = !isnan(val);
+        sums[i] += valid ? val : 0.0;
+        counts[i] += valid ? 1.0 : 0.0;
+    }
+}
+
+__attribute__((target("avx2")))
+static void addNanSumAvx2(const float* data, size_t n, double& sum, size_t& count) {
+    __m256d sumLow = _mm256_setzero_pd(), sumHigh = _mm256_setzero_pd();
+    size_t valid = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 val = _mm256_loadu_ps(data + i);
+        __m256 mask = _mm256_cmp_ps(val, val, _CMP_ORD_Q);
+        __m256 masked = _mm256_and_ps(mask, val);
+        sumLow = _mm256_add_pd(sumLow, _mm256_cvtps_pd(_mm256_castps256_ps128(masked)));
+        sumHigh = _mm256_add_pd(sumHigh, _mm256_cvtps_pd(_mm256_extractf128_ps(masked, 1)));
+        valid += __builtin_popcount(_mm256_movemask_ps(mask));
+    }
+    alignas(32) double sums[4];
+    _mm256_store_pd(sums, _mm256_add_pd(sumLow, sumHigh));
+    sum += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    count += valid;
+    addNanSumScalar(data + i, n - i, sum, count);
+}
+
+__attribute__((target("avx2")))
+static void addNanValuesAvx2(const float* data, size_t n, double* sums, double* counts) {
+    const __m256d ones = _mm256_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d val = _mm256_cvtps_pd(_mm_loadu_ps(data + i));
+        __m256d valid = _mm256_cmp_pd(val, val, _CMP_ORD_Q);
+        _mm256_storeu_pd(sums + i, _mm256_add_pd(_mm256_loadu_pd(sums + i), _mm256_and_pd(valid, val)));
+        _mm256_storeu_pd(counts + i, _mm256_add_pd(_mm256_loadu_pd(counts + i), _mm256_and_pd(valid, ones)));
+    }
+    addNanValuesScalar(data + i, n - i, sums + i, counts + i);
+}
+
+__attribute__((target("avx512f")))
+static void addNanSumAvx512(const float* data, size_t n, double& sum, size_t& count) {
+    __m512d sumLow = _mm512_setzero_pd(), sumHigh = _mm512_setzero_pd();
+    size_t valid = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 val = _mm512_loadu_ps(data + i);
+        __mmask16 mask = _mm512_cmp_ps_mask(val, val, _CMP_ORD_Q);
+        __m512 masked = _mm512_maskz_mov_ps(mask, val);
+        sumLow = _mm512_add_pd(sumLow, _mm512_cvtps_pd(_mm512_castps512_ps256(masked)));
+        sumHigh = _mm512_add_pd(sumHigh, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(masked), 1))));
+        valid += __builtin_popcount(mask);
+    }
+    sum += _mm512_reduce_add_pd(_mm512_add_pd(sumLow, sumHigh));
+    count += valid;
+    addNanSumScalar(data + i, n - i, sum, count);
+}
+
+__attribute__((target("avx512f")))
+static void addNanValuesAvx512(const float* data, size_t n, double* sums, double* counts) {
+    const __m512d ones = _mm512_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d val = _mm512_cvtps_pd(_mm256_loadu_ps(data + i));
+        __mmask8 valid = _mm512_cmp_pd_mask(val, val, _CMP_ORD_Q);
+        __m512d sum = _mm512_loadu_pd(sums + i);
+        __m512d count = _mm512_loadu_pd(counts + i);
+        _mm512_storeu_pd(sums + i, _mm512_mask_add_pd(sum, valid, sum, val));
+        _mm512_storeu_pd(counts + i, _mm512_mask_add_pd(count, valid, count, ones));
+    }
+    addNanValuesScalar(data + i, n - i, sums + i, counts + i);
+}
+
+void addNanSum(const float* data, size_t n, double& sum, size_t& count) {
+    typedef void (*SumFunction)(const float*, size_t, double&, size_t&);
+    static const SumFunction functions[3] = {addNanSumScalar, addNanSumAvx2, addNanSumAvx512};
+    functions[(int) getSimdLevel()](data, n, sum, count);
+}
+
+void addNanValues(const float* data, size_t n, double* sums, double* counts) {
+    typedef void (*ValuesFunction)(const float*, size_t, double*, double*);
+    static const ValuesFunction functions[3] = {addNanValuesScalar, addNanValuesAvx2, addNanValuesAvx512};
+    functions[(int) getSimdLevel()](data, n, sums, counts);
+}
+
+BasicStats calculateStats(const float* data, size_t n) {
+    static const StatsFunction functions[3] = {accumulateStatsScalar, accumulateStatsAvx2, accumulateStatsAvx512};
+    auto accumulate = functions[(int) getSimdLevel()];
+
+    long long blocks = (n + blockSize - 1) / blockSize;
+    vector<BasicStats> partials(blocks);
+#pragma omp parallel for schedule(static) if (blocks > 1)
+    for (long long b = 0; b < blocks; b++) {
+        auto& partial = partials[b];
+        partial.minVal = INFINITY;
+        partial.maxVal = -INFINITY;
+        size_t offset = b * blockSize;
+        accumulate(data + offset, min(blockSize, n - offset), partial);
+    }
+
+    BasicStats stats;
+    stats.minVal = INFINITY;
+    stats.maxVal = -INFINITY;
+    for (auto& partial : partials) {
+        stats.count += partial.count;
+        stats.sum += partial.sum;
+        stats.sumSquares += partial.sumSquares;
+        stats.minVal = min(stats.minVal, partial.minVal);
+        stats.maxVal = max(stats.maxVal, partial.maxVal);
+    }
+    deriveStats(stats);
+    return stats;
+}
+
+void deriveStats(BasicStats& stats) {
+    if (stats.count) {
+        stats.mean = stats.sum / stats.count;
+        stats.stdDev = sqrt(max(0.0, stats.sumSquares / stats.count - stats.mean * stats.mean));
+    } else {
+        stats.mean = stats.stdDev = NAN;
+        stats.minVal = stats.maxVal = NAN;
+    }
+}
+
+vector<size_t> calculateHistogram(const float* data, size_t n, float minVal, float maxVal, int bins) {
+    bins = max(1, bins);
+    vector<size_t> histogram(bins);
+    if (!(maxVal >= minVal)) {
+        return histogram;
+    }
+    float scale = (maxVal > minVal) ? bins / (maxVal - minVal) : 0;
+    long long blocks = (n + blockSize - 1) / blockSize;
+#pragma omp parallel if (blocks > 1)
+    {
+        vector<size_t> counts(bins);
+#pragma omp for schedule(static)
+        for (long long b = 0; b < blocks; b++) {
+            size_t offset = b * blockSize;
+            accumulateHistogramScalar(data + offset, min(blockSize, n - offset), minVal, maxVal, scale, bins, counts.data());
+        }
+#pragma omp critical
+        for (auto i = 0; i < bins; i++) {
+            histogram[i] += counts[i];
+        }
+    }
+    return histogram;
+}
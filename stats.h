@@ -0,0 +1,35 @@
+#ifndef ADASS_HDF5_BENCHMARK_STATS_H
+#define ADASS_HDF5_BENCHMARK_STATS_H
+
+#include <cstddef>
+#include <vector>
+
+// NaN-aware statistics of an image or region, as a viewer shows them. Sums are accumulated in double.
+struct BasicStats {
+    // Number of non-NaN values
+    size_t count = 0;
+    double sum = 0;
+    double sumSquares = 0;
+    // NaN if there are no valid values
+    double mean;
+    // Population standard deviation
+    double stdDev;
+    float minVal, maxVal;
+};
+
+// Mean, sum, sum of squares and extrema of n values in a single pass. Blocks of the data are reduced in parallel
+// with the SIMD kernels selected by setSimdLevel (see downsample.h), and combined in order, so that the result
+// does not depend on the number of threads.
+BasicStats calculateStats(const float* data, size_t n);
+// Adds the sum and number of the non-NaN values among n to sum and count. Unlike calculateStats these run on the
+// calling thread only, for callers that parallelise over many short runs of data.
+void addNanSum(const float* data, size_t n, double& sum, size_t& count);
+// Adds each non-NaN value to the matching element of sums, and 1 to the matching element of counts
+void addNanValues(const float* data, size_t n, double* sums, double* counts);
+// Sets the mean and standard deviation from the count and sums, and the extrema to NaN if there are no valid values
+void deriveStats(BasicStats& stats);
+// Counts of the non-NaN values in bins equal-width bins spanning [minVal, maxVal]. maxVal falls in the last bin,
+// and values outside the range are not counted. Each thread fills a histogram of its own; these are summed at the end.
+std::vector<size_t> calculateHistogram(const float* data, size_t n, float minVal, float maxVal, int bins);
+
+#endif //ADASS_HDF5_BENCHMARK_STATS_H
@@ -0,0 +1,235 @@
+#include "statsindex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fmt/format.h>
+
+#include "resources.h"
+
+using namespace std;
+using namespace H5;
+
+static const vector<string> statisticsGroups = {"XY", "XYZ"};
+
+static void writeDataSet(Group& group, const string& name, const PredType& type, const vector<hsize_t>& dims, const void* data) {
+    auto dataSet = group.createDataSet(name, type, DataSpace(dims.size(), dims.data()));
+    dataSet.write(data, type);
+}
+
+bool buildStatistics(H5File& file, const StatisticsOptions& options) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    auto hduGroup = file.openGroup("0");
+    auto source = hduGroup.openDataSet("DATA");
+
+    vector<hsize_t> dims(source.getSpace().getSimpleExtentNdims(), 0);
+    source.getSpace().getSimpleExtentDims(dims.data(), nullptr);
+    int rank = dims.size();
+    if (rank < 2) {
+        fmt::print("Statistics require an image or cube. Aborting.\n");
+        return false;
+    }
+    hsize_t width = dims[rank - 1];
+    hsize_t height = dims[rank - 2];
+    hsize_t depth = (rank > 2) ? dims[rank - 3] : 1;
+    hsize_t stokes = (rank > 3) ? dims[rank - 4] : 1;
+    size_t planeSize = width * height;
+    int bins = options.bins > 0 ? options.bins : max(2, int(sqrt(double(planeSize))));
+
+    vector<float> plane(planeSize);
+    double readSeconds = 0, computeSeconds = 0;
+    auto readPlane = [&](hsize_t s, hsize_t z) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        vector<hsize_t> count = {height, width};
+        vector<hsize_t> start = {0, 0};
+        if (rank > 2) {
+            count.insert(count.begin(), 1);
+            start.insert(start.begin(), z);
+        }
+        if (rank > 3) {
+            count.insert(count.begin(), 1);
+            start.insert(start.begin(), s);
+        }
+        DataSpace memspace(count.size(), count.data());
+        auto sourceSpace = source.getSpace();
+        sourceSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+        source.read(plane.data(), PredType::NATIVE_FLOAT, memspace, sourceSpace);
+        readSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+    };
+
+    // Per-channel statistics, in [stokes, depth] order, and their histograms
+    size_t channels = stokes * depth;
+    vector<float> minima(channels), maxima(channels);
+    vector<double> sums(channels), sumSquares(channels);
+    vector<long long> nanCounts(channels);
+    vector<unsigned long long> histograms(channels * bins);
+    for (hsize_t s = 0; s < stokes; s++) {
+        for (hsize_t z = 0; z < depth; z++) {
+            readPlane(s, z);
+            auto t0 = std::chrono::high_resolution_clock::now();
+            auto stats = calculateStats(plane.data(), planeSize);
+            auto histogram = calculateHistogram(plane.data(), planeSize, stats.minVal, stats.maxVal, bins);
+            size_t c = s * depth + z;
+            minima[c] = stats.minVal;
+            maxima[c] = stats.maxVal;
+            sums[c] = stats.sum;
+            sumSquares[c] = stats.sumSquares;
+            nanCounts[c] = planeSize - stats.count;
+            copy(histogram.begin(), histogram.end(), histograms.begin() + c * bins);
+            computeSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+        }
+    }
+
+    // Cube statistics combine those of the channels (fmin and fmax skip channels without valid pixels)
+    vector<float> cubeMinima(stokes, NAN), cubeMaxima(stokes, NAN);
+    vector<double> cubeSums(stokes), cubeSumSquares(stokes);
+    vector<long long> cubeNanCounts(stokes);
+    vector<unsigned long long> cubeHistograms(stokes * bins);
+    for (hsize_t s = 0; s < stokes; s++) {
+        for (hsize_t z = 0; z < depth; z++) {
+            size_t c = s * depth + z;
+            cubeMinima[s] = fmin(cubeMinima[s], minima[c]);
+            cubeMaxima[s] = fmax(cubeMaxima[s], maxima[c]);
+            cubeSums[s] += sums[c];
+            cubeSumSquares[s] += sumSquares[c];
+            cubeNanCounts[s] += nanCounts[c];
+        }
+        if (depth == 1) {
+            copy(histograms.begin() + s * bins, histograms.begin() + (s + 1) * bins, cubeHistograms.begin() + s * bins);
+            continue;
+        }
+        for (hsize_t z = 0; z < depth; z++) {
+            readPlane(s, z);
+            auto t0 = std::chrono::high_resolution_clock::now();
+            auto histogram = calculateHistogram(plane.data(), planeSize, cubeMinima[s], cubeMaxima[s], bins);
+            for (auto i = 0; i < bins; i++) {
+                cubeHistograms[s * bins + i] += histogram[i];
+            }
+            computeSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+        }
+    }
+
+    auto tWrite = std::chrono::high_resolution_clock::now();
+    if (hduGroup.nameExists("Statistics")) {
+        hduGroup.unlink("Statistics");
+    }
+    auto statisticsGroup = hduGroup.createGroup("Statistics");
+    auto xyGroup = statisticsGroup.createGroup("XY");
+    vector<hsize_t> channelDims = {stokes, depth};
+    vector<hsize_t> histogramDims = {stokes, depth, hsize_t(bins)};
+    writeDataSet(xyGroup, "MIN", PredType::NATIVE_FLOAT, channelDims, minima.data());
+    writeDataSet(xyGroup, "MAX", PredType::NATIVE_FLOAT, channelDims, maxima.data());
+    writeDataSet(xyGroup, "SUM", PredType::NATIVE_DOUBLE, channelDims, sums.data());
+    writeDataSet(xyGroup, "SUM_SQ", PredType::NATIVE_DOUBLE, channelDims, sumSquares.data());
+    writeDataSet(xyGroup, "NAN_COUNT", PredType::NATIVE_LLONG, channelDims, nanCounts.data());
+    writeDataSet(xyGroup, "HISTO", PredType::NATIVE_ULLONG, histogramDims, histograms.data());
+
+    auto xyzGroup = statisticsGroup.createGroup("XYZ");
+    vector<hsize_t> cubeDims = {stokes};
+    vector<hsize_t> cubeHistogramDims = {stokes, hsize_t(bins)};
+    writeDataSet(xyzGroup, "MIN", PredType::NATIVE_FLOAT, cubeDims, cubeMinima.data());
+    writeDataSet(xyzGroup, "MAX", PredType::NATIVE_FLOAT, cubeDims, cubeMaxima.data());
+    writeDataSet(xyzGroup, "SUM", PredType::NATIVE_DOUBLE, cubeDims, cubeSums.data());
+    writeDataSet(xyzGroup, "SUM_SQ", PredType::NATIVE_DOUBLE, cubeDims, cubeSumSquares.data());
+    writeDataSet(xyzGroup, "NAN_COUNT", PredType::NATIVE_LLONG, cubeDims, cubeNanCounts.data());
+    writeDataSet(xyzGroup, "HISTO", PredType::NATIVE_ULLONG, cubeHistogramDims, cubeHistograms.data());
+    file.flush(H5F_SCOPE_LOCAL);
+
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    double totalSeconds = std::chrono::duration<double>(tEnd - tStart).count();
+    double writeSeconds = std::chrono::duration<double>(tEnd - tWrite).count();
+    double cubeMb = planeSize * channels * sizeof(float) * 1.0e-6;
+    fmt::print("Built statistics and {}-bin histograms for {}x{}x{}x{} cube in {:.2f} s: {:.1f} MB/s\n", bins, width, height, depth,
+               stokes, totalSeconds, cubeMb / totalSeconds);
+    fmt::print("Read {:.2f} s ({} passes), compute {:.2f} s, write {:.2f} s\n", readSeconds, depth > 1 ? 2 : 1, computeSeconds,
+               writeSeconds);
+    fmt::print("Peak RSS {:.1f} MB\n", peakResidentMb());
+    return true;
+}
+
+StatisticsIndex::StatisticsIndex(H5File& file) {
+    auto hduGroup = file.openGroup("0");
+    if (!hduGroup.nameExists("Statistics")) {
+        return;
+    }
+    auto statisticsGroup = hduGroup.openGroup("Statistics");
+    for (auto& groupName : statisticsGroups) {
+        if (!statisticsGroup.nameExists(groupName)) {
+            return;
+        }
+        auto group = statisticsGroup.openGroup(groupName);
+        for (auto name : {"MIN", "MAX", "SUM", "SUM_SQ", "NAN_COUNT", "HISTO"}) {
+            if (!group.nameExists(name)) {
+                return;
+            }
+            dataSets[groupName][name] = group.openDataSet(name);
+        }
+    }
+
+    auto histogramSpace = dataSets["XY"]["HISTO"].getSpace();
+    vector<hsize_t> histogramDims(histogramSpace.getSimpleExtentNdims());
+    histogramSpace.getSimpleExtentDims(histogramDims.data(), nullptr);
+    numBins = histogramDims.back();
+
+    auto dataSpace = hduGroup.openDataSet("DATA").getSpace();
+    vector<hsize_t> dims(dataSpace.getSimpleExtentNdims());
+    dataSpace.getSimpleExtentDims(dims.data(), nullptr);
+    int rank = dims.size();
+    channelPixels = dims[rank - 1] * dims[rank - 2];
+    cubePixels = channelPixels * ((rank > 2) ? dims[rank - 3] : 1);
+    isValid = true;
+}
+
+bool StatisticsIndex::valid() const {
+    return isValid;
+}
+
+int StatisticsIndex::bins() const {
+    return numBins;
+}
+
+bool StatisticsIndex::readStats(const string& group, const vector<hsize_t>& start, BasicStats& stats, vector<size_t>* histogram) {
+    if (!isValid) {
+        return false;
+    }
+    auto& groupDataSets = dataSets[group];
+    vector<hsize_t> count(start.size(), 1);
+    DataSpace scalarSpace(1, count.data());
+    auto readValue = [&](const string& name, const PredType& type, void* value) {
+        auto& dataSet = groupDataSets[name];
+        auto fileSpace = dataSet.getSpace();
+        fileSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+        dataSet.read(value, type, scalarSpace, fileSpace);
+    };
+
+    long long nanCount;
+    readValue("MIN", PredType::NATIVE_FLOAT, &stats.minVal);
+    readValue("MAX", PredType::NATIVE_FLOAT, &stats.maxVal);
+    readValue("SUM", PredType::NATIVE_DOUBLE, &stats.sum);
+    readValue("SUM_SQ", PredType::NATIVE_DOUBLE, &stats.sumSquares);
+    readValue("NAN_COUNT", PredType::NATIVE_LLONG, &nanCount);
+    stats.count = (group == "XY" ? channelPixels : cubePixels) - nanCount;
+    deriveStats(stats);
+
+    if (histogram) {
+        vector<hsize_t> histogramCount(count), histogramStart(start);
+        histogramCount.push_back(numBins);
+        histogramStart.push_back(0);
+        vector<unsigned long long> values(numBins);
+        DataSpace memspace(1, &histogramCount.back());
+        auto& dataSet = groupDataSets["HISTO"];
+        auto fileSpace = dataSet.getSpace();
+        fileSpace.selectHyperslab(H5S_SELECT_SET, histogramCount.data(), histogramStart.data());
+        dataSet.read(values.data(), PredType::NATIVE_ULLONG, memspace, fileSpace);
+        histogram->assign(values.begin(), values.end());
+    }
+    return true;
+}
+
+bool StatisticsIndex::channelStats(int stokes, int channel, BasicStats& stats, vector<size_t>* histogram) {
+    return readStats("XY", {hsize_t(stokes), hsize_t(channel)}, stats, histogram);
+}
+
+bool StatisticsIndex::cubeStats(int stokes, BasicStats& stats, vector<size_t>* histogram) {
+    return readStats("XYZ", {hsize_t(stokes)}, stats, histogram);
+}
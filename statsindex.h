@@ -0,0 +1,50 @@
+#ifndef ADASS_HDF5_BENCHMARK_STATSINDEX_H
+#define ADASS_HDF5_BENCHMARK_STATSINDEX_H
+
+#include <H5Cpp.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "stats.h"
+
+// Precomputed statistics are stored as in the CARTA HDF5 schema, with the mean and standard deviation derived from
+// the sums:
+//     0/Statistics/XY/{MIN,MAX,SUM,SUM_SQ,NAN_COUNT}     [stokes, depth], one value per channel
+//     0/Statistics/XY/HISTO                              [stokes, depth, bins], spanning each channel's min to max
+//     0/Statistics/XYZ/{MIN,MAX,SUM,SUM_SQ,NAN_COUNT}    [stokes], one value per cube
+//     0/Statistics/XYZ/HISTO                             [stokes, bins], spanning the cube's min to max
+// 3D cubes have a single stokes.
+struct StatisticsOptions {
+    // Histogram bins; 0 uses the square root of the number of pixels in a channel, as CARTA does
+    int bins = 0;
+};
+
+// Writes 0/Statistics from 0/DATA, replacing any existing statistics. Each channel is read once and its
+// statistics and histogram are computed in parallel over its pixels. The cube histograms need the cube's range,
+// so the cube is read a second time to fill them.
+bool buildStatistics(H5::H5File& file, const StatisticsOptions& options);
+
+// Reads precomputed statistics from an open file
+class StatisticsIndex {
+public:
+    // Opens the statistics datasets of the file; valid() is false if it has none
+    explicit StatisticsIndex(H5::H5File& file);
+    bool valid() const;
+    int bins() const;
+    // Statistics of one channel, or of the whole cube (in stokes). The histogram is only read if one is passed.
+    bool channelStats(int stokes, int channel, BasicStats& stats, std::vector<size_t>* histogram = nullptr);
+    bool cubeStats(int stokes, BasicStats& stats, std::vector<size_t>* histogram = nullptr);
+
+private:
+    bool readStats(const std::string& group, const std::vector<hsize_t>& start, BasicStats& stats, std::vector<size_t>* histogram);
+
+    bool isValid = false;
+    int numBins = 0;
+    // Pixels per channel, and per cube, of each stokes
+    size_t channelPixels = 0, cubePixels = 0;
+    // Datasets by group ("XY" or "XYZ") and name
+    std::map<std::string, std::map<std::string, H5::DataSet>> dataSets;
+};
+
+#endif //ADASS_HDF5_BENCHMARK_STATSINDEX_H
@@ -0,0 +1,165 @@
+#include "swizzle.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fmt/format.h>
+
+#include "resources.h"
+
+using namespace std;
+using namespace H5;
+
+// Tile edge length in elements: a 64x64 float tile of input and output fits comfortably in L1/L2
+static const size_t transposeTile = 64;
+
+void transposeSlab(const float* in, float* out, size_t channels, size_t rows, size_t columns) {
+    long long numChannels = channels, numRows = rows, numColumns = columns;
+#pragma omp parallel for collapse(3) schedule(static)
+    for (long long xTile = 0; xTile < numColumns; xTile += transposeTile) {
+        for (long long y = 0; y < numRows; y++) {
+            for (long long zTile = 0; zTile < numChannels; zTile += transposeTile) {
+                auto xEnd = min(xTile + (long long) transposeTile, numColumns);
+                auto zEnd = min(zTile + (long long) transposeTile, numChannels);
+                for (auto x = xTile; x < xEnd; x++) {
+                    float* dest = out + (x * numRows + y) * numChannels;
+                    const float* src = in + y * numColumns + x;
+                    for (auto z = zTile; z < zEnd; z++) {
+                        dest[z] = src[z * numRows * numColumns];
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool swizzle(H5File& file, const SwizzleOptions& options) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    auto hduGroup = file.openGroup("0");
+    auto source = hduGroup.openDataSet("DATA");
+
+    vector<hsize_t> dims(source.getSpace().getSimpleExtentNdims(), 0);
+    source.getSpace().getSimpleExtentDims(dims.data(), nullptr);
+    int rank = dims.size();
+    if (rank < 3) {
+        fmt::print("Swizzling requires a 3D or 4D cube. Aborting.\n");
+        return false;
+    }
+    hsize_t width = dims[rank - 1];
+    hsize_t height = dims[rank - 2];
+    hsize_t depth = dims[rank - 3];
+    hsize_t stokes = (rank > 3) ? dims[rank - 4] : 1;
+
+    DSetCreatPropList createProperties;
+    DSetAccPropList accessProperties;
+    vector<hsize_t> targetDims = {width, height, depth};
+    if (rank == 4) {
+        targetDims.insert(targetDims.begin(), stokes);
+    }
+
+    // Slabs cover all columns, a band of rows and (for very deep cubes) a range of channels.
+    // The input and output buffers share the memory budget.
+    size_t slabElements = max<size_t>(options.memoryBudget / 2 / sizeof(float), width);
+    hsize_t channels = depth;
+    hsize_t rows = slabElements / (width * depth);
+    if (rows == 0) {
+        rows = 1;
+        channels = slabElements / width;
+    }
+    rows = min(rows, height);
+
+    if (!options.chunkDims.empty()) {
+        if (options.chunkDims.size() != 3) {
+            fmt::print("Swizzled chunk shape must have three dimensions (x, y, z). Aborting.\n");
+            return false;
+        }
+        vector<hsize_t> chunkDims(options.chunkDims);
+        for (auto i = 0; i < 3; i++) {
+            chunkDims[i] = max<hsize_t>(1, min(chunkDims[i], targetDims[targetDims.size() - 3 + i]));
+        }
+        // Align slabs to whole chunks where possible, so that chunks are not rewritten by several slabs
+        if (rows >= chunkDims[1]) {
+            rows = rows / chunkDims[1] * chunkDims[1];
+        }
+        if (channels < depth && channels >= chunkDims[2]) {
+            channels = channels / chunkDims[2] * chunkDims[2];
+        }
+        // Chunks that remain partially written after a slab must stay in the chunk cache until the next one
+        size_t chunkBytes = chunkDims[0] * chunkDims[1] * chunkDims[2] * sizeof(float);
+        size_t openChunks = ((width + chunkDims[0] - 1) / chunkDims[0]) * ((channels + chunkDims[2] - 1) / chunkDims[2]);
+        size_t cacheBytes = min(openChunks * chunkBytes, options.memoryBudget);
+        accessProperties.setChunkCache(max<size_t>(521, openChunks * 10 + 1), cacheBytes, 1.0);
+        if (rank == 4) {
+            chunkDims.insert(chunkDims.begin(), 1);
+        }
+        createProperties.setChunk(chunkDims.size(), chunkDims.data());
+    }
+
+    if (!hduGroup.nameExists("SwizzledData")) {
+        hduGroup.createGroup("SwizzledData");
+    }
+    auto swizzledGroup = hduGroup.openGroup("SwizzledData");
+    string targetName = (rank == 4) ? "ZYXW" : "ZYX";
+    if (swizzledGroup.nameExists(targetName)) {
+        // The space of the old dataset is only reclaimed by repacking the file
+        swizzledGroup.unlink(targetName);
+    }
+    DataSpace targetSpace(targetDims.size(), targetDims.data());
+    auto target = swizzledGroup.createDataSet(targetName, PredType::NATIVE_FLOAT, targetSpace, createProperties, accessProperties);
+
+    vector<float> slab(channels * rows * width);
+    vector<float> swizzled(slab.size());
+    double readSeconds = 0, transposeSeconds = 0, writeSeconds = 0;
+
+    for (hsize_t s = 0; s < stokes; s++) {
+        for (hsize_t z = 0; z < depth; z += channels) {
+            for (hsize_t y = 0; y < height; y += rows) {
+                hsize_t numChannels = min(channels, depth - z);
+                hsize_t numRows = min(rows, height - y);
+
+                auto t0 = std::chrono::high_resolution_clock::now();
+                vector<hsize_t> count = {numChannels, numRows, width};
+                vector<hsize_t> start = {z, y, 0};
+                if (rank == 4) {
+                    count.insert(count.begin(), 1);
+                    start.insert(start.begin(), s);
+                }
+                DataSpace memspace(count.size(), count.data());
+                auto sourceSpace = source.getSpace();
+                sourceSpace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+                source.read(slab.data(), PredType::NATIVE_FLOAT, memspace, sourceSpace);
+
+                auto t1 = std::chrono::high_resolution_clock::now();
+                transposeSlab(slab.data(), swizzled.data(), numChannels, numRows, width);
+
+                auto t2 = std::chrono::high_resolution_clock::now();
+                vector<hsize_t> targetCount = {width, numRows, numChannels};
+                vector<hsize_t> targetStart = {0, y, z};
+                if (rank == 4) {
+                    targetCount.insert(targetCount.begin(), 1);
+                    targetStart.insert(targetStart.begin(), s);
+                }
+                DataSpace targetMemspace(targetCount.size(), targetCount.data());
+                auto targetSelection = target.getSpace();
+                targetSelection.selectHyperslab(H5S_SELECT_SET, targetCount.data(), targetStart.data());
+                target.write(swizzled.data(), PredType::NATIVE_FLOAT, targetMemspace, targetSelection);
+                auto t3 = std::chrono::high_resolution_clock::now();
+
+                readSeconds += std::chrono::duration<double>(t1 - t0).count();
+                transposeSeconds += std::chrono::duration<double>(t2 - t1).count();
+                writeSeconds += std::chrono::duration<double>(t3 - t2).count();
+            }
+        }
+    }
+    target.close();
+    file.flush(H5F_SCOPE_LOCAL);
+
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    double totalSeconds = std::chrono::duration<double>(tEnd - tStart).count();
+    double cubeMb = width * height * depth * stokes * sizeof(float) * 1.0e-6;
+    fmt::print("Swizzled {}x{}x{}x{} cube into SwizzledData/{} ({}) in {:.2f} s: {:.1f} MB/s\n", width, height, depth, stokes,
+               targetName, options.chunkDims.empty() ? "contiguous" : "chunked", totalSeconds, cubeMb / totalSeconds);
+    fmt::print("Slabs of {} channel(s) x {} row(s); read {:.2f} s, transpose {:.2f} s ({:.1f} MB/s), write {:.2f} s\n",
+               channels, rows, readSeconds, transposeSeconds, cubeMb / transposeSeconds, writeSeconds);
+    fmt::print("Peak RSS {:.1f} MB\n", peakResidentMb());
+    return true;
+}
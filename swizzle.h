@@ -0,0 +1,22 @@
+#ifndef ADASS_HDF5_BENCHMARK_SWIZZLE_H
+#define ADASS_HDF5_BENCHMARK_SWIZZLE_H
+
+#include <H5Cpp.h>
+#include <vector>
+
+struct SwizzleOptions {
+    // Chunk shape of the swizzled dataset in its own (x, y, z) order; empty for a contiguous layout
+    std::vector<hsize_t> chunkDims;
+    // Memory available for the input and output slab buffers, in bytes
+    size_t memoryBudget = 1024 * 1024 * 1024;
+};
+
+// Transposes a (channels, rows, columns) slab into (columns, rows, channels) order, in cache-sized tiles
+// processed in parallel
+void transposeSlab(const float* in, float* out, size_t channels, size_t rows, size_t columns);
+
+// Writes 0/SwizzledData/ZYX (or ZYXW for 4D cubes) from 0/DATA, replacing any existing swizzled dataset.
+// The cube is streamed in slabs of all columns and a band of rows, so memory use stays within the budget.
+bool swizzle(H5::H5File& file, const SwizzleOptions& options);
+
+#endif //ADASS_HDF5_BENCHMARK_SWIZZLE_H
@@ -0,0 +1,156 @@
+#include "tilecache.h"
+
+#include <algorithm>
+
+#include "downsample.h"
+
+using namespace std;
+
+bool TileKey::operator==(const TileKey& other) const {
+    return channel == other.channel && x == other.x && y == other.y && mip == other.mip && stokes == other.stokes
+           && dataSet == other.dataSet;
+}
+
+size_t TileKeyHash::operator()(const TileKey& key) const {
+    size_t hash = std::hash<string>()(key.dataSet);
+    for (auto val : {key.stokes, key.channel, key.mip, key.x, key.y}) {
+        hash = hash * 1000003 ^ std::hash<int>()(val);
+    }
+    return hash;
+}
+
+TileCache::TileCache(size_t budgetBytes, int tileSize)
+    : tileEdge(max(1, tileSize)) {
+    tileCapacity = max<size_t>(1, budgetBytes / (size_t(tileEdge) * tileEdge * sizeof(float)));
+}
+
+int TileCache::tileSize() const {
+    return tileEdge;
+}
+
+size_t TileCache::capacity() const {
+    return tileCapacity;
+}
+
+shared_ptr<Tile> TileCache::allocateTile() {
+    float* data;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (freeBuffers.empty()) {
+            buffers.emplace_back(new float[size_t(tileEdge) * tileEdge]);
+            freeBuffers.push_back(buffers.back().get());
+        }
+        data = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+    // The buffer returns to the pool once the cache and every reader have released the tile
+    return shared_ptr<Tile>(new Tile{TileKey(), 0, 0, data}, [this](Tile* tile) {
+        {
+            lock_guard<std::mutex> lock(mutex);
+            freeBuffers.push_back(tile->data);
+        }
+        delete tile;
+    });
+}
+
+shared_ptr<const Tile> TileCache::get(const TileKey& key, int width, int height, const function<void(float*)>& load) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        auto entry = index.find(key);
+        if (entry != index.end()) {
+            counters.hits++;
+            lru.splice(lru.begin(), lru, entry->second);
+            return *entry->second;
+        }
+        counters.misses++;
+    }
+
+    auto tile = allocateTile();
+    tile->key = key;
+    tile->width = width;
+    tile->height = height;
+    load(tile->data);
+
+    // Evicted tiles are released after the lock, since releasing the last reference takes it
+    shared_ptr<Tile> evicted;
+    lock_guard<std::mutex> lock(mutex);
+    auto entry = index.find(key);
+    if (entry != index.end()) {
+        // Another thread loaded the same tile in the meantime
+        return *entry->second;
+    }
+    if (lru.size() >= tileCapacity) {
+        evicted = move(lru.back());
+        index.erase(evicted->key);
+        lru.pop_back();
+        counters.evictions++;
+    }
+    lru.push_front(tile);
+    index[key] = lru.begin();
+    return tile;
+}
+
+TileCacheStats TileCache::stats() const {
+    lock_guard<std::mutex> lock(mutex);
+    TileCacheStats current(counters);
+    current.tiles = lru.size();
+    return current;
+}
+
+void TileCache::clear() {
+    list<shared_ptr<Tile>> released;
+    lock_guard<std::mutex> lock(mutex);
+    index.clear();
+    released.swap(lru);
+    counters = TileCacheStats();
+    // released is destroyed after the lock
+}
+
+void loadTile(DataReader* reader, const vector<hsize_t>& dims, const TileKey& key, int tileSize, int width, int height, float* dest) {
+    int rank = dims.size();
+    int mip = key.mip;
+    vector<hsize_t> count = {1, hsize_t(height * mip), hsize_t(width * mip)};
+    vector<hsize_t> start = {hsize_t(key.channel), hsize_t(key.y * tileSize * mip), hsize_t(key.x * tileSize * mip)};
+    if (rank == 4) {
+        count.insert(count.begin(), 1);
+        start.insert(start.begin(), key.stokes);
+    }
+    if (mip == 1) {
+        reader->read(start, count, dest);
+        return;
+    }
+    static thread_local vector<float> block;
+    block.resize(count[rank - 2] * count[rank - 1]);
+    reader->read(start, count, block.data());
+    downsample(block.data(), count[rank - 2], count[rank - 1], count[rank - 1], mip, DownsampleFilter::Mean, dest);
+}
+
+void readThroughTiles(TileCache& tileCache, DataReader* reader, const string& dataSetName, const vector<hsize_t>& dims,
+                      int stokes, int z, int x, int y, int width, int height, int mip, float* dest) {
+    int rank = dims.size();
+    int imageWidth = dims[rank - 1] / mip;
+    int imageHeight = dims[rank - 2] / mip;
+    int tileSize = tileCache.tileSize();
+
+    for (auto tileY = y / tileSize; tileY * tileSize < y + height; tileY++) {
+        for (auto tileX = x / tileSize; tileX * tileSize < x + width; tileX++) {
+            int tileWidth = min(tileSize, imageWidth - tileX * tileSize);
+            int tileHeight = min(tileSize, imageHeight - tileY * tileSize);
+            TileKey key = {dataSetName, stokes, z, mip, tileX, tileY};
+
+            auto tile = tileCache.get(key, tileWidth, tileHeight, [&](float* data) {
+                loadTile(reader, dims, key, tileSize, tileWidth, tileHeight, data);
+            });
+
+            // Copy the part of the tile that overlaps the region
+            int left = max(x, tileX * tileSize);
+            int right = min(x + width, tileX * tileSize + tile->width);
+            int top = max(y, tileY * tileSize);
+            int bottom = min(y + height, tileY * tileSize + tile->height);
+            for (auto row = top; row < bottom; row++) {
+                const float* source = tile->data + size_t(row - tileY * tileSize) * tile->width + (left - tileX * tileSize);
+                copy(source, source + (right - left), dest + size_t(row - y) * width + (left - x));
+            }
+        }
+    }
+}
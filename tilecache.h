@@ -0,0 +1,85 @@
+#ifndef ADASS_HDF5_BENCHMARK_TILECACHE_H
+#define ADASS_HDF5_BENCHMARK_TILECACHE_H
+
+#include <H5Cpp.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "reader.h"
+
+// A square tile of an XY-Image, down-sampled by mip. Tile (x, y) covers pixels [x * tileSize, (x + 1) * tileSize)
+// of the image down-sampled by mip, i.e. a block of tileSize * mip pixels at full resolution.
+struct TileKey {
+    std::string dataSet;
+    int stokes;
+    int channel;
+    int mip;
+    int x, y;
+
+    bool operator==(const TileKey& other) const;
+};
+
+struct TileKeyHash {
+    size_t operator()(const TileKey& key) const;
+};
+
+struct Tile {
+    TileKey key;
+    // Edge tiles are cropped to the image
+    int width, height;
+    float* data;
+};
+
+struct TileCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t tiles = 0;
+};
+
+// Least recently used cache of decoded tiles with a byte budget, safe to share between threads. Tile buffers come
+// from a pool and are recycled when evicted tiles are released, so lookups do not allocate them.
+class TileCache {
+public:
+    TileCache(size_t budgetBytes, int tileSize);
+    int tileSize() const;
+    size_t capacity() const;
+    // Returns the tile, filling a new one with load (which writes width x height floats) on a miss. Loads run
+    // without the lock held. Returned tiles remain valid after they are evicted, until they are released.
+    std::shared_ptr<const Tile> get(const TileKey& key, int width, int height, const std::function<void(float*)>& load);
+    TileCacheStats stats() const;
+    // Drops every tile and resets the statistics
+    void clear();
+
+private:
+    std::shared_ptr<Tile> allocateTile();
+
+    size_t tileCapacity;
+    int tileEdge;
+    mutable std::mutex mutex;
+    // Every buffer the pool has allocated, and those not in use. Declared before the tiles, which return
+    // their buffers to the pool when they are destroyed.
+    std::vector<std::unique_ptr<float[]>> buffers;
+    std::vector<float*> freeBuffers;
+    std::list<std::shared_ptr<Tile>> lru;
+    std::unordered_map<TileKey, std::list<std::shared_ptr<Tile>>::iterator, TileKeyHash> index;
+    TileCacheStats counters;
+};
+
+// Reads the tile of a dataset named by key, which is width x height floats (cropped to the image at the edges),
+// into dest, down-sampling its block of the full-resolution image with a NaN-aware mean
+void loadTile(DataReader* reader, const std::vector<hsize_t>& dims, const TileKey& key, int tileSize, int width, int height, float* dest);
+
+// Reads the region [x, x + width) x [y, y + height) of channel z (in stokes) of a dataset, down-sampled by mip
+// with a NaN-aware mean, through the cache. x, y, width and height are in down-sampled pixels, so the result
+// is height x width floats and matches down-sampling the full image. Tiles missing from the cache are read
+// with reader.
+void readThroughTiles(TileCache& tileCache, DataReader* reader, const std::string& dataSetName, const std::vector<hsize_t>& dims,
+                      int stokes, int z, int x, int y, int width, int height, int mip, float* dest);
+
+#endif //ADASS_HDF5_BENCHMARK_TILECACHE_H
@@ -0,0 +1,123 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fmt/format.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+bool readTrace(const string& filename, vector<TraceEntry>& entries) {
+    ifstream input(filename);
+    if (!input) {
+        fmt::print("Could not open trace {}.\n", filename);
+        return false;
+    }
+    entries.clear();
+    string line;
+    for (auto lineNumber = 1; getline(input, line); lineNumber++) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        istringstream fields(line);
+        TraceEntry entry;
+        string patternName;
+        auto& r = entry.request;
+        vector<pair<LoadPattern, double>> pattern;
+        if (!(fields >> entry.timeMs >> patternName >> r.dataSet >> r.stokes >> r.channel >> r.channels >> r.x >> r.y >> r.width
+                     >> r.height >> r.mip) || !parseLoadMix(patternName, pattern) || pattern.size() != 1) {
+            fmt::print("Invalid request on line {} of {}.\n", lineNumber, filename);
+            return false;
+        }
+        r.pattern = pattern[0].first;
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+bool writeTrace(const string& filename, const vector<TraceEntry>& entries) {
+    ofstream output(filename);
+    if (!output) {
+        fmt::print("Could not create trace {}.\n", filename);
+        return false;
+    }
+    output << "# time_ms pattern dataset stokes channel channels x y width height mip\n";
+    for (auto& entry : entries) {
+        auto& r = entry.request;
+        output << fmt::format("{:.3f} {} {} {} {} {} {} {} {} {} {}\n", entry.timeMs, loadPatternName(r.pattern), r.dataSet, r.stokes,
+                              r.channel, r.channels, r.x, r.y, r.width, r.height, r.mip);
+    }
+    return bool(output);
+}
+
+vector<TraceEntry> generateTrace(const vector<hsize_t>& dims, const LoadOptions& options, size_t count) {
+    int rank = dims.size();
+    int regionSize = options.regionSize;
+    if (regionSize <= 0) {
+        regionSize = ceil(sqrt(0.001) * min(dims[rank - 1], dims[rank - 2]));
+    }
+    mt19937 rng(options.seed);
+    vector<double> weights;
+    for (auto& entry : options.mix) {
+        weights.push_back(entry.second);
+    }
+    discrete_distribution<int> choosePattern(weights.begin(), weights.end());
+    exponential_distribution<double> interArrival(options.rate > 0 ? options.rate : 1.0);
+
+    vector<TraceEntry> entries;
+    double seconds = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (options.rate > 0) {
+            seconds += interArrival(rng);
+        }
+        auto pattern = options.mix[choosePattern(rng)].first;
+        entries.push_back({seconds * 1.0e3, randomRequest(pattern, dims, regionSize, options.mip, rng)});
+    }
+    return entries;
+}
+
+LoadResult replayTrace(const vector<TraceEntry>& entries, const function<DataReader*(const string&)>& readerFor,
+                       const vector<hsize_t>& dims, const ReplayOptions& options, TileCache* tileCache) {
+    vector<string> names;
+    vector<vector<double>> latencies;
+    vector<float> data, result;
+    size_t bytes = 0;
+    double speed = options.speed > 0 ? options.speed : 1;
+
+    auto tStart = Clock::now();
+    for (auto& entry : entries) {
+        auto name = loadPatternName(entry.request.pattern);
+        auto index = find(names.begin(), names.end(), name) - names.begin();
+        if (index == names.size()) {
+            names.push_back(name);
+            latencies.emplace_back();
+        }
+
+        Clock::time_point issued;
+        if (options.paced) {
+            issued = tStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, milli>(entry.timeMs / speed));
+            this_thread::sleep_until(issued);
+        } else {
+            issued = Clock::now();
+        }
+        bytes += serveRequest(entry.request, readerFor(entry.request.dataSet), dims, data, result, tileCache);
+        latencies[index].push_back(std::chrono::duration<double, milli>(Clock::now() - issued).count());
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - tStart).count();
+
+    LoadResult replay;
+    replay.clients = 1;
+    double traceSeconds = entries.empty() ? 0 : entries.back().timeMs * 1.0e-3 / speed;
+    replay.offeredRate = (options.paced && traceSeconds > 0) ? entries.size() / traceSeconds : NAN;
+    replay.completedRate = seconds > 0 ? entries.size() / seconds : NAN;
+    replay.mbPerSec = seconds > 0 ? bytes * 1.0e-6 / seconds : NAN;
+    replay.requests = entries.size();
+    replay.dropped = 0;
+    replay.patterns = latencyStats(names, latencies);
+    return replay;
+}
@@ -0,0 +1,40 @@
+#ifndef ADASS_HDF5_BENCHMARK_TRACE_H
+#define ADASS_HDF5_BENCHMARK_TRACE_H
+
+#include <H5Cpp.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "load.h"
+#include "reader.h"
+#include "tilecache.h"
+
+// A request and when it was issued, in ms from the start of the trace
+struct TraceEntry {
+    double timeMs;
+    LoadRequest request;
+};
+
+// Traces are text files with one request per line, ordered by time, as
+//     time_ms pattern dataset stokes channel channels x y width height mip
+// e.g. "12.5 xy main 0 40 1 0 0 4096 4096 1". Lines starting with # are comments.
+bool readTrace(const std::string& filename, std::vector<TraceEntry>& entries);
+bool writeTrace(const std::string& filename, const std::vector<TraceEntry>& entries);
+
+// A trace of count requests drawn from the mix with the given seed, arriving as a Poisson process at
+// options.rate (all at time 0 if the rate is 0)
+std::vector<TraceEntry> generateTrace(const std::vector<hsize_t>& dims, const LoadOptions& options, size_t count);
+
+struct ReplayOptions {
+    // Issue requests at their recorded times (divided by speed) rather than back to back
+    bool paced = false;
+    double speed = 1;
+};
+
+// Replays a trace with the reader returned for each dataset name. Paced requests that fall behind are issued late,
+// and their latency is measured from their scheduled time.
+LoadResult replayTrace(const std::vector<TraceEntry>& entries, const std::function<DataReader*(const std::string&)>& readerFor,
+                       const std::vector<hsize_t>& dims, const ReplayOptions& options, TileCache* tileCache = nullptr);
+
+#endif //ADASS_HDF5_BENCHMARK_TRACE_H
@@ -0,0 +1,405 @@
+#include "viewport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#include <mutex>
+#include <thread>
+#include <omp.h>
+
+#include "downsample.h"
+#include "stats.h"
+
+using namespace std;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+typedef void (*EncodeFunction)(TileEncoding encoding, const float* in, size_t n, float minVal, float scale, uint8_t* out);
+
+bool parseTileEncoding(const string& name, TileEncoding& encoding) {
+    if (name == "float32") {
+        encoding = TileEncoding::Float32;
+    } else if (name == "float16") {
+        encoding = TileEncoding::Float16;
+    } else if (name == "uint16") {
+        encoding = TileEncoding::Uint16;
+    } else if (name == "uint8") {
+        encoding = TileEncoding::Uint8;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+string tileEncodingName(TileEncoding encoding) {
+    switch (encoding) {
+        case TileEncoding::Float32: return "float32";
+        case TileEncoding::Float16: return "float16";
+        case TileEncoding::Uint16: return "uint16";
+        case TileEncoding::Uint8: return "uint8";
+    }
+    return "unknown";
+}
+
+static size_t valueBytes(TileEncoding encoding) {
+    switch (encoding) {
+        case TileEncoding::Float32: return sizeof(float);
+        case TileEncoding::Float16: return sizeof(uint16_t);
+        case TileEncoding::Uint16: return sizeof(uint16_t);
+        case TileEncoding::Uint8: return sizeof(uint8_t);
+    }
+    return 0;
+}
+
+static bool quantized(TileEncoding encoding) {
+    return encoding == TileEncoding::Uint16 || encoding == TileEncoding::Uint8;
+}
+
+// Highest code of a quantized encoding
+static float topCode(TileEncoding encoding) {
+    return encoding == TileEncoding::Uint8 ? 255.0f : 65535.0f;
+}
+
+size_t encodedTileBytes(TileEncoding encoding, size_t n) {
+    return (quantized(encoding) ? 2 * sizeof(float) : 0) + n * valueBytes(encoding);
+}
+
+// Rounds to the nearest half, ties to even, as F16C does
+static uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+    if (magnitude >= 0x7f800000) {
+        // Infinity, or a NaN made quiet
+        return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 | ((magnitude >> 13) & 0x3ff) : 0);
+    }
+    if (magnitude >= 0x477ff000) {
+        // 65520 and above round to infinity
+        return sign | 0x7c00;
+    }
+    if (magnitude < 0x38800000) {
+        // Below 2^-14 the half is subnormal, in units of 2^-24
+        if (magnitude < 0x33000000) {
+            return sign;
+        }
+        uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+        int shift = 126 - int(magnitude >> 23);
+        uint32_t result = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if (remainder > half || (remainder == half && (result & 1))) {
+            result++;
+        }
+        return sign | result;
+    }
+    uint32_t rebiased = magnitude - 0x38000000;
+    return sign | ((rebiased + 0xfff + ((rebiased >> 13) & 1)) >> 13);
+}
+
+static float halfToFloat(uint16_t half) {
+    uint32_t sign = uint32_t(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else {
+        float value = mantissa * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Code of a value: 0 for NaN, and 1 to top across the range. Adding 1.5 and truncating rounds to the nearest code.
+// The clamps keep the second operand when the code is NaN (an infinity times a zero scale), as the SIMD min and max
+// do, so that every level gives the same codes and the conversion is always defined.
+static inline uint32_t quantize(float value, float minVal, float scale, float top) {
+    if (isnan(value)) {
+        return 0;
+    }
+    float code = (value - minVal) * scale + 1.5f;
+    code = code > 1.0f ? code : 1.0f;
+    code = code < top ? code : top;
+    return uint32_t(code);
+}
+
+static void encodeScalar(TileEncoding encoding, const float* in, size_t n, float minVal, float scale, uint8_t* out) {
+    switch (encoding) {
+        case TileEncoding::Float32:
+            memcpy(out, in, n * sizeof(float));
+            break;
+        case TileEncoding::Float16:
+            for (size_t i = 0; i < n; i++) {
+                uint16_t code = floatToHalf(in[i]);
+                memcpy(out + i * sizeof(code), &code, sizeof(code));
+            }
+            break;
+        case TileEncoding::Uint16:
+            for (size_t i = 0; i < n; i++) {
+                uint16_t code = quantize(in[i], minVal, scale, 65535.0f);
+                memcpy(out + i * sizeof(code), &code, sizeof(code));
+            }
+            break;
+        case TileEncoding::Uint8:
+            for (size_t i = 0; i < n; i++) {
+                out[i] = quantize(in[i], minVal, scale, 255.0f);
+            }
+            break;
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i quantizeAvx2(__m256 values, __m256 minimum, __m256 scale, __m256 top) {
+    __m256 code = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(values, minimum), scale), _mm256_set1_ps(1.5f));
+    code = _mm256_min_ps(_mm256_max_ps(code, _mm256_set1_ps(1.0f)), top);
+    code = _mm256_and_ps(code, _mm256_cmp_ps(values, values, _CMP_ORD_Q));
+    return _mm256_cvttps_epi32(code);
+}
+
+// Codes of 8 values as 16-bit integers
+__attribute__((target("avx2")))
+static inline __m128i packAvx2(__m256i codes) {
+    return _mm_packus_epi32(_mm256_castsi256_si128(codes), _mm256_extracti128_si256(codes, 1));
+}
+
+__attribute__((target("avx2,f16c")))
+static void encodeAvx2(TileEncoding encoding, const float* in, size_t n, float minVal, float scale, uint8_t* out) {
+    __m256 minimum = _mm256_set1_ps(minVal);
+    __m256 scales = _mm256_set1_ps(scale);
+    size_t i = 0;
+    switch (encoding) {
+        case TileEncoding::Float32:
+            i = n;
+            memcpy(out, in, n * sizeof(float));
+            break;
+        case TileEncoding::Float16:
+            for (; i + 8 <= n; i += 8) {
+                _mm_storeu_si128((__m128i*) (out + i * 2), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+            }
+            break;
+        case TileEncoding::Uint16:
+            for (; i + 8 <= n; i += 8) {
+                __m256i codes = quantizeAvx2(_mm256_loadu_ps(in + i), minimum, scales, _mm256_set1_ps(65535.0f));
+                _mm_storeu_si128((__m128i*) (out + i * 2), packAvx2(codes));
+            }
+            break;
+        case TileEncoding::Uint8:
+            for (; i + 16 <= n; i += 16) {
+                __m128i low = packAvx2(quantizeAvx2(_mm256_loadu_ps(in + i), minimum, scales, _mm256_set1_ps(255.0f)));
+                __m128i high = packAvx2(quantizeAvx2(_mm256_loadu_ps(in + i + 8), minimum, scales, _mm256_set1_ps(255.0f)));
+                _mm_storeu_si128((__m128i*) (out + i), _mm_packus_epi16(low, high));
+            }
+            break;
+    }
+    encodeScalar(encoding, in + i, n - i, minVal, scale, out + i * valueBytes(encoding));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i quantizeAvx512(__m512 values, __m512 minimum, __m512 scale, __m512 top) {
+    __m512 code = _mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(values, minimum), scale), _mm512_set1_ps(1.5f));
+    code = _mm512_min_ps(_mm512_max_ps(code, _mm512_set1_ps(1.0f)), top);
+    code = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(values, values, _CMP_ORD_Q), code);
+    return _mm512_cvttps_epi32(code);
+}
+
+__attribute__((target("avx512f")))
+static void encodeAvx512(TileEncoding encoding, const float* in, size_t n, float minVal, float scale, uint8_t* out) {
+    __m512 minimum = _mm512_set1_ps(minVal);
+    __m512 scales = _mm512_set1_ps(scale);
+    size_t i = 0;
+    switch (encoding) {
+        case TileEncoding::Float32:
+            i = n;
+            memcpy(out, in, n * sizeof(float));
+            break;
+        case TileEncoding::Float16:
+            for (; i + 16 <= n; i += 16) {
+                _mm256_storeu_si256((__m256i*) (out + i * 2), _mm512_cvtps_ph(_mm512_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+            }
+            break;
+        case TileEncoding::Uint16:
+            for (; i + 16 <= n; i += 16) {
+                __m512i codes = quantizeAvx512(_mm512_loadu_ps(in + i), minimum, scales, _mm512_set1_ps(65535.0f));
+                _mm256_storeu_si256((__m256i*) (out + i * 2), _mm512_cvtepi32_epi16(codes));
+            }
+            break;
+        case TileEncoding::Uint8:
+            for (; i + 16 <= n; i += 16) {
+                __m512i codes = quantizeAvx512(_mm512_loadu_ps(in + i), minimum, scales, _mm512_set1_ps(255.0f));
+                _mm_storeu_si128((__m128i*) (out + i), _mm512_cvtepi32_epi8(codes));
+            }
+            break;
+    }
+    encodeScalar(encoding, in + i, n - i, minVal, scale, out + i * valueBytes(encoding));
+}
+
+void encodeTile(TileEncoding encoding, const float* in, size_t n, uint8_t* out) {
+    static const EncodeFunction functions[3] = {encodeScalar, encodeAvx2, encodeAvx512};
+    // Every AVX2 CPU so far has F16C, but the half conversions check rather than assume it
+    static const bool f16c = __builtin_cpu_supports("f16c");
+    auto level = getSimdLevel();
+    if (encoding == TileEncoding::Float16 && level == SimdLevel::Avx2 && !f16c) {
+        level = SimdLevel::Scalar;
+    }
+
+    float minVal = 0, scale = 0;
+    if (quantized(encoding)) {
+        auto stats = calculateStats(in, n);
+        float maxVal = minVal;
+        if (stats.count) {
+            minVal = stats.minVal;
+            maxVal = stats.maxVal;
+        }
+        // An infinite end would leave no codes for the finite values, so the range then spans the finite ones only
+        if (!isfinite(minVal) || !isfinite(maxVal)) {
+            minVal = INFINITY;
+            maxVal = -INFINITY;
+            for (size_t i = 0; i < n; i++) {
+                if (isfinite(in[i])) {
+                    minVal = min(minVal, in[i]);
+                    maxVal = max(maxVal, in[i]);
+                }
+            }
+            if (minVal > maxVal) {
+                minVal = maxVal = 0;
+            }
+        }
+        // In double, as the width of a range of finite floats can overflow a float
+        scale = (maxVal > minVal) ? float((topCode(encoding) - 1) / (double(maxVal) - minVal)) : 0;
+        memcpy(out, &minVal, sizeof(float));
+        memcpy(out + sizeof(float), &maxVal, sizeof(float));
+        out += 2 * sizeof(float);
+    }
+    functions[(int) level](encoding, in, n, minVal, scale, out);
+}
+
+void decodeTile(TileEncoding encoding, const uint8_t* in, size_t n, float* out) {
+    if (encoding == TileEncoding::Float32) {
+        memcpy(out, in, n * sizeof(float));
+        return;
+    }
+    if (encoding == TileEncoding::Float16) {
+        for (size_t i = 0; i < n; i++) {
+            uint16_t code;
+            memcpy(&code, in + i * sizeof(code), sizeof(code));
+            out[i] = halfToFloat(code);
+        }
+        return;
+    }
+    float minVal, maxVal;
+    memcpy(&minVal, in, sizeof(float));
+    memcpy(&maxVal, in + sizeof(float), sizeof(float));
+    in += 2 * sizeof(float);
+    double step = (double(maxVal) - minVal) / (topCode(encoding) - 1);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t code = in[i];
+        if (encoding == TileEncoding::Uint16) {
+            uint16_t wide;
+            memcpy(&wide, in + i * sizeof(wide), sizeof(wide));
+            code = wide;
+        }
+        out[i] = code ? float(minVal + (code - 1) * step) : NAN;
+    }
+}
+
+vector<pair<int, int>> viewportTiles(const vector<hsize_t>& dims, const Viewport& viewport, int tileSize) {
+    int rank = dims.size();
+    int imageWidth = dims[rank - 1] / viewport.mip;
+    int imageHeight = dims[rank - 2] / viewport.mip;
+    int right = min(imageWidth, viewport.x + viewport.width);
+    int bottom = min(imageHeight, viewport.y + viewport.height);
+    vector<pair<int, int>> tiles;
+    for (auto tileY = viewport.y / tileSize; tileY * tileSize < bottom; tileY++) {
+        for (auto tileX = viewport.x / tileSize; tileX * tileSize < right; tileX++) {
+            tiles.push_back({tileX, tileY});
+        }
+    }
+    return tiles;
+}
+
+ViewportResult renderViewport(vector<unique_ptr<DataReader>>& readers, TileCache* tileCache, const string& dataSetName,
+                              const vector<hsize_t>& dims, const Viewport& viewport, int tileSize, TileEncoding encoding,
+                              vector<vector<uint8_t>>& encodedTiles) {
+    if (tileCache) {
+        tileSize = tileCache->tileSize();
+    }
+    auto tiles = viewportTiles(dims, viewport, tileSize);
+    int rank = dims.size();
+    int imageWidth = dims[rank - 1] / viewport.mip;
+    int imageHeight = dims[rank - 2] / viewport.mip;
+    encodedTiles.assign(tiles.size(), {});
+
+    ViewportResult result = {0, NAN, {}, 0, 0, 0, 0};
+    atomic<size_t> nextTile(0);
+    mutex resultMutex;
+    auto tStart = Clock::now();
+    // Tiles are the unit of parallelism, so each thread down-samples its tiles on one OpenMP thread
+    auto renderTiles = [&](DataReader* reader) {
+#ifdef _OPENMP
+        omp_set_num_threads(1);
+#endif
+        vector<float> buffer;
+        for (size_t i = nextTile++; i < tiles.size(); i = nextTile++) {
+            auto t0 = Clock::now();
+            int tileWidth = min(tileSize, imageWidth - tiles[i].first * tileSize);
+            int tileHeight = min(tileSize, imageHeight - tiles[i].second * tileSize);
+            size_t n = size_t(tileWidth) * tileHeight;
+            size_t bytesRead = 0;
+            TileKey key = {dataSetName, viewport.stokes, viewport.z, viewport.mip, tiles[i].first, tiles[i].second};
+            auto load = [&](float* data) {
+                loadTile(reader, dims, key, tileSize, tileWidth, tileHeight, data);
+                bytesRead = n * viewport.mip * viewport.mip * sizeof(float);
+            };
+            shared_ptr<const Tile> cachedTile;
+            const float* data;
+            if (tileCache) {
+                cachedTile = tileCache->get(key, tileWidth, tileHeight, load);
+                data = cachedTile->data;
+            } else {
+                buffer.resize(n);
+                load(buffer.data());
+                data = buffer.data();
+            }
+            auto t1 = Clock::now();
+            encodedTiles[i].resize(encodedTileBytes(encoding, n));
+            encodeTile(encoding, data, n, encodedTiles[i].data());
+            auto t2 = Clock::now();
+
+            lock_guard<mutex> lock(resultMutex);
+            result.tileMs.push_back(std::chrono::duration<double, milli>(t2 - t0).count());
+            if (result.tileMs.size() == 1) {
+                result.firstTileMs = std::chrono::duration<double, milli>(t2 - tStart).count();
+            }
+            result.fetchMs += std::chrono::duration<double, milli>(t1 - t0).count();
+            result.encodeMs += std::chrono::duration<double, milli>(t2 - t1).count();
+            result.bytesRead += bytesRead;
+            result.outputBytes += encodedTiles[i].size();
+        }
+    };
+
+    // The calling thread renders too, and gets its OpenMP thread count back afterwards
+#ifdef _OPENMP
+    int ompThreads = omp_get_max_threads();
+#endif
+    vector<thread> threads;
+    for (size_t t = 1; t < readers.size(); t++) {
+        threads.emplace_back(renderTiles, readers[t].get());
+    }
+    renderTiles(readers[0].get());
+    for (auto& thread : threads) {
+        thread.join();
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(ompThreads);
+#endif
+    result.totalMs = std::chrono::duration<double, milli>(Clock::now() - tStart).count();
+    return result;
+}
@@ -0,0 +1,70 @@
+#ifndef ADASS_HDF5_BENCHMARK_VIEWPORT_H
+#define ADASS_HDF5_BENCHMARK_VIEWPORT_H
+
+#include <H5Cpp.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "reader.h"
+#include "tilecache.h"
+
+// Encoding of the tiles sent to a client
+enum class TileEncoding {
+    Float32,
+    // IEEE half precision, rounded to nearest even; NaNs stay NaN
+    Float16,
+    // Linear in the tile's range, preceded by its minimum and maximum as two floats. Code 0 is NaN, and codes
+    // 1 to 2^bits - 1 span the range of the finite values; infinities are clamped into it.
+    Uint16,
+    Uint8
+};
+
+bool parseTileEncoding(const std::string& name, TileEncoding& encoding);
+std::string tileEncodingName(TileEncoding encoding);
+
+// Bytes of a tile of n values in the encoding
+size_t encodedTileBytes(TileEncoding encoding, size_t n);
+// Encodes n values into out, which holds encodedTileBytes(encoding, n) bytes, with the SIMD kernels selected by
+// setSimdLevel (see downsample.h). Every level gives the same bytes.
+void encodeTile(TileEncoding encoding, const float* in, size_t n, uint8_t* out);
+// Decodes an encoded tile, as a client would
+void decodeTile(TileEncoding encoding, const uint8_t* in, size_t n, float* out);
+
+// A view of channel z (in stokes) at a zoom level: [x, x + width) x [y, y + height) of the image down-sampled by mip
+struct Viewport {
+    int stokes;
+    int z;
+    int mip;
+    int x, y, width, height;
+};
+
+struct ViewportResult {
+    // From the first request until every tile was encoded, and until the first one was
+    double totalMs;
+    double firstTileMs;
+    // Time of each tile, from its request until it was encoded, in the order they finished
+    std::vector<double> tileMs;
+    // Fetching and down-sampling, and encoding, summed over tiles
+    double fetchMs;
+    double encodeMs;
+    // Full-resolution bytes read for the tiles (0 for tiles found in the tile cache), and encoded bytes sent
+    size_t bytesRead;
+    size_t outputBytes;
+};
+
+// Tiles (x, y) of the grid of tileSize tiles at the viewport's mip that overlap it, row by row
+std::vector<std::pair<int, int>> viewportTiles(const std::vector<hsize_t>& dims, const Viewport& viewport, int tileSize);
+
+// Fetches, down-samples (NaN-aware mean) and encodes every tile of a viewport of a dataset, on one thread per reader,
+// each down-sampling on one OpenMP thread.
+// Each thread takes the next tile not yet started. Tiles are read through tileCache if one is given (with its tile
+// size), and as tileSize tiles otherwise. Edge tiles are cropped to the image; tiles are not cropped to the viewport.
+// encodedTiles receives the encoded tiles, in the order of viewportTiles.
+ViewportResult renderViewport(std::vector<std::unique_ptr<DataReader>>& readers, TileCache* tileCache, const std::string& dataSetName,
+                              const std::vector<hsize_t>& dims, const Viewport& viewport, int tileSize, TileEncoding encoding,
+                              std::vector<std::vector<uint8_t>>& encodedTiles);
+
+#endif //ADASS_HDF5_BENCHMARK_VIEWPORT_H